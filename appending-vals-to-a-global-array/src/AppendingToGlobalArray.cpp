@@ -4,6 +4,7 @@
 #include <poputil/TileMapping.hpp>
 #include <popops/ElementWise.hpp>
 #include <popops/codelets.hpp>
+#include <popops/Zero.hpp>
 #include <poplar/Program.hpp>
 #include <algorithm>
 
@@ -27,11 +28,16 @@ int main() {
     popops::addCodelets(graph);
 
     auto data = graph.addVariable(FLOAT, {NumIterations}, "data"); // Where we will store the results
-    poputil::mapTensorLinearly(graph, data);
+    const auto dataMapping = ipu::LinearTileMapping{}.apply(graph, data);
 
     auto latestResult = graph.addVariable(FLOAT, {}, "latestResult");
     graph.setTileMapping(latestResult, 0); // Store latest result on tile 0, it will be broadcast to all others
 
+    // The slot the latest result goes in. It lives in a tensor rather than in each vertex, so that it can be reset
+    // before every run: otherwise only the first run would append anything
+    auto index = graph.addVariable(UNSIGNED_INT, {}, "index");
+    graph.setTileMapping(index, 0);
+
     // A dummy operation where we calculate a new value for
     // the latest result and store it in latestResult.
     auto calculateLatestResult = [&](Tensor &latestResult) -> auto {
@@ -49,18 +55,17 @@ int main() {
     // matches the current iteration will write the latest value to the array
     auto appendResult = [&](Tensor &data, Tensor &latestResult) -> auto {
         auto cs = graph.addComputeSet("appendLatest");
-        auto tileMapping = graph.getTileMapping(data);
         auto tileNum = 0;
-        for (auto &tile : tileMapping) {
+        for (auto &tile : dataMapping) {
             for (auto chunk: tile) {
                 auto from = chunk.begin();
                 auto to = chunk.end();
                 auto v = graph.addVertex(cs, "AppendValToGlobalArray", {
                         {"results",       data.slice(from, to)},
-                        {"currentResult", latestResult}
+                        {"currentResult", latestResult},
+                        {"index",         index}
                 });
                 graph.setTileMapping(v, tileNum);
-                graph.setInitialValue(v["index"], 0);
                 graph.setInitialValue(v["myStartIndex"], from);
             }
             tileNum++;
@@ -68,19 +73,34 @@ int main() {
         return Execute(cs);
     };
 
-    const auto program = Repeat(
+    auto incrementIndex = [&]() -> auto {
+        auto cs = graph.addComputeSet("incrementIndex");
+        auto v = graph.addVertex(cs, "IncrementIndex", {{"index", index}});
+        graph.setTileMapping(v, 0);
+        return Execute(cs);
+    };
+
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
+    auto program = Sequence{};
+    popops::zero(graph, index, program, "resetIndex");
+    program.add(Repeat(
             NumIterations,
-            Sequence{calculateLatestResult(latestResult),
-                     appendResult(data, latestResult)
+            Sequence{cycles.wrap("calcNextResult", calculateLatestResult(latestResult)),
+                     cycles.wrap("appendLatest", appendResult(data, latestResult)),
+                     incrementIndex()
             }
-    );
+    ));
 
 
     auto engine = ipu::prepareEngine(graph, {program}, *device);
-
-    auto timer = ipu::startTimer("Running append program");
-    engine.run(0);
-    ipu::endTimer(timer);
+    cycles.connect(engine);
+
+    auto bench = ipu::Benchmark::fromEnvironment("appendingToGlobalArray")
+            .throughput("appends", NumIterations)
+            .afterWarmups([&]() { cycles.reset(); });
+    bench.run([&]() { engine.run(0); });
+    bench.report();
+    cycles.report();
 
     return EXIT_SUCCESS;
 }
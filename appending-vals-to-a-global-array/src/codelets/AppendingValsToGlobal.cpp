@@ -13,17 +13,28 @@ using namespace poplar;
 class AppendValToGlobalArray : public Vertex {
 public:
     Input<float> currentResult;
+    Input<unsigned> index;
     Output <Vector<float>> results;
-    int index;
-    int myStartIndex;
+    unsigned myStartIndex;
 
     auto compute() -> bool {
-        const bool onOrAfterStartOfMyRange = (index >= myStartIndex);
-        const bool beforeEndOfMyRange = (index < myStartIndex + results.size());
+        const bool onOrAfterStartOfMyRange = (*index >= myStartIndex);
+        const bool beforeEndOfMyRange = (*index < myStartIndex + results.size());
         if (onOrAfterStartOfMyRange && beforeEndOfMyRange) {
-            results[index - myStartIndex] = *currentResult;
+            results[*index - myStartIndex] = *currentResult;
         }
-        index++;
+        return true;
+    }
+};
+
+
+/* Moves the shared index on to the next slot once every tile has appended */
+class IncrementIndex : public Vertex {
+public:
+    InOut<unsigned> index;
+
+    auto compute() -> bool {
+        *index = *index + 1;
         return true;
     }
 };
@@ -0,0 +1,232 @@
+#ifndef IPU_BENCHMARK_HPP
+#define IPU_BENCHMARK_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <poplar/VersionInfo.hpp>
+
+namespace ipu {
+    using namespace std;
+
+    /** Summary statistics (in seconds) over the measured runs of a benchmark */
+    struct BenchmarkStats {
+        size_t runs = 0;
+        double min = 0;
+        double median = 0;
+        double p95 = 0;
+        double mean = 0;
+        double stddev = 0;
+
+        static auto of(vector<double> samples) -> BenchmarkStats {
+            auto stats = BenchmarkStats{};
+            if (samples.empty()) return stats;
+
+            sort(samples.begin(), samples.end());
+            const auto n = samples.size();
+            // Nearest-rank percentile, so p95 is always a time we actually measured
+            const auto percentile = [&](const double p) -> double {
+                const auto rank = static_cast<size_t>(ceil(p / 100.0 * n));
+                return samples[max<size_t>(rank, 1) - 1];
+            };
+            stats.runs = n;
+            stats.min = samples.front();
+            stats.median = n % 2 == 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+            stats.p95 = percentile(95);
+            stats.mean = accumulate(samples.begin(), samples.end(), 0.0) / n;
+            if (n > 1) {
+                auto sumOfSquares = 0.0;
+                for (const auto s: samples) sumOfSquares += (s - stats.mean) * (s - stats.mean);
+                stats.stddev = sqrt(sumOfSquares / (n - 1));
+            }
+            return stats;
+        }
+    };
+
+    /**
+     * Times a piece of work repeatedly: some warmup runs that are thrown away (to get past first-run effects like
+     * lazily loaded programs and cold host caches), and then a number of measured runs that we summarise as
+     * min/median/p95/mean/stddev. Throughputs (e.g. cells/s, GB/s) are derived from the median time.
+     *
+     * The number of warmups and runs can be overridden with the IPU_BENCH_WARMUPS and IPU_BENCH_RUNS environment
+     * variables. If IPU_BENCH_OUTPUT names a .csv or .json file, results are appended to it (JSON output is one
+     * object per line), tagged with the Poplar SDK version, so results can be tracked across SDK versions.
+     *
+     *     auto bench = ipu::Benchmark::fromEnvironment("haloExchange", 1, 10)
+     *             .throughput("cells", numCells * numIters)
+     *             .afterWarmups([&]() { cycles.reset(); }); // So the cycle counts only cover measured runs
+     *     bench.run([&]() { engine.run(0); });
+     *     bench.report();
+     */
+    class Benchmark {
+        struct Throughput {
+            string unit;
+            double amountPerRun;
+        };
+
+        string t_name;
+        unsigned t_warmups;
+        unsigned t_runs;
+        unsigned t_calls = 0;
+        vector<double> t_samples;
+        vector<Throughput> t_throughputs;
+        vector<pair<string, string>> t_tags;
+        function<void()> t_afterWarmups;
+
+        static auto escaped(const string &s) -> string {
+            auto result = string{};
+            for (const auto c: s) {
+                if (c == '"' || c == '\\') result += '\\';
+                result += c;
+            }
+            return result;
+        }
+
+    public:
+        explicit Benchmark(string name, const unsigned warmups = 1, const unsigned runs = 10) :
+                t_name(move(name)), t_warmups(warmups), t_runs(runs) {}
+
+        static auto fromEnvironment(const string &name, const unsigned defaultWarmups = 1,
+                                    const unsigned defaultRuns = 10) -> Benchmark {
+            const auto warmups = getenv("IPU_BENCH_WARMUPS");
+            const auto runs = getenv("IPU_BENCH_RUNS");
+            return Benchmark{name,
+                             warmups != nullptr ? (unsigned) stoul(warmups) : defaultWarmups,
+                             runs != nullptr ? (unsigned) stoul(runs) : defaultRuns};
+        }
+
+        /** Report <unit>/s, where each measured run processes amountPerRun units */
+        auto throughput(const string &unit, const double amountPerRun) -> Benchmark & {
+            t_throughputs.push_back({unit, amountPerRun});
+            return *this;
+        }
+
+        /** Called once the warmups are done, before the first measured run, e.g. to reset on-device counters */
+        auto afterWarmups(function<void()> f) -> Benchmark & {
+            t_afterWarmups = move(f);
+            return *this;
+        }
+
+        /** Extra context (strategy, problem size, target...) written alongside the results */
+        auto tag(const string &key, const string &value) -> Benchmark & {
+            t_tags.emplace_back(key, value);
+            return *this;
+        }
+
+        [[nodiscard]] auto warmups() const -> unsigned { return t_warmups; }
+
+        [[nodiscard]] auto runs() const -> unsigned { return t_runs; }
+
+        /**
+         * Times one call of f. The first `warmups` calls are thrown away and the rest are recorded, so this can be
+         * used directly in a loop that does other (untimed) work between runs
+         */
+        auto measure(const function<void()> &f) -> double {
+            if (t_calls == t_warmups && t_afterWarmups) t_afterWarmups();
+            const auto tic = chrono::high_resolution_clock::now();
+            f();
+            const auto toc = chrono::high_resolution_clock::now();
+            const auto seconds = chrono::duration_cast<chrono::duration<double >>(toc - tic).count();
+            if (t_calls++ >= t_warmups) {
+                t_samples.push_back(seconds);
+            }
+            return seconds;
+        }
+
+        /** Runs the warmups and measured runs of f, calling setup (untimed) before each one */
+        auto run(const function<void()> &f, const function<void()> &setup = {}) -> BenchmarkStats {
+            cout << "Benchmarking [" << t_name << "] (" << t_warmups << " warmups, " << t_runs << " runs)..."
+                 << endl;
+            for (auto i = 0u; i < t_warmups + t_runs; i++) {
+                if (setup) setup();
+                measure(f);
+            }
+            return stats();
+        }
+
+        [[nodiscard]] auto stats() const -> BenchmarkStats {
+            return BenchmarkStats::of(t_samples);
+        }
+
+        /** Prints the summary, and appends it to $IPU_BENCH_OUTPUT if that is set */
+        auto report(ostream &os = cout) const -> BenchmarkStats {
+            const auto s = stats();
+            os << "[" << t_name << "] " << s.runs << " runs: "
+               << setprecision(5)
+               << "min " << s.min << "s, median " << s.median << "s, p95 " << s.p95
+               << "s, stddev " << s.stddev << "s" << endl;
+            for (const auto &[unit, amount]: t_throughputs) {
+                os << "[" << t_name << "] " << setprecision(4) << amount / s.median << " " << unit << "/s" << endl;
+            }
+            if (const auto output = getenv("IPU_BENCH_OUTPUT"); output != nullptr) {
+                write(output);
+            }
+            return s;
+        }
+
+        auto toJson() const -> string {
+            const auto s = stats();
+            stringstream ss;
+            ss << setprecision(9)
+               << "{\"name\":\"" << escaped(t_name) << "\",\"sdk\":\"" << escaped(poplar::versionString()) << "\"";
+            for (const auto &[key, value]: t_tags) {
+                ss << ",\"" << escaped(key) << "\":\"" << escaped(value) << "\"";
+            }
+            ss << ",\"warmups\":" << t_warmups << ",\"runs\":" << s.runs
+               << ",\"min\":" << s.min << ",\"median\":" << s.median << ",\"p95\":" << s.p95
+               << ",\"mean\":" << s.mean << ",\"stddev\":" << s.stddev << ",\"throughput\":{";
+            for (auto i = 0u; i < t_throughputs.size(); i++) {
+                ss << (i > 0 ? "," : "") << "\"" << escaped(t_throughputs[i].unit) << "/s\":"
+                   << t_throughputs[i].amountPerRun / s.median;
+            }
+            ss << "}}";
+            return ss.str();
+        }
+
+        /** One row per throughput (or a single row if there are none), so every row has the same columns */
+        auto toCsv(const bool withHeader) const -> string {
+            const auto s = stats();
+            auto tags = string{};
+            for (const auto &[key, value]: t_tags) {
+                tags += (tags.empty() ? "" : ";") + key + "=" + value;
+            }
+            stringstream ss;
+            if (withHeader) {
+                ss << "name,sdk,tags,warmups,runs,min,median,p95,mean,stddev,unit,throughput" << endl;
+            }
+            const auto row = [&](const string &unit, const double throughput) {
+                ss << setprecision(9) << t_name << ",\"" << poplar::versionString() << "\",\"" << tags << "\","
+                   << t_warmups << "," << s.runs << "," << s.min << "," << s.median << "," << s.p95 << ","
+                   << s.mean << "," << s.stddev << "," << unit << "," << throughput << endl;
+            };
+            if (t_throughputs.empty()) row("", 0);
+            for (const auto &[unit, amount]: t_throughputs) row(unit + "/s", amount / s.median);
+            return ss.str();
+        }
+
+        /** Appends the results to a .csv or .json(l) file */
+        auto write(const filesystem::path &path) const -> void {
+            const auto isNew = !filesystem::exists(path) || filesystem::file_size(path) == 0;
+            ofstream file(path, ios::app);
+            if (path.extension() == ".csv") {
+                file << toCsv(isNew);
+            } else {
+                file << toJson() << endl;
+            }
+            cout << "[" << t_name << "] results appended to " << path << endl;
+        }
+    };
+
+}
+
+#endif
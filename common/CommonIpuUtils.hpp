@@ -8,6 +8,9 @@
 #include <algorithm>
 #include <cmath>
 #include <chrono>
+#include <sstream>
+#include <optional>
+#include <stdexcept>
 #include <poplar/Engine.hpp>
 #include <poplar/IPUModel.hpp>
 #include <poputil/TileMapping.hpp>
@@ -16,6 +19,16 @@
 #include <popops/codelets.hpp>
 #include <popops/ElementWiseUtil.hpp>
 #include <poplar/Program.hpp>
+#include "ExecutableCache.hpp"
+#include "DeviceFactory.hpp"
+#include "Benchmark.hpp"
+#include "CycleCounter.hpp"
+#include "LinearTileMapping.hpp"
+#include "MemoryBudget.hpp"
+#include "HostDataSource.hpp"
+#include "Replication.hpp"
+#include "RuntimeSizes.hpp"
+#include "TuningDatabase.hpp"
 
 
 namespace ipu {
@@ -23,29 +36,6 @@ namespace ipu {
     using namespace poplar::program;
     using namespace std;
 
-    Device getIpuModel() {
-        IPUModel ipuModel;
-        ipuModel.numIPUs = 1;
-        ipuModel.tilesPerIPU = 4;
-        return ipuModel.createDevice();
-    }
-
-    auto getIpuDevice(unsigned int numIpus = 1) -> optional <Device> {
-        DeviceManager manager = DeviceManager::createDeviceManager();
-
-        for (auto &d : manager.getDevices(TargetType::IPU, numIpus)) {
-            cerr << "Trying to attach to IPU " << d.getId();
-            if (d.attach()) {
-                cerr << " - attached" << endl;
-                return {move(d)};
-            } else {
-                cerr << endl;
-            }
-        }
-        cerr << "Error attaching to device" << endl;
-        return nullopt;
-    }
-
     const auto POPLAR_ENGINE_OPTIONS_DEBUG = OptionFlags{
             {"target.saveArchive",                "archive.a"},
             {"debug.instrument",                  "true"},
@@ -61,6 +51,120 @@ namespace ipu {
 
     const auto POPLAR_ENGINE_OPTIONS_RELEASE = OptionFlags{};
 
+    /**
+     * Enough instrumentation to see where the time goes in PopVision (compute and exchange per IPU, and the
+     * graph report), without the per-tile counters, control-flow instrumentation and debug dumps of the full
+     * debug options that noticeably slow down every step
+     */
+    const auto POPLAR_ENGINE_OPTIONS_LIGHT_PROFILE = OptionFlags{
+            {"autoReport.outputGraphProfile",     "true"},
+            {"autoReport.outputExecutionProfile", "true"},
+            {"debug.instrumentCompute",           "true"},
+            {"debug.instrumentControlFlow",       "false"},
+            {"debug.computeInstrumentationLevel", "ipu"}
+    };
+
+    enum class EngineProfile {
+        Release, LightProfile, FullDebug
+    };
+
+    auto toString(const EngineProfile profile) -> string {
+        switch (profile) {
+            case EngineProfile::Release:
+                return "release";
+            case EngineProfile::LightProfile:
+                return "light-profile";
+            case EngineProfile::FullDebug:
+                return "full-debug";
+        }
+        return "unknown";
+    }
+
+    auto engineProfileFromString(const string &name) -> EngineProfile {
+        if (name == "release") return EngineProfile::Release;
+        if (name == "light-profile" || name == "light") return EngineProfile::LightProfile;
+        if (name == "full-debug" || name == "debug") return EngineProfile::FullDebug;
+        throw std::invalid_argument("Unknown engine profile '" + name + "' (expected release, light-profile or full-debug)");
+    }
+
+    auto engineOptionsFor(const EngineProfile profile) -> OptionFlags {
+        switch (profile) {
+            case EngineProfile::LightProfile:
+                return POPLAR_ENGINE_OPTIONS_LIGHT_PROFILE;
+            case EngineProfile::FullDebug:
+                return POPLAR_ENGINE_OPTIONS_DEBUG;
+            default:
+                return POPLAR_ENGINE_OPTIONS_RELEASE;
+        }
+    }
+
+    /**
+     * Decides which iterations of a long-running loop have execution profiling enabled, so that we capture a
+     * representative trace without paying the profiling cost in every iteration.
+     *
+     * The spec is a comma-separated list of windows of (1-based, inclusive) iterations:
+     *   "2"             only iteration 2
+     *   "2-4"           iterations 2, 3 and 4
+     *   "100-101/1000"  iterations 100 and 101 of every 1000 (100, 101, 1100, 1101, ...)
+     * The empty spec profiles every iteration.
+     */
+    class ProfileSampler {
+        struct Window {
+            unsigned from, to, period;
+        };
+        vector<Window> t_windows;
+        bool t_enabled;
+
+    public:
+        explicit ProfileSampler(const string &spec = "", const bool enabled = true) : t_enabled(enabled) {
+            stringstream ss(spec);
+            string window;
+            while (getline(ss, window, ',')) {
+                if (window.empty()) continue;
+                auto period = 0u;
+                if (const auto slash = window.find('/'); slash != string::npos) {
+                    period = stoul(window.substr(slash + 1));
+                    window = window.substr(0, slash);
+                }
+                const auto dash = window.find('-');
+                const auto from = (unsigned) stoul(window.substr(0, dash));
+                const auto to = dash == string::npos ? from : (unsigned) stoul(window.substr(dash + 1));
+                if (to < from || (period > 0 && to - from >= period)) {
+                    throw std::invalid_argument("Invalid profiling window in '" + spec + "'");
+                }
+                t_windows.push_back({from, to, period});
+            }
+        }
+
+        [[nodiscard]] auto shouldProfile(const unsigned iteration) const -> bool {
+            if (!t_enabled) return false;
+            if (t_windows.empty()) return true;
+            return any_of(t_windows.begin(), t_windows.end(), [iteration](const Window &w) -> bool {
+                if (iteration < w.from) return false;
+                const auto offset = w.period > 0 ? (iteration - w.from) % w.period : iteration - w.from;
+                return offset <= w.to - w.from;
+            });
+        }
+
+        /**
+         * Call before running an iteration: turns execution profiling on if this iteration is sampled, and off if
+         * it isn't (an instrumented engine starts with profiling on, so every iteration would be captured otherwise)
+         */
+        auto beginIteration(Engine &engine, const unsigned iteration) const -> void {
+            if (!t_enabled) return;
+            if (shouldProfile(iteration)) {
+                engine.enableExecutionProfiling();
+            } else {
+                engine.disableExecutionProfiling();
+            }
+        }
+
+        /** Call after running an iteration: turns execution profiling back off */
+        auto endIteration(Engine &engine, const unsigned iteration) const -> void {
+            if (shouldProfile(iteration)) engine.disableExecutionProfiling();
+        }
+    };
+
 
     template<class UnaryPredicate>
     void assertThat(const string &&msg, const UnaryPredicate p) {
@@ -69,25 +173,13 @@ namespace ipu {
     };
 
 
-/**
- * Similar to Graphcore's poputils Linear tile mapping, but restricts the tensor to live in just 1 IPU's memories
- */
-    const auto mapLinearlyOnOneIpu = [&](Tensor &tensor, const int ipuNum, Device& device, Graph &graph) {
-        auto totalElements = 1;
-        for (auto dim: tensor.shape()) {
-            totalElements *= dim;
-        }
-        int numTilesPerIpu = device.getTarget().getNumTiles() / device.getTarget().getNumIPUs();
-        auto itemsPerTile = totalElements / numTilesPerIpu;
-        auto numTilesWithExtraItem = totalElements % numTilesPerIpu;
-        auto from = 0;
-        for (auto tileNum = 0; tileNum < numTilesPerIpu; tileNum++) {
-            const auto itemsForThisTile = (tileNum < numTilesWithExtraItem) ? itemsPerTile + 1 : itemsPerTile;
-            const auto to = from + itemsForThisTile;
-            graph.setTileMapping(tensor.slice(from, to), tileNum + (ipuNum * numTilesPerIpu));
-            from = to;
-        }
-    };
+    /**
+     * Similar to Graphcore's poputils Linear tile mapping, but restricts the tensor to live in just 1 IPU's memories.
+     * See LinearTileMapping for more control over how the tensor is split.
+     */
+    auto mapLinearlyOnOneIpu(Tensor &tensor, const int ipuNum, Device &device, Graph &graph) -> TileIntervals {
+        return LinearTileMapping{}.ipus(ipuNum, ipuNum + 1).apply(graph, tensor);
+    }
 
     /** Starts a timer and outputs a message */
     auto startTimer(const string &title) -> auto {
@@ -105,28 +197,126 @@ namespace ipu {
     }
 
     /**
-     * Compiles the graph with the given programs, creates an Engine and loads the engine onto the device
+     * Chooses the engine options for a run from one of the release, light-profile and full-debug profiles.
+     * The profile comes from the --engine-profile=<name> command line argument if given, or else from the
+     * IPU_ENGINE_PROFILE environment variable, and defaults to release. Profiling windows (see ProfileSampler)
+     * come from --profile-iterations=<spec> or IPU_PROFILE_ITERATIONS in the same way.
      */
-    auto prepareEngine(Graph &graph, ArrayRef <Program> programs, Device &device) -> Engine {
-        auto timer = startTimer("Compiling graph, creating engine, and loading to device");
-        auto tic = std::get<1>(timer);
-
-        auto progressFunc = [tic](int a, int b) {
-            auto toc = chrono::high_resolution_clock::now();
-            auto diff = chrono::duration_cast < chrono::duration < double >> (toc - tic).count();
-            cout << " ...stage " << a << " of " << b << " after " << right << setw(6)
-                 << setprecision(2)
-                 << diff << "s" <<
-                 endl;
-        };
+    class EngineBuilder {
+        EngineProfile t_profile;
+        optional<string> t_profileIterations;
+        OptionFlags t_extraOptions;
+        ExecutableCache t_cache;
 
-        auto engine = Engine(graph, programs,
-                             POPLAR_ENGINE_OPTIONS_DEBUG, progressFunc);
-        engine.load(device);
-        endTimer(timer);
-        return engine;
-    }
+    public:
+        explicit EngineBuilder(const EngineProfile profile = EngineProfile::Release,
+                               ExecutableCache cache = ExecutableCache::fromEnvironment()) :
+                t_profile(profile), t_cache(move(cache)) {}
+
+        static auto fromEnvironment() -> EngineBuilder {
+            auto builder = EngineBuilder{};
+            if (const auto profile = getenv("IPU_ENGINE_PROFILE"); profile != nullptr) {
+                builder.profile(engineProfileFromString(profile));
+            }
+            if (const auto iterations = getenv("IPU_PROFILE_ITERATIONS"); iterations != nullptr) {
+                builder.profileIterations(iterations);
+            }
+            return builder;
+        }
+
+        static auto fromCommandLine(const int argc, char *argv[]) -> EngineBuilder {
+            auto builder = fromEnvironment();
+            const auto valueOf = [](const string &arg, const string &name) -> optional<string> {
+                const auto prefix = "--" + name + "=";
+                return arg.rfind(prefix, 0) == 0 ? optional<string>{arg.substr(prefix.size())} : nullopt;
+            };
+            for (auto i = 1; i < argc; i++) {
+                if (auto profile = valueOf(argv[i], "engine-profile"); profile.has_value()) {
+                    builder.profile(engineProfileFromString(*profile));
+                } else if (auto iterations = valueOf(argv[i], "profile-iterations"); iterations.has_value()) {
+                    builder.profileIterations(*iterations);
+                }
+            }
+            return builder;
+        }
+
+        auto profile(const EngineProfile profile) -> EngineBuilder & {
+            t_profile = profile;
+            return *this;
+        }
+
+        auto profileIterations(const string &spec) -> EngineBuilder & {
+            t_profileIterations = spec;
+            return *this;
+        }
 
+        /** Adds (or overrides) an engine option on top of the profile's options */
+        auto option(const string &name, const string &value) -> EngineBuilder & {
+            t_extraOptions.set(name, value);
+            return *this;
+        }
+
+        auto cache(ExecutableCache cache) -> EngineBuilder & {
+            t_cache = move(cache);
+            return *this;
+        }
+
+        [[nodiscard]] auto profile() const -> EngineProfile { return t_profile; }
+
+        [[nodiscard]] auto isProfiling() const -> bool { return t_profile != EngineProfile::Release; }
+
+        [[nodiscard]] auto options() const -> OptionFlags {
+            auto options = engineOptionsFor(t_profile);
+            for (const auto &[name, value]: t_extraOptions) {
+                options.set(name, value);
+            }
+            return options;
+        }
+
+        /**
+         * A sampler for the configured profiling windows, or for defaultIterations if none were configured.
+         * Never samples anything in the release profile, since there is no instrumentation to enable.
+         */
+        [[nodiscard]] auto profileSampler(const string &defaultIterations = "") const -> ProfileSampler {
+            return ProfileSampler{t_profileIterations.value_or(defaultIterations), isProfiling()};
+        }
+
+        /**
+         * Compiles the graph with the given programs (or loads a previously compiled executable from the
+         * executable cache), creates an Engine and loads the engine onto the device
+         */
+        auto build(Graph &graph, ArrayRef<Program> programs, Device &device) const -> Engine {
+            auto timer = startTimer("Compiling graph, creating engine, and loading to device (" +
+                                    toString(t_profile) + " profile)");
+            auto tic = std::get<1>(timer);
+
+            auto progressFunc = [tic](int a, int b) {
+                auto toc = chrono::high_resolution_clock::now();
+                auto diff = chrono::duration_cast < chrono::duration < double >> (toc - tic).count();
+                cout << " ...stage " << a << " of " << b << " after " << right << setw(6)
+                     << setprecision(2)
+                     << diff << "s" <<
+                     endl;
+            };
+
+            const auto engineOptions = options();
+            auto exe = t_cache.getOrCompile(graph, programs, engineOptions, progressFunc);
+            auto engine = Engine(move(exe), engineOptions);
+            engine.load(device);
+            endTimer(timer);
+            return engine;
+        }
+    };
+
+    /**
+     * Compiles the graph with the given programs (or loads a previously compiled executable from the
+     * executable cache), creates an Engine and loads the engine onto the device. The engine options come
+     * from the builder, which by default picks the profile from the IPU_ENGINE_PROFILE environment variable.
+     */
+    auto prepareEngine(Graph &graph, ArrayRef <Program> programs, Device &device,
+                       const EngineBuilder &builder = EngineBuilder::fromEnvironment()) -> Engine {
+        return builder.build(graph, programs, device);
+    }
 
 
 }
@@ -0,0 +1,155 @@
+#ifndef IPU_CYCLECOUNTER_HPP
+#define IPU_CYCLECOUNTER_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <poplar/Engine.hpp>
+#include <poplar/Graph.hpp>
+#include <poplar/Program.hpp>
+#include <poplar/CycleCount.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace poplar::program;
+    using namespace std;
+
+    /**
+     * Measures programs on the device with poplar::cycleCount rather than timing engine.run from the host, so
+     * host launch overhead and stream syncs don't end up in the kernel time.
+     *
+     * Each wrapped program streams its 64-bit cycle count back to a host callback every time it runs, so it can
+     * be wrapped inside a Repeat, and counts accumulate over all invocations (and over all programs wrapped with
+     * the same name). Wrap the exchange and compute parts of a superstep separately to see how the time splits
+     * between them:
+     *
+     *     auto cycles = ipu::CycleCounter(graph);
+     *     auto step = Sequence{cycles.wrap("exchange", haloExchange), cycles.wrap("compute", stencil)};
+     *     ...
+     *     cycles.connect(engine);
+     *     engine.run(0);
+     *     cycles.report();
+     *
+     * Counting costs a sync and a device-to-host copy per invocation, which would skew host-side timings, so
+     * counters made with fromEnvironment only count when IPU_CYCLE_COUNT=1.
+     */
+    class CycleCounter {
+        struct Counter {
+            string name;
+            uint64_t totalCycles = 0;
+            uint64_t calls = 0;
+        };
+
+        Graph &t_graph;
+        unsigned t_tile;
+        bool t_enabled;
+        double t_clockHz;
+        vector<unique_ptr<Counter>> t_counters; // Stable addresses for the stream callbacks
+        vector<pair<string, Counter *>> t_streams;
+
+        [[nodiscard]] auto find(const string &name) const -> Counter * {
+            for (const auto &counter: t_counters) {
+                if (counter->name == name) return counter.get();
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] auto get(const string &name) const -> const Counter & {
+            if (const auto counter = find(name); counter != nullptr) return *counter;
+            throw invalid_argument("No cycle counter called '" + name + "'");
+        }
+
+    public:
+        explicit CycleCounter(Graph &graph, const unsigned tile = 0, const bool enabled = true) :
+                t_graph(graph), t_tile(tile), t_enabled(enabled),
+                t_clockHz(graph.getTarget().getTileClockFrequency()) {}
+
+        static auto fromEnvironment(Graph &graph, const unsigned tile = 0) -> CycleCounter {
+            const auto enabled = getenv("IPU_CYCLE_COUNT");
+            return CycleCounter{graph, tile, enabled != nullptr && string{enabled} == "1"};
+        }
+
+        [[nodiscard]] auto enabled() const -> bool { return t_enabled; }
+
+        /** Returns a program that runs the given program and adds how many cycles it took to the named counter */
+        auto wrap(const string &name, const Program &program) -> Program {
+            if (!t_enabled) return program;
+
+            auto counter = find(name);
+            if (counter == nullptr) {
+                t_counters.push_back(make_unique<Counter>(Counter{name}));
+                counter = t_counters.back().get();
+            }
+            const auto stream = "cycles/" + name + "/" + to_string(t_streams.size());
+
+            // Multi-IPU programs must sync across all the IPUs, or we'd only see our own IPU finish
+            const auto syncType = t_graph.getTarget().getNumIPUs() > 1 ? SyncType::GLOBAL : SyncType::INTERNAL;
+            auto measured = Sequence{program};
+            const auto cycles = cycleCount(t_graph, measured, t_tile, syncType, stream);
+            const auto toHost = t_graph.addDeviceToHostFIFO(stream, UNSIGNED_INT, 2);
+            t_streams.emplace_back(stream, counter);
+            return Sequence{measured, Copy(cycles, toHost)};
+        }
+
+        /** Connects the cycle count streams of all the wrapped programs. Call after creating the engine */
+        auto connect(Engine &engine) -> void {
+            for (auto &[stream, counter]: t_streams) {
+                engine.connectStreamToCallback(stream, [c = counter](void *p) {
+                    const auto words = static_cast<const uint32_t *>(p); // Lower word first
+                    c->totalCycles += static_cast<uint64_t>(words[1]) << 32u | words[0];
+                    c->calls++;
+                });
+            }
+        }
+
+        /** Forgets the counts so far (e.g. after warmup runs) */
+        auto reset() -> void {
+            for (auto &counter: t_counters) {
+                counter->totalCycles = 0;
+                counter->calls = 0;
+            }
+        }
+
+        [[nodiscard]] auto cycles(const string &name) const -> uint64_t { return get(name).totalCycles; }
+
+        [[nodiscard]] auto calls(const string &name) const -> uint64_t { return get(name).calls; }
+
+        [[nodiscard]] auto seconds(const string &name) const -> double { return cycles(name) / t_clockHz; }
+
+        /** Mean on-device time of one invocation of the named program(s) */
+        [[nodiscard]] auto secondsPerCall(const string &name) const -> double {
+            const auto &counter = get(name);
+            return counter.calls == 0 ? 0.0 : counter.totalCycles / t_clockHz / counter.calls;
+        }
+
+        /** Prints on-device time per wrapped program, and each program's share of the total across all of them */
+        auto report(ostream &os = cout) const -> void {
+            if (!t_enabled) return;
+
+            uint64_t allCycles = 0;
+            for (const auto &counter: t_counters) allCycles += counter->totalCycles;
+
+            os << "On-device cycle counts (tile clock " << t_clockHz / 1e6 << "MHz):" << endl;
+            os << setw(24) << left << "program" << right
+               << setw(10) << "calls" << setw(18) << "cycles" << setw(14) << "total (s)"
+               << setw(14) << "per call (s)" << setw(8) << "share" << endl;
+            for (const auto &counter: t_counters) {
+                os << setw(24) << left << counter->name << right
+                   << setw(10) << counter->calls
+                   << setw(18) << counter->totalCycles
+                   << setw(14) << setprecision(5) << counter->totalCycles / t_clockHz
+                   << setw(14) << setprecision(5) << secondsPerCall(counter->name)
+                   << setw(7) << setprecision(3)
+                   << (allCycles > 0 ? 100.0 * counter->totalCycles / allCycles : 0.0) << "%" << endl;
+            }
+        }
+    };
+
+}
+
+#endif
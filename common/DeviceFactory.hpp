@@ -0,0 +1,163 @@
+#ifndef IPU_DEVICEFACTORY_HPP
+#define IPU_DEVICEFACTORY_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <optional>
+#include <stdexcept>
+#include <poplar/Device.hpp>
+#include <poplar/DeviceManager.hpp>
+#include <poplar/IPUModel.hpp>
+#include <poplar/Target.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace std;
+
+    /** Where a device should come from: real hardware, the IPUModel emulator, or hardware falling back to the model */
+    enum class DeviceKind {
+        Auto, Hardware, Model
+    };
+
+    /**
+     * Describes the device we want to run on, as a string of the form
+     *
+     *     [auto|hw|model:]<preset>[:<numIpus>[x<tilesPerIpu>]]
+     *
+     * where preset is mk1 (GC2: 1216 tiles, 256KiB per tile), mk2 (GC200: 1472 tiles, 624KiB per tile) or any
+     * (whatever hardware we can attach to, emulated as a mk2 if there is none). For
+     * example "mk2" is a whole Mk2 IPU (from hardware if we can attach to one, otherwise emulated), "model:mk1:4"
+     * is an emulated 4-IPU Mk1 system, and "hw:mk2:2x736" is a virtual device using half the tiles of each of
+     * 2 real Mk2 IPUs. Emulated devices keep the preset's memory per tile and clock, so the memory-pressure and
+     * scaling behaviour matches the real target even when only a subset of tiles is used.
+     */
+    struct DeviceSpec {
+        DeviceKind kind = DeviceKind::Auto;
+        string preset = "any";
+        unsigned numIpus = 1;
+        optional<unsigned> tilesPerIpu = nullopt;
+
+        static auto parse(const string &spec) -> DeviceSpec {
+            auto result = DeviceSpec{};
+            auto parts = vector<string>{};
+            stringstream ss(spec);
+            for (string part; getline(ss, part, ':');) parts.push_back(part);
+
+            auto i = 0u;
+            if (i < parts.size()) {
+                if (parts[i] == "auto") { result.kind = DeviceKind::Auto; i++; }
+                else if (parts[i] == "hw") { result.kind = DeviceKind::Hardware; i++; }
+                else if (parts[i] == "model") { result.kind = DeviceKind::Model; i++; }
+            }
+            if (i < parts.size()) {
+                result.preset = parts[i++];
+                if (result.preset != "mk1" && result.preset != "mk2" && result.preset != "any") {
+                    throw invalid_argument("Unknown IPU preset '" + result.preset + "' in device spec '" + spec +
+                                           "' (expected mk1, mk2 or any)");
+                }
+            }
+            if (i < parts.size()) {
+                const auto size = parts[i++];
+                const auto x = size.find('x');
+                result.numIpus = stoul(size.substr(0, x));
+                if (x != string::npos) result.tilesPerIpu = stoul(size.substr(x + 1));
+            }
+            if (i < parts.size() || result.numIpus == 0 || result.tilesPerIpu == 0u) {
+                throw invalid_argument("Could not parse device spec '" + spec + "'");
+            }
+            return result;
+        }
+
+        /** The spec in the IPU_DEVICE environment variable if it is set, otherwise the given default */
+        static auto fromEnvironment(const DeviceSpec &defaultSpec) -> DeviceSpec {
+            const auto spec = getenv("IPU_DEVICE");
+            return spec != nullptr ? parse(spec) : defaultSpec;
+        }
+
+        static auto fromEnvironment() -> DeviceSpec {
+            return fromEnvironment(DeviceSpec{});
+        }
+
+        /** The architecture string poplar uses for this preset's IPU version */
+        [[nodiscard]] auto ipuVersion() const -> string {
+            return preset == "mk1" ? "ipu1" : "ipu2";
+        }
+
+        [[nodiscard]] auto toString() const -> string {
+            stringstream ss;
+            ss << (kind == DeviceKind::Hardware ? "hw" : kind == DeviceKind::Model ? "model" : "auto")
+               << ":" << preset << ":" << numIpus;
+            if (tilesPerIpu.has_value()) ss << "x" << *tilesPerIpu;
+            return ss.str();
+        }
+    };
+
+    /** An emulated device matching the preset's tiles, memory and clock (optionally with fewer tiles) */
+    auto getIpuModel(const DeviceSpec &spec) -> Device {
+        const auto ipuVersion = spec.ipuVersion();
+        IPUModel ipuModel(ipuVersion.c_str());
+        ipuModel.numIPUs = spec.numIpus;
+        if (spec.tilesPerIpu.has_value()) {
+            ipuModel.tilesPerIPU = *spec.tilesPerIpu;
+        }
+        cerr << "Using IPUModel " << spec.toString() << " (" << ipuModel.tilesPerIPU << " tiles of "
+             << ipuModel.memoryPerTile / 1024 << "KiB per IPU)" << endl;
+        return ipuModel.createDevice();
+    }
+
+    auto getIpuModel(const string &preset = "mk2", const unsigned numIpus = 1,
+                     const optional<unsigned> tilesPerIpu = nullopt) -> Device {
+        return getIpuModel(DeviceSpec{DeviceKind::Model, preset, numIpus, tilesPerIpu});
+    }
+
+    auto getIpuDevice(unsigned int numIpus = 1) -> optional <Device> {
+        DeviceManager manager = DeviceManager::createDeviceManager();
+
+        for (auto &d : manager.getDevices(TargetType::IPU, numIpus)) {
+            cerr << "Trying to attach to IPU " << d.getId();
+            if (d.attach()) {
+                cerr << " - attached" << endl;
+                return {move(d)};
+            } else {
+                cerr << endl;
+            }
+        }
+        cerr << "Error attaching to device" << endl;
+        return nullopt;
+    }
+
+    /**
+     * Creates the device described by the spec. Hardware devices are checked against the requested preset and
+     * narrowed to a virtual device when a tile subset is requested. With DeviceKind::Auto, we fall back to an
+     * IPUModel of the same shape if no matching hardware can be attached.
+     */
+    auto createDevice(const DeviceSpec &spec) -> optional<Device> {
+        if (spec.kind != DeviceKind::Model) {
+            if (auto device = getIpuDevice(spec.numIpus); device.has_value()) {
+                const auto &target = device->getTarget();
+                if (spec.preset != "any" && target.getTargetArchString() != spec.ipuVersion()) {
+                    cerr << "Attached device is an " << target.getTargetArchString() << ", not the requested "
+                         << spec.preset << " (" << spec.ipuVersion() << ")" << endl;
+                } else if (spec.tilesPerIpu.has_value() && *spec.tilesPerIpu > target.getTilesPerIPU()) {
+                    cerr << "Requested " << *spec.tilesPerIpu << " tiles per IPU, but the device only has "
+                         << target.getTilesPerIPU() << endl;
+                } else if (spec.tilesPerIpu.has_value()) {
+                    return {device->createVirtualDevice(*spec.tilesPerIpu)};
+                } else {
+                    return device;
+                }
+            }
+            if (spec.kind == DeviceKind::Hardware) {
+                return nullopt;
+            }
+            cerr << "Falling back to the IPUModel" << endl;
+        }
+        return {getIpuModel(spec)};
+    }
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef IPU_EXECUTABLECACHE_HPP
+#define IPU_EXECUTABLECACHE_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <iterator>
+#include <filesystem>
+#include <poplar/Engine.hpp>
+#include <poplar/Graph.hpp>
+#include <poplar/Program.hpp>
+#include <poplar/OptionFlags.hpp>
+#include <poplar/Target.hpp>
+#include <poplar/VersionInfo.hpp>
+#include "FileUtils.hpp"
+
+namespace ipu {
+    using namespace poplar;
+    using namespace poplar::program;
+    using namespace std;
+    namespace fs = std::filesystem;
+
+    /**
+     * A streambuf that throws away what is written to it, keeping only a 64-bit FNV-1a hash of the bytes.
+     * This lets us hash a serialized graph without holding the (potentially huge) serialization in memory.
+     */
+    class HashingStreamBuf : public streambuf {
+        uint64_t t_hash = 14695981039346656037ull;
+
+        void update(const unsigned char c) {
+            t_hash ^= c;
+            t_hash *= 1099511628211ull;
+        }
+
+    protected:
+        auto overflow(int_type c) -> int_type override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                update(static_cast<unsigned char>(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+        auto xsputn(const char *s, streamsize n) -> streamsize override {
+            for (streamsize i = 0; i < n; i++) update(static_cast<unsigned char>(s[i]));
+            return n;
+        }
+
+    public:
+        [[nodiscard]] auto hash() const -> uint64_t { return t_hash; }
+    };
+
+    /**
+     * A content-addressed, size-bounded on-disk cache of compiled poplar::Executables.
+     *
+     * Entries are keyed by a hash of the serialized graph, the program list, the engine options, the target, the
+     * Poplar SDK and the contents of the codelets directory (the serialized graph only names the vertex types, not
+     * their code), so any change to the graph or how it is compiled results in a miss. When the cache grows beyond
+     * maxBytes, the least recently used entries are evicted.
+     *
+     * Configure with the IPU_EXECUTABLE_CACHE_DIR (default "executable-cache") and IPU_EXECUTABLE_CACHE_MAX_MB
+     * (default 8192) environment variables. Setting IPU_EXECUTABLE_CACHE_DIR to the empty string disables the cache.
+     */
+    class ExecutableCache {
+        fs::path t_dir;
+        uintmax_t t_maxBytes;
+        bool t_enabled;
+
+        [[nodiscard]] auto pathFor(const string &key) const -> fs::path {
+            return t_dir / (key + ".exe");
+        }
+
+    public:
+        static constexpr auto DefaultDir = "executable-cache";
+        static constexpr auto DefaultMaxMegaBytes = 8192ull;
+        static constexpr auto DefaultCodeletDir = "codelets";
+
+        explicit ExecutableCache(const fs::path &dir = DefaultDir,
+                                 const uintmax_t maxBytes = DefaultMaxMegaBytes * 1024 * 1024) :
+                t_dir(dir), t_maxBytes(maxBytes), t_enabled(!dir.empty()) {}
+
+        static auto fromEnvironment() -> ExecutableCache {
+            const auto dir = getenv("IPU_EXECUTABLE_CACHE_DIR");
+            const auto maxMb = getenv("IPU_EXECUTABLE_CACHE_MAX_MB");
+            return ExecutableCache{dir != nullptr ? fs::path{dir} : fs::path{DefaultDir},
+                                   (maxMb != nullptr ? stoull(maxMb) : DefaultMaxMegaBytes) * 1024 * 1024};
+        }
+
+        [[nodiscard]] auto enabled() const -> bool { return t_enabled; }
+
+        [[nodiscard]] auto dir() const -> const fs::path & { return t_dir; }
+
+        /**
+         * The cache key for compiling these programs in this graph with these options. Every file under codeletDir
+         * (where the recipes keep their codelets and the headers they include) is hashed too, since graph.addCodelets
+         * compiles them into the executable
+         */
+        static auto key(const Graph &graph, ArrayRef<Program> programs, const OptionFlags &options,
+                        const fs::path &codeletDir = DefaultCodeletDir) -> string {
+            HashingStreamBuf hashBuf;
+            ostream hashStream(&hashBuf);
+
+            graph.serialize(hashStream, programs, SerializationFormat::Binary);
+
+            for (const auto &[option, value]: options) {
+                hashStream << option << '=' << value << ';';
+            }
+
+            const auto &target = graph.getTarget();
+            hashStream << static_cast<int>(target.getTargetType()) << ';'
+                       << target.getTargetArchString() << ';'
+                       << target.getNumIPUs() << ';'
+                       << target.getTilesPerIPU() << ';';
+            hashStream << poplar::versionString() << ';' << poplar::packageHash() << ';';
+
+            auto codeletFiles = vector<fs::path>{};
+            error_code ec;
+            if (fs::is_directory(codeletDir, ec)) {
+                for (const auto &entry: fs::recursive_directory_iterator(codeletDir, ec)) {
+                    if (entry.is_regular_file(ec)) codeletFiles.push_back(entry.path());
+                }
+            }
+            sort(codeletFiles.begin(), codeletFiles.end()); // Directory order isn't stable
+            for (const auto &file: codeletFiles) {
+                ifstream codelet(file, ios::binary);
+                hashStream << file.generic_string() << ';'
+                           << string(istreambuf_iterator<char>(codelet), istreambuf_iterator<char>()) << ';';
+            }
+            hashStream.flush();
+
+            stringstream ss;
+            ss << hex << setw(16) << setfill('0') << hashBuf.hash();
+            return ss.str();
+        }
+
+        /** Loads the executable for this key, if we have it. Unreadable (e.g. stale SDK version) entries are misses */
+        auto load(const string &key) const -> optional<Executable> {
+            if (!t_enabled) return nullopt;
+
+            const auto path = pathFor(key);
+            if (!fs::exists(path)) {
+                cout << "Executable cache miss [" << key << "]" << endl;
+                return nullopt;
+            }
+            try {
+                ifstream file(path, ios::binary);
+                auto exe = Executable::deserialize(file);
+                fs::last_write_time(path, fs::file_time_type::clock::now()); // Mark as recently used
+                cout << "Executable cache hit [" << key << "] loaded from " << path << endl;
+                return {move(exe)};
+            } catch (const exception &e) {
+                cerr << "Executable cache entry " << path << " could not be loaded (" << e.what()
+                     << "), discarding it" << endl;
+                fs::remove(path);
+                return nullopt;
+            }
+        }
+
+        /** Stores the executable under this key and then evicts old entries if we've grown too big */
+        auto store(const string &key, const Executable &exe) const -> void {
+            if (!t_enabled) return;
+
+            fs::create_directories(t_dir);
+            const auto path = pathFor(key);
+            const auto tmpPath = uniqueTempPath(path); // So jobs storing the same key don't write the same file
+            {
+                ofstream file(tmpPath, ios::binary | ios::trunc);
+                exe.serialize(file);
+                file.close();
+                if (!file) {
+                    cerr << "Executable cache couldn't write " << tmpPath << ", so [" << key << "] isn't stored"
+                         << endl;
+                    error_code ec;
+                    fs::remove(tmpPath, ec);
+                    return;
+                }
+            }
+            fs::rename(tmpPath, path); // So a concurrent job never reads a half-written entry
+            cout << "Executable cache stored [" << key << "] in " << path << endl;
+            evict();
+        }
+
+        /**
+         * Removes least-recently-used entries until the cache fits in maxBytes. Entries another job removes while
+         * we're looking are skipped rather than treated as errors
+         */
+        auto evict() const -> void {
+            auto entries = vector<pair<fs::file_time_type, fs::path>>{};
+            uintmax_t totalBytes = 0;
+            error_code ec;
+            for (const auto &entry: fs::directory_iterator(t_dir, ec)) {
+                if (!entry.is_regular_file(ec) || entry.path().extension() != ".exe") continue;
+                const auto lastUsed = entry.last_write_time(ec);
+                if (ec) continue;
+                const auto size = entry.file_size(ec);
+                if (ec) continue;
+                entries.emplace_back(lastUsed, entry.path());
+                totalBytes += size;
+            }
+            sort(entries.begin(), entries.end());
+            for (auto it = entries.begin(); totalBytes > t_maxBytes && it != entries.end(); it++) {
+                const auto size = fs::file_size(it->second, ec);
+                if (ec || !fs::remove(it->second, ec)) continue; // Already evicted by someone else
+                totalBytes -= size;
+                cout << "Executable cache evicted " << it->second << " (" << size / 1024 / 1024 << "MB)" << endl;
+            }
+        }
+
+        /**
+         * Loads the executable for these programs from the cache, or compiles them
+         * and stores the result if it isn't there yet
+         */
+        auto getOrCompile(const Graph &graph, ArrayRef<Program> programs, const OptionFlags &options,
+                          ProgressFunc progressFunc = {}) const -> Executable {
+            if (!t_enabled) return compileGraph(graph, programs, options, progressFunc);
+
+            const auto cacheKey = key(graph, programs, options);
+            if (auto exe = load(cacheKey); exe.has_value()) {
+                return move(*exe);
+            }
+            auto exe = compileGraph(graph, programs, options, progressFunc);
+            store(cacheKey, exe);
+            return exe;
+        }
+    };
+
+}
+
+#endif
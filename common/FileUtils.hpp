@@ -0,0 +1,57 @@
+#ifndef IPU_FILEUTILS_HPP
+#define IPU_FILEUTILS_HPP
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace ipu {
+    namespace fs = std::filesystem;
+
+    /**
+     * A file beside path that no other process or thread will write, to write path's new contents to before
+     * renaming it into place. It's in the same directory so the rename is atomic
+     */
+    inline auto uniqueTempPath(const fs::path &path) -> fs::path {
+        const auto thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        return fs::path{path}.concat("." + std::to_string(getpid()) + "." + std::to_string(thread) + ".tmp");
+    }
+
+    /**
+     * Holds an exclusive flock on a lock file (created if need be) until destroyed, so processes that all take it
+     * around a read-modify-write of a shared file don't lose each other's changes
+     */
+    class FileLock {
+        int t_fd;
+
+    public:
+        explicit FileLock(const fs::path &path) : t_fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666)) {
+            if (t_fd < 0) {
+                throw std::runtime_error("Couldn't open the lock file " + path.string() + ": " + strerror(errno));
+            }
+            while (flock(t_fd, LOCK_EX) != 0) {
+                if (errno != EINTR) {
+                    const auto error = std::string{strerror(errno)};
+                    close(t_fd);
+                    throw std::runtime_error("Couldn't lock " + path.string() + ": " + error);
+                }
+            }
+        }
+
+        FileLock(const FileLock &) = delete;
+
+        auto operator=(const FileLock &) -> FileLock & = delete;
+
+        ~FileLock() { close(t_fd); } // Closing the only descriptor releases the lock
+    };
+
+}
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef IPU_HOSTDATASOURCE_HPP
+#define IPU_HOSTDATASOURCE_HPP
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poplar/Engine.hpp>
+#include <poplar/StreamCallback.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace std;
+
+    /** A read-only memory mapping of a whole file, so datasets bigger than host RAM are paged in on demand */
+    class MappedFile {
+        const char *t_data = nullptr;
+        size_t t_size = 0;
+
+    public:
+        explicit MappedFile(const string &path) {
+            const auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw runtime_error("Could not open " + path + ": " + strerror(errno));
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                throw runtime_error("Could not map " + path + ": it is empty or can't be read");
+            }
+            t_size = st.st_size;
+            const auto mapped = mmap(nullptr, t_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED) throw runtime_error("Could not map " + path + ": " + strerror(errno));
+            madvise(mapped, t_size, MADV_SEQUENTIAL); // We read it front to back, so read ahead aggressively
+            t_data = static_cast<const char *>(mapped);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+
+        auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+        ~MappedFile() {
+            if (t_data != nullptr) munmap(const_cast<char *>(t_data), t_size);
+        }
+
+        [[nodiscard]] auto data() const -> const char * { return t_data; }
+
+        [[nodiscard]] auto size() const -> size_t { return t_size; }
+    };
+
+    /**
+     * Feeds a host-to-device FIFO from a producer thread through a small ring of host buffers, instead of pointing
+     * engine.connectStream at one big array. The producer fills batch i+1 (and i+2 with three buffers) while the
+     * device consumes batch i, and Poplar's prefetch can copy the next batch before the device asks for it, so a
+     * Repeat loop over a Copy from the stream doesn't wait on the host as long as the producer keeps up. Only the
+     * ring lives in host RAM, so the dataset can be far bigger than memory (e.g. a memory-mapped file).
+     *
+     * Each batch is one Copy's worth of the stream (batchBytes must match the Copy's destination). The producer
+     * writes batch number i into the buffer and returns false when there is no more data.
+     *
+     * A buffer is only reused once the device completes its batch, since Poplar may hand a prefetched batch back.
+     * Each replica can have a fetched and prefetchDepth prefetched batches in flight at once, so connect grows the
+     * ring to hold all of them plus one for the producer to fill; a smaller ring would deadlock.
+     *
+     *     auto source = ipu::HostDataSource::fromFile("dataset.bin", batchBytes);
+     *     source.connect(engine, "TO_IPU");
+     *     engine.run(0); // e.g. Repeat(numBatches, Sequence{Copy(toIpuStream, batch), compute})
+     *     source.report();
+     */
+    class HostDataSource {
+    public:
+        using Producer = function<bool(char *buffer, size_t batchBytes, uint64_t batch)>;
+
+    private:
+        /** Shared with the stream callback and the producer thread, which can both outlive a moved-from source */
+        struct State {
+            size_t batchBytes;
+            Producer producer;
+            vector<vector<char>> buffers;
+            mutex lock;
+            condition_variable changed;
+            uint64_t produced = 0;  // Batches written into the ring so far
+            uint64_t delivered = 0; // Batches handed to Poplar by fetch or prefetch
+            uint64_t consumed = 0;  // Batches the device has completed, whose buffers can be reused
+            bool exhausted = false;
+            bool stopping = false;
+
+            uint64_t bytesDelivered = 0;
+            uint64_t stalls = 0;          // Fetches that had to wait for the producer
+            uint64_t prefetchMisses = 0;  // Prefetches that found the next batch not ready yet
+            double stalledSeconds = 0;
+            chrono::high_resolution_clock::time_point firstFetch{};
+            chrono::high_resolution_clock::time_point lastComplete{};
+
+            /** Copies out the next batch we haven't handed over yet */
+            auto deliver(void *p) -> void {
+                memcpy(p, buffers[delivered % buffers.size()].data(), batchBytes);
+                delivered++;
+            }
+
+            auto markStarted() -> void {
+                if (firstFetch == decltype(firstFetch){}) firstFetch = chrono::high_resolution_clock::now();
+            }
+
+            auto produceAll() -> void {
+                while (true) {
+                    unique_lock<mutex> guard(lock);
+                    changed.wait(guard, [this]() { return stopping || produced - consumed < buffers.size(); });
+                    if (stopping) return;
+                    const auto batch = produced;
+                    auto &buffer = buffers[batch % buffers.size()];
+                    guard.unlock();
+
+                    // The slot is ours until we bump produced, so fill it without holding the lock
+                    const auto more = producer(buffer.data(), batchBytes, batch);
+
+                    guard.lock();
+                    if (!more) {
+                        exhausted = true;
+                        changed.notify_all();
+                        return;
+                    }
+                    produced++;
+                    changed.notify_all();
+                }
+            }
+        };
+
+        class Callback : public StreamCallback {
+            shared_ptr<State> t_state;
+
+        public:
+            explicit Callback(shared_ptr<State> state) : t_state(move(state)) {}
+
+            auto prefetch(void *p) -> Result override {
+                auto &s = *t_state;
+                lock_guard<mutex> guard(s.lock);
+                if (s.produced == s.delivered) {
+                    s.prefetchMisses++;
+                    return Result::NotAvailable;
+                }
+                s.markStarted();
+                s.deliver(p);
+                return Result::Success;
+            }
+
+            auto fetch(void *p) -> void override {
+                auto &s = *t_state;
+                unique_lock<mutex> guard(s.lock);
+                s.markStarted();
+                if (s.produced == s.delivered) {
+                    s.stalls++;
+                    const auto tic = chrono::high_resolution_clock::now();
+                    s.changed.wait(guard, [&s]() { return s.produced > s.delivered || s.exhausted || s.stopping; });
+                    s.stalledSeconds += chrono::duration_cast<chrono::duration<double >>(
+                            chrono::high_resolution_clock::now() - tic).count();
+                    if (s.produced == s.delivered) {
+                        throw runtime_error("The host data source ran out of data after " + to_string(s.delivered) +
+                                            " batches, but the device asked for more");
+                    }
+                }
+                s.deliver(p);
+            }
+
+            auto complete() -> void override {
+                auto &s = *t_state;
+                lock_guard<mutex> guard(s.lock);
+                s.consumed++;
+                s.bytesDelivered += s.batchBytes;
+                s.lastComplete = chrono::high_resolution_clock::now();
+                s.changed.notify_all();
+            }
+
+            /** Prefetched batches stay in the ring until complete(), so we just hand them over again */
+            auto invalidatePrefetched() -> void override {
+                lock_guard<mutex> guard(t_state->lock);
+                t_state->delivered = t_state->consumed;
+            }
+        };
+
+        shared_ptr<State> t_state;
+        thread t_producer;
+
+    public:
+        /** numBuffers = 2 double buffers, 3 triple buffers (more slack when batch preparation time varies) */
+        HostDataSource(const size_t batchBytes, Producer producer, const unsigned numBuffers = 2) :
+                t_state(make_shared<State>()) {
+            if (batchBytes == 0) throw invalid_argument("Batches must be at least one byte");
+            if (numBuffers < 2) throw invalid_argument("A host data source needs at least two buffers to overlap");
+            t_state->batchBytes = batchBytes;
+            t_state->producer = move(producer);
+            t_state->buffers = vector<vector<char>>(numBuffers, vector<char>(batchBytes));
+        }
+
+        HostDataSource(HostDataSource &&) = default;
+
+        auto operator=(HostDataSource &&) -> HostDataSource & = delete;
+
+        ~HostDataSource() { stop(); }
+
+        /**
+         * Streams a file batch by batch through a memory mapping. The last batch is zero-padded, and with cycle
+         * set the file is read again from the start, so a long Repeat can run over a short file
+         */
+        static auto fromFile(const string &path, const size_t batchBytes, const unsigned numBuffers = 3,
+                             const bool cycle = false) -> HostDataSource {
+            const auto file = make_shared<MappedFile>(path);
+            const auto numBatches = (file->size() + batchBytes - 1) / batchBytes;
+            return HostDataSource(batchBytes, [file, numBatches, cycle](char *buffer, const size_t bytes,
+                                                                               const uint64_t batch) -> bool {
+                if (!cycle && batch >= numBatches) return false;
+                const auto offset = (batch % numBatches) * bytes;
+                const auto n = min(bytes, file->size() - offset);
+                memcpy(buffer, file->data() + offset, n);
+                memset(buffer + n, 0, bytes - n);
+                return true;
+            }, numBuffers);
+        }
+
+        /** Streams numBatches batches of elements made by generate(batch, elements, count), e.g. fromGenerator<float> */
+        template<typename T>
+        static auto fromGenerator(const size_t elementsPerBatch, const uint64_t numBatches,
+                                  function<void(uint64_t batch, T *elements, size_t count)> generate,
+                                  const unsigned numBuffers = 2) -> HostDataSource {
+            return HostDataSource(elementsPerBatch * sizeof(T), [=](char *buffer, const size_t,
+                                                                    const uint64_t batch) -> bool {
+                if (batch >= numBatches) return false;
+                generate(batch, reinterpret_cast<T *>(buffer), elementsPerBatch);
+                return true;
+            }, numBuffers);
+        }
+
+        static constexpr auto DefaultPrefetchDepth = 1u;
+
+        /**
+         * Starts the producer thread and connects the stream, which every one of the replicas takes batches from.
+         * Call after loading the engine
+         */
+        auto connect(Engine &engine, const string &stream, const unsigned replicas = 1,
+                     const unsigned prefetchDepth = DefaultPrefetchDepth) -> void {
+            if (t_producer.joinable()) throw logic_error("This host data source is already connected");
+            const auto inFlight = size_t{replicas} * (1 + prefetchDepth);
+            if (t_state->buffers.size() < inFlight + 1) {
+                t_state->buffers.resize(inFlight + 1, vector<char>(t_state->batchBytes));
+            }
+            engine.connectStreamToCallback(stream, make_unique<Callback>(t_state));
+            t_producer = thread([state = t_state]() { state->produceAll(); });
+        }
+
+        /** Stops the producer thread. Batches it had prepared but the device didn't consume are dropped */
+        auto stop() -> void {
+            if (t_state == nullptr) return; // Moved from
+            {
+                lock_guard<mutex> guard(t_state->lock);
+                t_state->stopping = true;
+            }
+            t_state->changed.notify_all();
+            if (t_producer.joinable()) t_producer.join();
+        }
+
+        [[nodiscard]] auto batches() const -> uint64_t {
+            lock_guard<mutex> guard(t_state->lock);
+            return t_state->consumed;
+        }
+
+        /** Bytes delivered per second, from the first fetch to the last completed batch */
+        [[nodiscard]] auto bytesPerSecond() const -> double {
+            lock_guard<mutex> guard(t_state->lock);
+            const auto seconds = chrono::duration_cast<chrono::duration<double >>(
+                    t_state->lastComplete - t_state->firstFetch).count();
+            return seconds > 0 ? t_state->bytesDelivered / seconds : 0.0;
+        }
+
+        auto report(ostream &os = cout) const -> void {
+            const auto rate = bytesPerSecond();
+            lock_guard<mutex> guard(t_state->lock);
+            const auto &s = *t_state;
+            os << "Host data source: " << s.consumed << " batches of " << s.batchBytes << " bytes through "
+               << s.buffers.size() << " buffers, " << setprecision(4) << rate / 1e9 << " GB/s. "
+               << s.stalls << " stalls waiting for the producer (" << s.stalledSeconds << "s), "
+               << s.prefetchMisses << " prefetch misses" << endl;
+        }
+    };
+
+    /**
+     * The device-to-host counterpart of HostDataSource: each batch the device writes to a FIFO is copied into a
+     * ring of host buffers by the stream callback, and a consumer thread processes it (writes it out, checks it...)
+     * while the device carries on. The callback only waits when all the buffers are still waiting to be consumed.
+     *
+     *     auto sink = ipu::HostDataSink(batchBytes, [](const char *batch, size_t bytes, uint64_t i) { ... });
+     *     sink.connect(engine, "FROM_IPU");
+     *     engine.run(0);
+     *     sink.drain();
+     */
+    class HostDataSink {
+    public:
+        using Consumer = function<void(const char *buffer, size_t batchBytes, uint64_t batch)>;
+
+    private:
+        struct State {
+            size_t batchBytes;
+            Consumer consumer;
+            vector<vector<char>> buffers;
+            mutex lock;
+            condition_variable changed;
+            uint64_t received = 0; // Batches copied out of the stream so far
+            uint64_t consumed = 0; // Batches the consumer has finished with
+            bool stopping = false;
+            uint64_t stalls = 0;   // Callbacks that had to wait for the consumer to free a buffer
+            double stalledSeconds = 0;
+
+            auto receive(const void *p) -> void {
+                unique_lock<mutex> guard(lock);
+                if (received - consumed == buffers.size()) {
+                    stalls++;
+                    const auto tic = chrono::high_resolution_clock::now();
+                    changed.wait(guard, [this]() { return received - consumed < buffers.size() || stopping; });
+                    stalledSeconds += chrono::duration_cast<chrono::duration<double >>(
+                            chrono::high_resolution_clock::now() - tic).count();
+                    if (stopping) return;
+                }
+                auto &buffer = buffers[received % buffers.size()];
+                guard.unlock();
+
+                memcpy(buffer.data(), p, batchBytes); // Only the consumer reads it, and not until we bump received
+
+                guard.lock();
+                received++;
+                changed.notify_all();
+            }
+
+            auto consumeAll() -> void {
+                while (true) {
+                    unique_lock<mutex> guard(lock);
+                    changed.wait(guard, [this]() { return stopping || consumed < received; });
+                    if (consumed == received) return; // Stopping, and nothing left to do
+                    const auto batch = consumed;
+                    const auto &buffer = buffers[batch % buffers.size()];
+                    guard.unlock();
+
+                    consumer(buffer.data(), batchBytes, batch);
+
+                    guard.lock();
+                    consumed++;
+                    changed.notify_all();
+                }
+            }
+        };
+
+        shared_ptr<State> t_state;
+        thread t_consumer;
+
+    public:
+        HostDataSink(const size_t batchBytes, Consumer consumer, const unsigned numBuffers = 2) :
+                t_state(make_shared<State>()) {
+            if (batchBytes == 0) throw invalid_argument("Batches must be at least one byte");
+            if (numBuffers < 2) throw invalid_argument("A host data sink needs at least two buffers to overlap");
+            t_state->batchBytes = batchBytes;
+            t_state->consumer = move(consumer);
+            t_state->buffers = vector<vector<char>>(numBuffers, vector<char>(batchBytes));
+        }
+
+        HostDataSink(HostDataSink &&) = default;
+
+        auto operator=(HostDataSink &&) -> HostDataSink & = delete;
+
+        ~HostDataSink() { drain(); }
+
+        /** Starts the consumer thread and connects the stream. Call after loading the engine */
+        auto connect(Engine &engine, const string &stream) -> void {
+            if (t_consumer.joinable()) throw logic_error("This host data sink is already connected");
+            engine.connectStreamToCallback(stream, [state = t_state](void *p) { state->receive(p); });
+            t_consumer = thread([state = t_state]() { state->consumeAll(); });
+        }
+
+        /** Waits for the consumer to finish every batch received so far, then stops it */
+        auto drain() -> void {
+            if (t_state == nullptr) return; // Moved from
+            {
+                lock_guard<mutex> guard(t_state->lock);
+                t_state->stopping = true;
+            }
+            t_state->changed.notify_all();
+            if (t_consumer.joinable()) t_consumer.join();
+        }
+
+        [[nodiscard]] auto batches() const -> uint64_t {
+            lock_guard<mutex> guard(t_state->lock);
+            return t_state->consumed;
+        }
+
+        auto report(ostream &os = cout) const -> void {
+            lock_guard<mutex> guard(t_state->lock);
+            const auto &s = *t_state;
+            os << "Host data sink: " << s.consumed << " batches of " << s.batchBytes << " bytes through "
+               << s.buffers.size() << " buffers. " << s.stalls << " stalls waiting for the consumer ("
+               << setprecision(4) << s.stalledSeconds << "s)" << endl;
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef IPU_LINEARTILEMAPPING_HPP
+#define IPU_LINEARTILEMAPPING_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <poplar/Graph.hpp>
+#include <poplar/Tensor.hpp>
+#include <poplar/Interval.hpp>
+#include <poplar/Target.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace std;
+
+    /** For each tile, the intervals of the (flattened) tensor it holds. The same shape as Graph::getTileMapping */
+    using TileIntervals = vector<vector<Interval>>;
+
+    /**
+     * Maps a tensor linearly over a set of tiles, like poputil::mapTensorLinearly, but with more control:
+     *
+     * - every tile's slice starts on an alignment boundary (8 bytes by default), so vertices can use 64-bit
+     *   loads and VectorLayout::ONE_PTR, 8 without Poplar inserting copies to realign the data
+     * - slices are whole multiples of a minimum grain (e.g. the SIMD width or a row of a structure)
+     * - only a range of tiles on each IPU, and/or a range of IPUs, can be targeted
+     * - tiles can be given weighted shares (e.g. to leave room on tile 0 for other data)
+     *
+     * The elements left over when the tensor doesn't divide evenly go one grain at a time to the tiles with the
+     * largest shortfall, so no tile has more than one grain more than its share.
+     *
+     *     const auto mapping = ipu::LinearTileMapping{}.grain(4).tiles(0, 1000).apply(graph, tensor);
+     *     for (auto tile = 0u; tile < mapping.size(); tile++)
+     *         for (const auto &interval: mapping[tile]) ... add a vertex for tensor.slice(interval) on tile
+     */
+    class LinearTileMapping {
+        size_t t_grain = 1;
+        size_t t_alignmentBytes = 8;
+        optional<pair<unsigned, unsigned>> t_tiles = nullopt;
+        optional<pair<unsigned, unsigned>> t_ipus = nullopt;
+        vector<double> t_weights;
+
+    public:
+        /** The smallest number of elements any tile gets (other than none, or the remainder on the last tile) */
+        auto grain(const size_t elements) -> LinearTileMapping & {
+            if (elements == 0) throw invalid_argument("The mapping grain must be at least 1 element");
+            t_grain = elements;
+            return *this;
+        }
+
+        /** The byte alignment for the start of every tile's slice. 1 turns alignment off */
+        auto alignment(const size_t bytes) -> LinearTileMapping & {
+            if (bytes == 0) throw invalid_argument("The mapping alignment must be at least 1 byte");
+            t_alignmentBytes = bytes;
+            return *this;
+        }
+
+        /** Only use tiles [from, to) on each IPU */
+        auto tiles(const unsigned from, const unsigned to) -> LinearTileMapping & {
+            t_tiles = {from, to};
+            return *this;
+        }
+
+        /** Only use IPUs [from, to) */
+        auto ipus(const unsigned from, const unsigned to) -> LinearTileMapping & {
+            t_ipus = {from, to};
+            return *this;
+        }
+
+        /** Relative share for each tile used, in the order of targetTiles() */
+        auto weights(vector<double> weights) -> LinearTileMapping & {
+            t_weights = move(weights);
+            return *this;
+        }
+
+        /** The global tile numbers we map to, in order */
+        [[nodiscard]] auto targetTiles(const Target &target) const -> vector<unsigned> {
+            const auto tilesPerIpu = target.getTilesPerIPU();
+            const auto [fromIpu, toIpu] = t_ipus.value_or(make_pair(0u, target.getNumIPUs()));
+            const auto [fromTile, toTile] = t_tiles.value_or(make_pair(0u, tilesPerIpu));
+            if (fromIpu >= toIpu || toIpu > target.getNumIPUs()) {
+                throw invalid_argument("IPU range [" + to_string(fromIpu) + ", " + to_string(toIpu) +
+                                       ") is empty or not on this target");
+            }
+            if (fromTile >= toTile || toTile > tilesPerIpu) {
+                throw invalid_argument("Tile range [" + to_string(fromTile) + ", " + to_string(toTile) +
+                                       ") is empty or not on this target");
+            }
+            auto result = vector<unsigned>{};
+            for (auto ipu = fromIpu; ipu < toIpu; ipu++) {
+                for (auto tile = fromTile; tile < toTile; tile++) {
+                    result.push_back(ipu * tilesPerIpu + tile);
+                }
+            }
+            return result;
+        }
+
+        /** The grain actually used for elements of this size: a multiple of both the grain and the alignment */
+        [[nodiscard]] auto effectiveGrain(const size_t elementBytes) const -> size_t {
+            const auto elementsPerAlignment = t_alignmentBytes % elementBytes == 0
+                                              ? t_alignmentBytes / elementBytes : 1;
+            return lcm(t_grain, elementsPerAlignment);
+        }
+
+        /** Works out the mapping without applying it */
+        [[nodiscard]] auto intervals(const Target &target, const Type &type, const size_t numElements) const
+        -> TileIntervals {
+            const auto tiles = targetTiles(target);
+            if (!t_weights.empty() && t_weights.size() != tiles.size()) {
+                throw invalid_argument("Got " + to_string(t_weights.size()) + " weights for " +
+                                       to_string(tiles.size()) + " tiles");
+            }
+            const auto weightOf = [&](const size_t i) -> double { return t_weights.empty() ? 1.0 : t_weights[i]; };
+            const auto totalWeight = t_weights.empty() ? (double) tiles.size()
+                                                       : accumulate(t_weights.begin(), t_weights.end(), 0.0);
+            if (totalWeight <= 0) throw invalid_argument("Mapping weights must add up to more than 0");
+
+            // Share out whole grains by weight, then hand out the leftover grains by largest remainder
+            const auto grain = effectiveGrain(target.getTypeSize(type));
+            const auto numGrains = (numElements + grain - 1) / grain;
+            auto grainsForTile = vector<size_t>(tiles.size());
+            auto remainders = vector<pair<double, size_t>>{};
+            size_t grainsAssigned = 0;
+            for (auto i = 0u; i < tiles.size(); i++) {
+                const auto share = numGrains * weightOf(i) / totalWeight;
+                grainsForTile[i] = static_cast<size_t>(floor(share));
+                grainsAssigned += grainsForTile[i];
+                remainders.emplace_back(share - grainsForTile[i], i);
+            }
+            stable_sort(remainders.begin(), remainders.end(), [](const auto &a, const auto &b) {
+                return a.first > b.first;
+            });
+            for (auto i = 0u; grainsAssigned < numGrains; i++, grainsAssigned++) {
+                grainsForTile[remainders[i % remainders.size()].second]++;
+            }
+
+            auto result = TileIntervals(target.getNumTiles());
+            size_t from = 0;
+            for (auto i = 0u; i < tiles.size() && from < numElements; i++) {
+                const auto to = min(numElements, from + grainsForTile[i] * grain);
+                if (to > from) result[tiles[i]].emplace_back(from, to);
+                from = to;
+            }
+            return result;
+        }
+
+        /** Maps the (flattened) tensor and returns the intervals each tile got, for wiring up vertices */
+        auto apply(Graph &graph, const Tensor &tensor) const -> TileIntervals {
+            const auto flat = tensor.flatten();
+            const auto mapping = intervals(graph.getTarget(), tensor.elementType(), flat.numElements());
+            graph.setTileMapping(flat, mapping);
+            return mapping;
+        }
+    };
+
+    /** For each tile, for each of its workers, the intervals of the (flattened) tensor that worker processes */
+    using WorkerIntervals = vector<vector<vector<Interval>>>;
+
+    /**
+     * Splits each tile's intervals between its workers (e.g. target.getNumWorkerContexts()), so a vertex per
+     * worker piece keeps all the hardware threads busy instead of one. Workers get whole grains of elements, with
+     * leftover grains going one each to the first workers and the partial grain at the end of the tile's data to
+     * the last busy worker, so the split points stay aligned if the grain is a multiple of the SIMD width.
+     * A worker's share can span several of its tile's intervals, in which case it gets one piece per interval.
+     */
+    inline auto splitAcrossWorkers(const TileIntervals &mapping, const unsigned numWorkers, const size_t grain = 1)
+    -> WorkerIntervals {
+        if (numWorkers == 0) throw invalid_argument("Work must be split across at least one worker");
+        if (grain == 0) throw invalid_argument("The worker grain must be at least 1 element");
+
+        auto result = WorkerIntervals(mapping.size(), vector<vector<Interval>>(numWorkers));
+        for (auto tile = 0u; tile < mapping.size(); tile++) {
+            const auto &intervals = mapping[tile];
+            size_t total = 0;
+            for (const auto &interval: intervals) total += interval.size();
+            if (total == 0) continue;
+
+            const auto numGrains = (total + grain - 1) / grain;
+            auto interval = intervals.begin();
+            auto offsetInInterval = size_t{0};
+            auto from = size_t{0};
+            for (auto worker = 0u; worker < numWorkers && from < total; worker++) {
+                const auto grains = numGrains / numWorkers + (worker < numGrains % numWorkers ? 1 : 0);
+                const auto to = min(total, from + grains * grain);
+                // Walk along the tile's intervals, cutting out this worker's [from, to) of them
+                for (auto remaining = to - from; remaining > 0;) {
+                    const auto available = interval->size() - offsetInInterval;
+                    const auto taken = min(available, remaining);
+                    const auto begin = interval->begin() + offsetInInterval;
+                    result[tile][worker].emplace_back(begin, begin + taken);
+                    remaining -= taken;
+                    offsetInInterval += taken;
+                    if (offsetInInterval == interval->size()) {
+                        ++interval;
+                        offsetInInterval = 0;
+                    }
+                }
+                from = to;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Prints how evenly the work is spread: the busiest tile and worker against the mean over all tiles and
+     * workers. The BSP step lasts as long as the busiest worker, so max/mean is roughly the slowdown over a
+     * perfect split
+     */
+    inline auto reportWorkBalance(const WorkerIntervals &split, ostream &os = cout) -> void {
+        size_t total = 0, maxTile = 0, maxWorker = 0, numWorkers = 0, idleWorkers = 0, busyTiles = 0;
+        for (const auto &workers: split) {
+            size_t tileTotal = 0;
+            for (const auto &pieces: workers) {
+                size_t workerTotal = 0;
+                for (const auto &piece: pieces) workerTotal += piece.size();
+                tileTotal += workerTotal;
+                maxWorker = max(maxWorker, workerTotal);
+                if (workerTotal == 0) idleWorkers++;
+                numWorkers++;
+            }
+            total += tileTotal;
+            maxTile = max(maxTile, tileTotal);
+            if (tileTotal > 0) busyTiles++;
+        }
+        if (total == 0) {
+            os << "Work balance: nothing to do" << endl;
+            return;
+        }
+        const auto meanTile = (double) total / split.size();
+        const auto meanWorker = (double) total / numWorkers;
+        os << "Work balance: " << total << " elements on " << busyTiles << "/" << split.size() << " tiles, "
+           << numWorkers - idleWorkers << "/" << numWorkers << " workers busy. "
+           << "Per tile max " << maxTile << " (mean " << setprecision(4) << meanTile
+           << ", imbalance " << maxTile / meanTile << "x), "
+           << "per worker max " << maxWorker << " (mean " << meanWorker
+           << ", imbalance " << maxWorker / meanWorker << "x)" << endl;
+    }
+
+}
+
+#endif
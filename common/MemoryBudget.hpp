@@ -0,0 +1,178 @@
+#ifndef IPU_MEMORYBUDGET_HPP
+#define IPU_MEMORYBUDGET_HPP
+
+#include <iostream>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <poplar/Graph.hpp>
+#include <poplar/Tensor.hpp>
+#include <poplar/Target.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace std;
+
+    /**
+     * A rough estimate of how much memory each tile will need, made before compiling so that a configuration
+     * that can't fit fails in seconds rather than after a long graph compilation.
+     *
+     * Tensor bytes come from the tile mappings of the tensors we add. Everything else is estimated: vertex state
+     * (a few bytes per field, added per vertex), exchange receive buffers (the bytes a tile's vertices read from
+     * other tiles' memories), and a fixed per-tile overhead for codelet and control code, worker stacks and the
+     * Poplar runtime. The real figure is usually somewhat higher (e.g. from alignment gaps and rearrangement
+     * copies), so treat the headroom as an upper bound.
+     *
+     *     auto budget = ipu::MemoryBudget(graph);
+     *     budget.addTensors(tensors);
+     *     budget.addVerticesOnEveryTile(7);
+     *     budget.enforce(); // Throws, with the worst tiles, if any tile is over budget
+     */
+    class MemoryBudget {
+        const Graph &t_graph;
+        size_t t_bytesPerTile;
+        size_t t_overheadBytesPerTile;
+        vector<size_t> t_tensorBytes;
+        vector<size_t> t_vertexBytes;
+        vector<size_t> t_exchangeBytes;
+        vector<pair<string, size_t>> t_largestTensor;
+
+        [[nodiscard]] auto numTiles() const -> unsigned { return t_graph.getTarget().getNumTiles(); }
+
+        [[nodiscard]] auto elementBytes(const Tensor &tensor) const -> size_t {
+            return t_graph.getTarget().getTypeSize(tensor.elementType());
+        }
+
+        [[nodiscard]] auto worstTiles(const size_t count) const -> vector<unsigned> {
+            auto tiles = vector<unsigned>(numTiles());
+            iota(tiles.begin(), tiles.end(), 0);
+            const auto n = min<size_t>(count, tiles.size());
+            partial_sort(tiles.begin(), tiles.begin() + n, tiles.end(), [this](const unsigned a, const unsigned b) {
+                return bytesOnTile(a) > bytesOnTile(b);
+            });
+            tiles.resize(n);
+            return tiles;
+        }
+
+    public:
+        static constexpr size_t DefaultOverheadBytesPerTile = 24 * 1024;
+        static constexpr size_t DefaultVertexStateBytes = 32;
+
+        explicit MemoryBudget(const Graph &graph, const size_t overheadBytesPerTile = DefaultOverheadBytesPerTile) :
+                t_graph(graph),
+                t_bytesPerTile(graph.getTarget().getBytesPerTile()),
+                t_overheadBytesPerTile(overheadBytesPerTile),
+                t_tensorBytes(graph.getTarget().getNumTiles()),
+                t_vertexBytes(graph.getTarget().getNumTiles()),
+                t_exchangeBytes(graph.getTarget().getNumTiles()),
+                t_largestTensor(graph.getTarget().getNumTiles()) {}
+
+        /** Counts the bytes of the tensor on each tile it is mapped to. Don't add overlapping slices twice! */
+        auto addTensor(const string &name, const Tensor &tensor) -> MemoryBudget & {
+            const auto mapping = t_graph.getTileMapping(tensor, false);
+            for (auto tile = 0u; tile < mapping.size(); tile++) {
+                size_t elements = 0;
+                for (const auto &interval: mapping[tile]) elements += interval.size();
+                const auto bytes = elements * elementBytes(tensor);
+                t_tensorBytes[tile] += bytes;
+                if (bytes > t_largestTensor[tile].second) t_largestTensor[tile] = {name, bytes};
+            }
+            return *this;
+        }
+
+        auto addTensors(const map<string, Tensor> &tensors) -> MemoryBudget & {
+            for (const auto &[name, tensor]: tensors) addTensor(name, tensor);
+            return *this;
+        }
+
+        auto addVertices(const unsigned tile, const size_t count,
+                         const size_t stateBytesEach = DefaultVertexStateBytes) -> MemoryBudget & {
+            t_vertexBytes.at(tile) += count * stateBytesEach;
+            return *this;
+        }
+
+        auto addVerticesOnEveryTile(const size_t count,
+                                    const size_t stateBytesEach = DefaultVertexStateBytes) -> MemoryBudget & {
+            for (auto tile = 0u; tile < numTiles(); tile++) addVertices(tile, count, stateBytesEach);
+            return *this;
+        }
+
+        /**
+         * Records that vertices on this tile read the given tensor: any of it that lives on other tiles has to be
+         * exchanged into a receive buffer on this tile
+         */
+        auto addRemoteReads(const unsigned tile, const Tensor &tensor) -> MemoryBudget & {
+            const auto mapping = t_graph.getTileMapping(tensor, false);
+            for (auto t = 0u; t < mapping.size(); t++) {
+                if (t == tile) continue;
+                for (const auto &interval: mapping[t]) {
+                    t_exchangeBytes.at(tile) += interval.size() * elementBytes(tensor);
+                }
+            }
+            return *this;
+        }
+
+        /** Any other buffer we know the compiler or our programs will need on this tile */
+        auto addBuffer(const unsigned tile, const size_t bytes) -> MemoryBudget & {
+            t_exchangeBytes.at(tile) += bytes;
+            return *this;
+        }
+
+        [[nodiscard]] auto bytesOnTile(const unsigned tile) const -> size_t {
+            return t_overheadBytesPerTile + t_tensorBytes.at(tile) + t_vertexBytes.at(tile) + t_exchangeBytes.at(tile);
+        }
+
+        /** Bytes left on the tile (negative when it is oversubscribed) */
+        [[nodiscard]] auto headroom(const unsigned tile) const -> long long {
+            return static_cast<long long>(t_bytesPerTile) - static_cast<long long>(bytesOnTile(tile));
+        }
+
+        [[nodiscard]] auto fits() const -> bool {
+            for (auto tile = 0u; tile < numTiles(); tile++) {
+                if (headroom(tile) < 0) return false;
+            }
+            return true;
+        }
+
+        auto report(ostream &os = cout, const size_t worst = 5) const -> void {
+            os << "Estimated tile memory (budget " << t_bytesPerTile / 1024 << "KiB per tile), worst tiles:" << endl;
+            os << setw(8) << "tile" << setw(12) << "tensors" << setw(10) << "vertices" << setw(10) << "exchange"
+               << setw(10) << "overhead" << setw(12) << "total" << setw(12) << "headroom" << "  largest tensor"
+               << endl;
+            for (const auto tile: worstTiles(worst)) {
+                os << setw(8) << tile << setw(12) << t_tensorBytes[tile] << setw(10) << t_vertexBytes[tile]
+                   << setw(10) << t_exchangeBytes[tile] << setw(10) << t_overheadBytesPerTile
+                   << setw(12) << bytesOnTile(tile) << setw(12) << headroom(tile)
+                   << "  " << t_largestTensor[tile].first << endl;
+            }
+        }
+
+        /** Reports and throws if any tile is estimated to be over budget, before we waste time compiling */
+        auto enforce(ostream &os = cout) const -> void {
+            report(os);
+            if (fits()) return;
+
+            auto overBudget = 0u;
+            for (auto tile = 0u; tile < numTiles(); tile++) {
+                if (headroom(tile) < 0) overBudget++;
+            }
+            const auto worstTile = worstTiles(1)[0];
+            stringstream ss;
+            ss << overBudget << " of " << numTiles() << " tiles are estimated to need more than their "
+               << t_bytesPerTile << " bytes of memory. Tile " << worstTile << " needs " << bytesOnTile(worstTile)
+               << " bytes (" << t_tensorBytes[worstTile] << " for tensors, largest '"
+               << t_largestTensor[worstTile].first << "'). Reduce the per-tile data size, spread the data over more "
+               << "tiles or IPUs, or move data that isn't needed every step into a RemoteBuffer.";
+            throw runtime_error(ss.str());
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef IPU_PROFILEDIGEST_HPP
+#define IPU_PROFILEDIGEST_HPP
+
+#include <iostream>
+#include <cstdint>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <pva/pva.hpp>
+
+namespace ipu {
+    using namespace std;
+
+    /** Cycles spent in all the execution steps of one program (usually a named compute set) */
+    struct StepDigest {
+        string name;
+        string kind;
+        uint64_t calls = 0;
+        uint64_t maxTileCycles = 0; // Sum over calls of the slowest tile's cycles, i.e. the time the step took
+        double meanTileCycles = 0;  // Sum over calls of the mean tile cycles
+
+        /** max/mean tile cycles: 1 is perfectly balanced, 2 means the slowest tile took twice the average */
+        [[nodiscard]] auto imbalance() const -> double {
+            return meanTileCycles > 0 ? maxTileCycles / meanTileCycles : 1.0;
+        }
+    };
+
+    /**
+     * A compact summary of an execution profile (the profile.pop the engine writes with autoReport.all), so we
+     * don't need to eyeball printProfileSummary output: per-program step cycles and tile imbalance, the split
+     * between compute, exchange and sync cycles, and the per-tile memory high-water mark. Steps are keyed by
+     * program name, so named compute sets like "explicitCompute1" or "acceptParticles" can be compared directly
+     * between two runs with printComparison.
+     */
+    class ProfileDigest {
+        vector<StepDigest> t_steps;
+        map<string, uint64_t> t_cyclesByKind;
+        uint64_t t_maxTileMemory = 0;
+        unsigned t_maxMemoryTile = 0;
+        uint64_t t_bytesPerTile = 0;
+        double t_clockHz = 0;
+
+        static auto kindOf(const pva::Program::Type type) -> string {
+            switch (type) {
+                case pva::Program::Type::OnTileExecute:
+                    return "compute";
+                case pva::Program::Type::DoExchange:
+                case pva::Program::Type::GlobalExchange:
+                case pva::Program::Type::StreamCopyBegin:
+                case pva::Program::Type::StreamCopyMid:
+                case pva::Program::Type::StreamCopyEnd:
+                    return "exchange";
+                case pva::Program::Type::Sync:
+                case pva::Program::Type::SyncAns:
+                    return "sync";
+                default:
+                    return "other";
+            }
+        }
+
+        static auto escaped(const string &s) -> string {
+            auto result = string{};
+            for (const auto c: s) {
+                if (c == '"' || c == '\\') result += '\\';
+                result += c;
+            }
+            return result;
+        }
+
+    public:
+        static auto fromReport(const pva::Report &report) -> ProfileDigest {
+            auto digest = ProfileDigest{};
+            auto indexOf = map<string, size_t>{};
+
+            for (const auto &step: report.execution().steps()) {
+                const auto program = step.program();
+                const auto name = program->name();
+                if (indexOf.count(name) == 0) {
+                    indexOf[name] = digest.t_steps.size();
+                    digest.t_steps.push_back({name, kindOf(program->type())});
+                }
+                auto &s = digest.t_steps[indexOf[name]];
+
+                // Across IPUs, the step takes as long as the slowest IPU's slowest tile
+                uint64_t maxCycles = 0;
+                auto meanCycles = 0.0;
+                const auto ipus = step.ipus();
+                for (const auto &ipu: ipus) {
+                    maxCycles = max<uint64_t>(maxCycles, ipu.cycles());
+                    meanCycles += ipu.cycles() * ipu.tileBalance() / ipus.size();
+                }
+                s.calls++;
+                s.maxTileCycles += maxCycles;
+                s.meanTileCycles += meanCycles;
+                digest.t_cyclesByKind[s.kind] += maxCycles;
+            }
+
+            const auto compilation = report.compilation();
+            for (const auto &tile: compilation.tiles()) {
+                const auto bytes = tile.memory().total().includingGaps();
+                if (bytes > digest.t_maxTileMemory) {
+                    digest.t_maxTileMemory = bytes;
+                    digest.t_maxMemoryTile = tile.number();
+                }
+            }
+            digest.t_bytesPerTile = compilation.target().bytesPerTile();
+            digest.t_clockHz = compilation.target().clockFrequency();
+            return digest;
+        }
+
+        static auto fromFile(const string &profilePath) -> ProfileDigest {
+            return fromReport(pva::openReport(profilePath));
+        }
+
+        [[nodiscard]] auto steps() const -> const vector<StepDigest> & { return t_steps; }
+
+        [[nodiscard]] auto cycles(const string &kind) const -> uint64_t {
+            const auto it = t_cyclesByKind.find(kind);
+            return it != t_cyclesByKind.end() ? it->second : 0;
+        }
+
+        [[nodiscard]] auto totalCycles() const -> uint64_t {
+            uint64_t total = 0;
+            for (const auto &[kind, cycles]: t_cyclesByKind) total += cycles;
+            return total;
+        }
+
+        [[nodiscard]] auto find(const string &name) const -> const StepDigest * {
+            for (const auto &step: t_steps) {
+                if (step.name == name) return &step;
+            }
+            return nullptr;
+        }
+
+        auto print(ostream &os = cout) const -> void {
+            const auto total = totalCycles();
+            const auto percent = [total](const uint64_t cycles) -> double {
+                return total > 0 ? 100.0 * cycles / total : 0.0;
+            };
+
+            os << setw(40) << left << "program" << right << setw(10) << "kind" << setw(8) << "calls"
+               << setw(16) << "max cycles" << setw(16) << "mean cycles" << setw(11) << "imbalance"
+               << setw(8) << "share" << endl;
+            auto sorted = t_steps;
+            sort(sorted.begin(), sorted.end(), [](const StepDigest &a, const StepDigest &b) {
+                return a.maxTileCycles > b.maxTileCycles;
+            });
+            for (const auto &s: sorted) {
+                os << setw(40) << left << s.name << right << setw(10) << s.kind << setw(8) << s.calls
+                   << setw(16) << s.maxTileCycles << setw(16) << fixed << setprecision(0) << s.meanTileCycles
+                   << setw(11) << setprecision(2) << s.imbalance()
+                   << setw(7) << setprecision(1) << percent(s.maxTileCycles) << "%" << endl;
+                os.unsetf(ios::fixed);
+            }
+            os << endl << "Total " << total << " cycles";
+            if (t_clockHz > 0) os << " (" << setprecision(5) << total / t_clockHz << "s)";
+            os << fixed << setprecision(1)
+               << ": compute " << percent(cycles("compute")) << "%, exchange " << percent(cycles("exchange"))
+               << "%, sync " << percent(cycles("sync")) << "%, other " << percent(cycles("other")) << "%" << endl;
+            os << "Memory high-water mark: " << t_maxTileMemory << " bytes on tile " << t_maxMemoryTile;
+            if (t_bytesPerTile > 0) os << " (" << 100.0 * t_maxTileMemory / t_bytesPerTile << "%)";
+            os << endl;
+            os.unsetf(ios::fixed);
+        }
+
+        [[nodiscard]] auto toJson() const -> string {
+            stringstream ss;
+            ss << "{\"totalCycles\":" << totalCycles()
+               << ",\"computeCycles\":" << cycles("compute")
+               << ",\"exchangeCycles\":" << cycles("exchange")
+               << ",\"syncCycles\":" << cycles("sync")
+               << ",\"otherCycles\":" << cycles("other")
+               << ",\"maxTileMemory\":" << t_maxTileMemory
+               << ",\"maxMemoryTile\":" << t_maxMemoryTile
+               << ",\"bytesPerTile\":" << t_bytesPerTile
+               << ",\"steps\":{";
+            for (auto i = 0u; i < t_steps.size(); i++) {
+                const auto &s = t_steps[i];
+                ss << (i > 0 ? "," : "") << "\"" << escaped(s.name) << "\":{\"kind\":\"" << s.kind
+                   << "\",\"calls\":" << s.calls << ",\"maxTileCycles\":" << s.maxTileCycles
+                   << ",\"meanTileCycles\":" << setprecision(12) << s.meanTileCycles
+                   << ",\"imbalance\":" << setprecision(6) << s.imbalance() << "}";
+            }
+            ss << "}}";
+            return ss.str();
+        }
+
+        auto writeJson(const string &path) const -> void {
+            ofstream file(path, ios::trunc);
+            file << toJson() << endl;
+            cout << "Profile digest written to " << path << endl;
+        }
+
+        /** Side-by-side max cycles per program for two profiles, e.g. of two halo exchange strategies */
+        static auto printComparison(const ProfileDigest &a, const ProfileDigest &b, ostream &os = cout) -> void {
+            auto names = vector<string>{};
+            for (const auto &s: a.t_steps) names.push_back(s.name);
+            for (const auto &s: b.t_steps) {
+                if (a.find(s.name) == nullptr) names.push_back(s.name);
+            }
+
+            const auto cyclesIn = [](const ProfileDigest &d, const string &name) -> uint64_t {
+                const auto s = d.find(name);
+                return s != nullptr ? s->maxTileCycles : 0;
+            };
+            const auto row = [&os](const string &name, const uint64_t cyclesA, const uint64_t cyclesB) {
+                os << setw(40) << left << name << right << setw(16) << cyclesA << setw(16) << cyclesB;
+                if (cyclesA > 0) os << setw(10) << fixed << setprecision(2) << (double) cyclesB / cyclesA << "x";
+                os << endl;
+                os.unsetf(ios::fixed);
+            };
+
+            os << setw(40) << left << "program" << right << setw(16) << "A cycles" << setw(16) << "B cycles"
+               << setw(11) << "B/A" << endl;
+            for (const auto &name: names) row(name, cyclesIn(a, name), cyclesIn(b, name));
+            for (const auto kind: {"compute", "exchange", "sync", "other"}) {
+                row(string{"["} + kind + "]", a.cycles(kind), b.cycles(kind));
+            }
+            row("[total]", a.totalCycles(), b.totalCycles());
+        }
+    };
+
+}
+
+#endif
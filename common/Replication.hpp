@@ -0,0 +1,102 @@
+#ifndef IPU_REPLICATION_HPP
+#define IPU_REPLICATION_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <stdexcept>
+#include <poplar/Device.hpp>
+#include <poplar/Engine.hpp>
+#include <poplar/Graph.hpp>
+#include <poplar/Target.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace std;
+
+    /**
+     * Data-parallel replication: the graph is built once for one replica's share of the device (e.g. 1 IPU of a
+     * 4-IPU device with 4 replicas), and Poplar runs a copy of it on every replica with its own data. Streams are
+     * per replica, so each replica reads and writes its own slice of the host buffers, and N replicas process N
+     * independent jobs in the time one takes.
+     *
+     *     const auto replication = ipu::Replication::fromCommandLine(argc, argv); // --replicas=N or IPU_REPLICAS
+     *     auto device = ipu::createDevice({ipu::DeviceKind::Auto, "any", replication.replicas() * ipusPerReplica});
+     *     auto graph = replication.createGraph(*device);  // graph.getTarget() is one replica's target
+     *     ...
+     *     auto input = vector<float>(replication.replicas() * itemsPerReplica);
+     *     replication.connectStream(engine, "TO_IPU", input.data(), itemsPerReplica * sizeof(float));
+     */
+    class Replication {
+        unsigned t_replicas;
+
+    public:
+        explicit Replication(const unsigned replicas = 1) : t_replicas(replicas) {
+            if (replicas == 0) throw invalid_argument("There must be at least one replica");
+        }
+
+        static auto fromEnvironment() -> Replication {
+            const auto replicas = getenv("IPU_REPLICAS");
+            return Replication{replicas != nullptr ? (unsigned) stoul(replicas) : 1u};
+        }
+
+        static auto fromCommandLine(const int argc, char *argv[]) -> Replication {
+            auto result = fromEnvironment();
+            const auto prefix = string{"--replicas="};
+            for (auto i = 1; i < argc; i++) {
+                const auto arg = string{argv[i]};
+                if (arg.rfind(prefix, 0) == 0) result = Replication{(unsigned) stoul(arg.substr(prefix.size()))};
+            }
+            return result;
+        }
+
+        [[nodiscard]] auto replicas() const -> unsigned { return t_replicas; }
+
+        [[nodiscard]] auto isReplicated() const -> bool { return t_replicas > 1; }
+
+        /** A graph for one replica, which must get a whole number of the device's IPUs */
+        [[nodiscard]] auto createGraph(const Device &device) const -> Graph {
+            const auto &target = device.getTarget();
+            if (target.getNumIPUs() % t_replicas != 0) {
+                throw invalid_argument("Can't split " + to_string(target.getNumIPUs()) + " IPUs into " +
+                                       to_string(t_replicas) + " replicas. Use a multiple of " +
+                                       to_string(t_replicas) + " IPUs");
+            }
+            if (!isReplicated()) return Graph(target);
+            cout << "Replicating the graph " << t_replicas << " times (" << target.getNumIPUs() / t_replicas
+                 << " IPUs per replica)" << endl;
+            return Graph(target, replication_factor(t_replicas));
+        }
+
+        /**
+         * Connects replica r's end of the stream to data + r * bytesPerReplica, so one host buffer holds every
+         * replica's inputs (or results) side by side
+         */
+        auto connectStream(Engine &engine, const string &stream, void *data, const size_t bytesPerReplica) const
+        -> void {
+            for (auto replica = 0u; replica < t_replicas; replica++) {
+                engine.connectStream(stream, replica, static_cast<char *>(data) + replica * bytesPerReplica);
+            }
+        }
+
+        /** Prints one line per replica, e.g. a checksum of its slice of a host results buffer */
+        template<typename T>
+        auto reportPerReplica(const string &title, const T *data, const size_t elementsPerReplica,
+                              const function<double(const T *, size_t)> &summarise, ostream &os = cout) const
+        -> void {
+            os << title << ":" << endl;
+            for (auto replica = 0u; replica < t_replicas; replica++) {
+                os << "  replica " << setw(3) << replica << ": " << setprecision(8)
+                   << summarise(data + replica * elementsPerReplica, elementsPerReplica) << endl;
+            }
+        }
+    };
+
+}
+
+#endif
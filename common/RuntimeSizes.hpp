@@ -0,0 +1,104 @@
+#ifndef IPU_RUNTIMESIZES_HPP
+#define IPU_RUNTIMESIZES_HPP
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <poplar/Engine.hpp>
+#include <poplar/Graph.hpp>
+#include <poplar/Program.hpp>
+
+namespace ipu {
+    using namespace poplar;
+    using namespace poplar::program;
+    using namespace std;
+
+    /**
+     * Problem sizes (element counts, rows, columns...) that are read from device memory at runtime instead of
+     * being baked into the graph, so one compiled (and cached) executable sized for the maxima can run a whole
+     * sweep of smaller problems. Each size is an unsigned scalar with a copy on every tile, so vertices read it
+     * without any exchange, and the host sets them all through one FIFO before running the other programs:
+     *
+     *     auto sizes = ipu::RuntimeSizes(graph, {{"items", MaxItems}});
+     *     graph.connect(v["activeItems"], sizes.on("items", tile)); // Input<unsigned> activeItems
+     *     programs.push_back(sizes.program());
+     *     ...
+     *     sizes.connect(engine);
+     *     sizes.set("items", 1000);
+     *     engine.run(setSizesProgram); // then run the rest as usual
+     *
+     * Vertices should clamp their loops to the active size and return straight away when their part of the data
+     * is entirely outside it, so inactive regions cost only a few cycles.
+     */
+    class RuntimeSizes {
+        vector<string> t_names;
+        vector<unsigned> t_maxima;
+        unsigned t_numTiles;
+        unsigned t_replicas;
+        Tensor t_values; // [size][tile]
+        string t_stream;
+        vector<unsigned> t_host;
+        Program t_program;
+
+        [[nodiscard]] auto indexOf(const string &name) const -> size_t {
+            const auto it = find(t_names.begin(), t_names.end(), name);
+            if (it == t_names.end()) throw invalid_argument("No runtime size called '" + name + "'");
+            return it - t_names.begin();
+        }
+
+    public:
+        /** Sizes start at their maximum, so a program that never calls set() runs the full problem */
+        RuntimeSizes(Graph &graph, const vector<pair<string, unsigned>> &maxima,
+                     const string &stream = "runtimeSizes") :
+                t_numTiles(graph.getTarget().getNumTiles()), t_replicas(graph.getReplicationFactor()),
+                t_stream(stream) {
+            if (maxima.empty()) throw invalid_argument("There must be at least one runtime size");
+            for (const auto &[name, max]: maxima) {
+                t_names.push_back(name);
+                t_maxima.push_back(max);
+                t_host.insert(t_host.end(), t_numTiles, max);
+            }
+            t_values = graph.addVariable(UNSIGNED_INT, {t_names.size(), t_numTiles}, "runtimeSizes");
+            for (auto tile = 0u; tile < t_numTiles; tile++) {
+                graph.setTileMapping(t_values.slice(tile, tile + 1, 1), tile);
+            }
+            const auto toDevice = graph.addHostToDeviceFIFO(t_stream, UNSIGNED_INT, t_values.numElements());
+            t_program = Copy(toDevice, t_values);
+        }
+
+        /** The named size's copy on the given tile, for connecting to an Input<unsigned> vertex field */
+        [[nodiscard]] auto on(const string &name, const unsigned tile) const -> Tensor {
+            return t_values[indexOf(name)][tile];
+        }
+
+        /** Copies the current sizes to every tile */
+        [[nodiscard]] auto program() const -> Program { return t_program; }
+
+        /** Call after loading the engine. The values are read from the host each time program() runs */
+        auto connect(Engine &engine) -> void {
+            for (auto replica = 0u; replica < t_replicas; replica++) {
+                engine.connectStream(t_stream, replica, t_host.data()); // Every replica runs the same sizes
+            }
+        }
+
+        auto set(const string &name, const unsigned value) -> RuntimeSizes & {
+            const auto i = indexOf(name);
+            if (value > t_maxima[i]) {
+                throw invalid_argument("Runtime size '" + name + "' can't be " + to_string(value) +
+                                       ": the graph was compiled for at most " + to_string(t_maxima[i]));
+            }
+            fill(t_host.begin() + i * t_numTiles, t_host.begin() + (i + 1) * t_numTiles, value);
+            return *this;
+        }
+
+        [[nodiscard]] auto get(const string &name) const -> unsigned { return t_host[indexOf(name) * t_numTiles]; }
+
+        [[nodiscard]] auto max(const string &name) const -> unsigned { return t_maxima[indexOf(name)]; }
+    };
+
+}
+
+#endif
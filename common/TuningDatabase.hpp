@@ -0,0 +1,105 @@
+#ifndef IPU_TUNINGDATABASE_HPP
+#define IPU_TUNINGDATABASE_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <filesystem>
+#include "FileUtils.hpp"
+
+namespace ipu {
+    using namespace std;
+    namespace fs = std::filesystem;
+
+    /**
+     * The fastest choice (e.g. a strategy's name) an autotuner found for each configuration, so each configuration
+     * is only measured once. Keys describe the configuration and the target, e.g. "haloStrategy/ipu2/1x1472/b100",
+     * and the cost is whatever the tuner minimised. The file is plain text with one "key<TAB>choice<TAB>cost" line
+     * per key, so it's easy to read, diff and edit by hand. Runs recording at the same time take turns through
+     * a "<database>.lock" file beside it.
+     *
+     * Configure with IPU_TUNING_DB (default "tuning.db"). Setting it to the empty string disables the database:
+     * nothing is found, and nothing is recorded.
+     */
+    class TuningDatabase {
+        fs::path t_path;
+
+    public:
+        struct Entry {
+            string choice;
+            double cost;
+        };
+
+        static constexpr auto DefaultPath = "tuning.db";
+
+        explicit TuningDatabase(const fs::path &path = DefaultPath) : t_path(path) {}
+
+        static auto fromEnvironment() -> TuningDatabase {
+            const auto path = getenv("IPU_TUNING_DB");
+            return TuningDatabase{path != nullptr ? fs::path{path} : fs::path{DefaultPath}};
+        }
+
+        [[nodiscard]] auto enabled() const -> bool { return !t_path.empty(); }
+
+        [[nodiscard]] auto path() const -> const fs::path & { return t_path; }
+
+        /** Every entry in the database. Lines that don't parse are skipped */
+        [[nodiscard]] auto entries() const -> map<string, Entry> {
+            auto result = map<string, Entry>{};
+            if (!enabled()) return result;
+            ifstream file(t_path);
+            for (string line; getline(file, line);) {
+                stringstream ss(line);
+                string key, choice, cost;
+                if (getline(ss, key, '\t') && getline(ss, choice, '\t') && getline(ss, cost)) {
+                    try {
+                        result[key] = {choice, stod(cost)};
+                    } catch (const logic_error &) {
+                        cerr << "Skipping the unreadable tuning entry '" << line << "' in " << t_path << endl;
+                    }
+                }
+            }
+            return result;
+        }
+
+        [[nodiscard]] auto find(const string &key) const -> optional<Entry> {
+            const auto all = entries();
+            const auto it = all.find(key);
+            return it != all.end() ? optional<Entry>{it->second} : nullopt;
+        }
+
+        /** Adds the entry, replacing any for the same key */
+        auto record(const string &key, const Entry &entry) const -> void {
+            if (!enabled()) return;
+            if (key.find_first_of("\t\n") != string::npos || entry.choice.find_first_of("\t\n") != string::npos) {
+                throw invalid_argument("Tuning keys and choices can't contain tabs or newlines");
+            }
+            if (t_path.has_parent_path()) fs::create_directories(t_path.parent_path());
+            // So a run recording at the same time can't read the entries before we write ours, and drop them
+            const auto lock = FileLock{fs::path{t_path}.concat(".lock")};
+            auto all = entries();
+            all[key] = entry;
+            const auto tmpPath = uniqueTempPath(t_path);
+            {
+                ofstream file(tmpPath, ios::trunc);
+                file << setprecision(15);
+                for (const auto &[k, e]: all) file << k << '\t' << e.choice << '\t' << e.cost << '\n';
+                file.close();
+                if (!file) {
+                    fs::remove(tmpPath);
+                    throw runtime_error("Couldn't write the tuning database " + tmpPath.string());
+                }
+            }
+            fs::rename(tmpPath, t_path); // So a concurrent run never reads a half-written database
+        }
+    };
+
+}
+
+#endif
@@ -17,8 +17,9 @@
 #include <cmath>
 #include <random>
 #include "codelets/ParticleCodeletsCommon.h"
+#include "CommonIpuUtils.hpp"
 
-const auto InitialParticles = 1000;
+const auto InitialParticles = 1000; // Per tile by default. Change it with --particles=N, up to MaxNumParticles
 const auto GlobalXMin = 0;
 const auto GlobalXMax = 1000;
 const auto GlobalYMin = 0;
@@ -30,31 +31,8 @@ const auto NumProcessors = 900 * NumIpus;
 using namespace poplar;
 using namespace poplar::program;
 
-poplar::Device getIpuModel() {
-    poplar::IPUModel ipuModel;
-    ipuModel.numIPUs = 1;
-    ipuModel.tilesPerIPU = 4;
-    return ipuModel.createDevice();
-}
-
-auto getIpuDevice(unsigned int numIpus = 1) -> std::optional<Device> {
-    DeviceManager manager = DeviceManager::createDeviceManager();
-
-    // Attempt to connect to a single IPU
-    for (auto &d : manager.getDevices(poplar::TargetType::IPU, numIpus)) {
-        std::cerr << "Trying to attach to IPU " << d.getId();
-        if (d.attach()) {
-            std::cerr << " - attached" << std::endl;
-            return {std::move(d)};
-        } else {
-            std::cerr << std::endl;
-        }
-    }
-    std::cerr << "Error attaching to device" << std::endl;
-    return std::nullopt;
-}
-
-auto initialiseTileData(char *buf, const size_t numProcessors, const size_t MemSizePerTile) {
+auto initialiseTileData(char *buf, const size_t numProcessors, const size_t MemSizePerTile,
+                        const int initialParticles) {
 
 
     memset(buf, 0, MemSizePerTile * numProcessors);
@@ -72,7 +50,7 @@ auto initialiseTileData(char *buf, const size_t numProcessors, const size_t MemS
         auto tileData = reinterpret_cast<TileData *const>(&buf[tileOffset]);
         tileData->myRank = tileNum;
         tileData->numProcessors = numProcessors;
-        tileData->numParticles = InitialParticles;
+        tileData->numParticles = initialParticles;
         tileData->nextToShed = -1;
         tileData->global.min.x = GlobalXMin;
         tileData->global.min.y = GlobalYMin;
@@ -93,7 +71,7 @@ auto initialiseTileData(char *buf, const size_t numProcessors, const size_t MemS
         std::uniform_real_distribution<float> x_distribution(tileData->local.min.x, tileData->local.max.x);
         std::uniform_real_distribution<float> y_distribution(tileData->local.min.y, tileData->local.max.y);
 
-        for (auto i = 0; i < InitialParticles; i++) {
+        for (auto i = 0; i < initialParticles; i++) {
             Particle *const p = &tileData->particles[i];
             p->position = Vector2D{x_distribution(generator), y_distribution(generator)};
             auto speed = speed_distribution(generator);
@@ -112,25 +90,6 @@ auto angle(float x, float y) -> float {
     return atan2f(y, x);
 }
 
-const auto POPLAR_ENGINE_OPTIONS_DEBUG = OptionFlags{
-        {"target.saveArchive",                "archive.a"},
-        {"debug.instrument",                  "true"},
-        {"debug.instrumentCompute",           "true"},
-        {"debug.loweredVarDumpFile",          "vars.capnp"},
-        {"debug.instrumentControlFlow",       "true"},
-        {"debug.computeInstrumentationLevel", "tile"},
-        {"debug.outputAllSymbols",            "true"},
-        {"autoReport.all",                    "true"},
-        {"autoReport.outputSerializedGraph",  "true"},
-        {"debug.retainDebugInformation",      "true"},
-//        {"debug.runtimeVerify","true"},
-//        {"debug.trace", "true"},
-//        {"debug.traceFile", "debug.trace.out"},
-//        {"debug.verify", "true"}
-};
-
-const auto POPLAR_ENGINE_OPTIONS_RELEASE = OptionFlags{};
-
 auto printTileData(const TileData &tileData, bool ignoreGlobals, FILE *fptr) -> void {
     fprintf(fptr, "{");
     fprintf(fptr, "\"%s\":%d,", "rank", tileData.myRank);
@@ -186,13 +145,30 @@ void deserialiseToFile(char *buf, int iter, size_t numProcessors, size_t SizeOfM
 }
 
 
-int main() {
+// The particle count is data the vertices read from each tile's TileData, not part of the graph, so one
+// executable (compiled for MaxNumParticles per tile) serves any count up to that
+auto initialParticlesFromCommandLine(const int argc, char *argv[]) -> int {
+    auto result = InitialParticles;
+    const auto prefix = std::string{"--particles="};
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        if (arg.rfind(prefix, 0) == 0) result = std::stoi(arg.substr(prefix.size()));
+    }
+    if (result < 0 || result > MaxNumParticles) {
+        throw std::invalid_argument("--particles must be between 0 and " + std::to_string(MaxNumParticles));
+    }
+    return result;
+}
 
-//    auto device = std::optional<Device>{getIpuModel()};
-    auto device = getIpuDevice(NumIpus);
-    device = device->createVirtualDevice(NumProcessors / NumIpus);
+int main(int argc, char *argv[]) {
+    const auto initialParticles = initialParticlesFromCommandLine(argc, argv);
+
+    const auto deviceSpec = ipu::DeviceSpec::fromEnvironment(
+            {ipu::DeviceKind::Auto, "any", NumIpus, NumProcessors / NumIpus});
+    auto device = ipu::createDevice(deviceSpec);
     if (!device.has_value()) {
         std::cerr << "Could not attach to IPU device. Aborting" << std::endl;
+        return EXIT_FAILURE;
     }
 
     auto graph = poplar::Graph(device->getTarget());
@@ -222,6 +198,11 @@ int main() {
     auto memories = graph.addVariable(poplar::CHAR, {NUM_PROCESSORS, MaxMem}, "memories");
     mapNPerTile(memories, 1);
 
+    auto memoryBudget = ipu::MemoryBudget(graph);
+    memoryBudget.addTensor("particlesToShed", particleToShed)
+            .addTensor("hasParticlesToShed", hasParticlesToShed)
+            .addTensor("memories", memories);
+
     Sequence findAlienParticle;
     {
         auto cs = graph.addComputeSet("findFirstParticleToShed");
@@ -324,6 +305,8 @@ int main() {
                                              {"isOfferingParticle",    isOfferingSlices},
                                      });
             graph.setInitialValue(v["numNeighbours"], neighbours.size());
+            memoryBudget.addRemoteReads(tileNum, particleToShedSlices)
+                    .addRemoteReads(tileNum, isOfferingSlices);
             graph.setPerfEstimate(v, 100);
             graph.setTileMapping(v, tileNum);
         }
@@ -381,14 +364,18 @@ int main() {
     auto copyBackToHost = Copy(memories, memoryOut);
 
 
+    // Find and exchange particles is the data-dependent communication; updating positions is the compute
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
     Sequence timestepProgram = Sequence{
-            findAlienParticle,
-            loopUntilAllParticlesExchanged,
-            updateParticlePositions
+            cycles.wrap("exchangeParticles", Sequence{findAlienParticle, loopUntilAllParticlesExchanged}),
+            cycles.wrap("updatePositions", updateParticlePositions)
     };
 
     Program copyInitialData = Copy(memoryIn, memories);
 
+    // Fail now rather than after compiling if MaxMem doesn't fit: each tile has 5 vertices
+    memoryBudget.addVerticesOnEveryTile(5).enforce();
+
     char *dataBuf = new char[MaxMem * NUM_PROCESSORS];
 
     std::cout << "Compiling..." <<
@@ -405,8 +392,12 @@ int main() {
     };
 
 
+    // Pick the engine profile with --engine-profile=<name> or IPU_ENGINE_PROFILE, and which iterations are
+    // profiled with --profile-iterations=<spec> or IPU_PROFILE_ITERATIONS (by default only iteration 2)
+    const auto engineBuilder = ipu::EngineBuilder::fromCommandLine(argc, argv);
+    const auto profileSampler = engineBuilder.profileSampler("2");
     auto engine = Engine(graph, {copyInitialData, timestepProgram, copyBackToHost},
-                         POPLAR_ENGINE_OPTIONS_RELEASE, progressFunc);
+                         engineBuilder.options(), progressFunc);
     auto toc = std::chrono::high_resolution_clock::now();
     auto diff = std::chrono::duration_cast<std::chrono::duration<double >>(toc - tic).count();
     std::cout << " took " << std::right << std::setw(12) << std::setprecision(5) << diff << "s" <<
@@ -414,9 +405,10 @@ int main() {
 
     engine.load(*device);
     engine.disableExecutionProfiling();
+    cycles.connect(engine);
 
 
-    initialiseTileData(dataBuf, NUM_PROCESSORS, MaxMem);
+    initialiseTileData(dataBuf, NUM_PROCESSORS, MaxMem, initialParticles);
     engine.connectStream("<<data", dataBuf);
     engine.connectStream(">>data", dataBuf);
 
@@ -430,36 +422,35 @@ int main() {
     deserialiseToFile(dataBuf, 0, NUM_PROCESSORS, MaxMem);
 
 
+    // The first iteration is a warmup, the rest are summarised at the end
+    auto bench = ipu::Benchmark("particleShedding", 1, MaxIters - 1)
+            .throughput("particles", 1.0 * initialParticles * NUM_PROCESSORS);
     for (auto iter = 1; iter <= MaxIters; iter++) {
         std::cout << "Running iteration " << iter << ":" << std::endl;
-        tic = std::chrono::high_resolution_clock::now();
-        if (iter == 2) {
-            engine.enableExecutionProfiling();
+        profileSampler.beginIteration(engine, iter);
+        diff = bench.measure([&]() { engine.run(1); });
+        profileSampler.endIteration(engine, iter);
 
-        }
-        engine.run(1);
-        if (iter == 2) {
-            engine.disableExecutionProfiling();
-        }
-
-        toc = std::chrono::high_resolution_clock::now();
-
-
-        diff = std::chrono::duration_cast<std::chrono::duration<double >>(toc - tic).count();
         std::cout << " took " << std::right << std::setw(12) << std::setprecision(5) << diff << "s" <<
                   std::endl;
         engine.run(2); // Copy back
+        if (iter == 1) cycles.reset(); // Don't count the warmup
 
 //        deserialiseToFile(dataBuf, iter, NUM_PROCESSORS, MaxMem);
     }
 
-    engine.printProfileSummary(std::cout,
-                               OptionFlags{
-//                                       {"showVarStorage", "true"},
-//                                       {"showOptimizations", "true"},
-//                                       { "showExecutionSteps", "false" }
-                               }
-    );
+    bench.report();
+    cycles.report();
+
+    if (engineBuilder.isProfiling()) {
+        engine.printProfileSummary(std::cout,
+                                   OptionFlags{
+//                                           {"showVarStorage", "true"},
+//                                           {"showOptimizations", "true"},
+//                                           { "showExecutionSteps", "false" }
+                                   }
+        );
+    }
 
 
 //    for (auto i = 0; i < NUM_PROCESSORS; i++) {
@@ -4,6 +4,9 @@
 #include <iomanip>
 #include <fstream>
 #include <map>
+#include <cstring>
+#include <numeric>
+#include <sstream>
 
 #include <poplar/Engine.hpp>
 #include <poplar/IPUModel.hpp>
@@ -12,7 +15,9 @@
 #include <poplar/Program.hpp>
 #include <popops/ElementWise.hpp>
 #include <popops/codelets.hpp>
+#include <poputil/VertexTemplates.hpp>
 
+#include "CommonIpuUtils.hpp"
 
 using ::std::map;
 using ::std::vector;
@@ -20,6 +25,10 @@ using ::std::string;
 using ::std::optional;
 
 using ::poplar::FLOAT;
+using ::poplar::HALF;
+using ::poplar::Type;
+using ::poplar::Interval;
+using ::poplar::ComputeSet;
 using ::poplar::OptionFlags;
 using ::poplar::Tensor;
 using ::poplar::Graph;
@@ -36,6 +45,67 @@ using ::poplar::program::Execute;
 
 const auto NUM_DATA_ITEMS = 200000;
 
+enum class VertexVariant {
+    Auto, Scalar, Aligned, Simd
+};
+
+const auto ALL_VERTEX_VARIANTS = vector<VertexVariant>{VertexVariant::Scalar, VertexVariant::Aligned,
+                                                      VertexVariant::Simd};
+
+auto vertexName(const VertexVariant variant) -> string {
+    switch (variant) {
+        case VertexVariant::Scalar:
+            return "SkeletonVertex";
+        case VertexVariant::Aligned:
+            return "SkeletonVertexAligned";
+        case VertexVariant::Simd:
+            return "SkeletonVertexSimd";
+        default:
+            throw std::invalid_argument("Auto isn't a vertex");
+    }
+}
+
+auto vertexVariantFromString(const string &name) -> VertexVariant {
+    if (name == "auto") return VertexVariant::Auto;
+    if (name == "scalar") return VertexVariant::Scalar;
+    if (name == "aligned") return VertexVariant::Aligned;
+    if (name == "simd") return VertexVariant::Simd;
+    throw std::invalid_argument("Unknown vertex variant '" + name + "' (expected auto, scalar, aligned or simd)");
+}
+
+struct SkeletonOptions {
+    Type dataType = FLOAT;
+    VertexVariant variant = VertexVariant::Auto;
+    bool benchmarkVertices = false;
+    unsigned streamBatches = 0; // 0 turns the streaming mode off
+    vector<unsigned> itemSweep; // Problem sizes to run on the one executable, at most NUM_DATA_ITEMS
+
+    // --type=float|half, --vertex=auto|scalar|aligned|simd, --benchmark-vertices, --stream-batches=N and
+    // --items=N,N,... Other arguments are left alone
+    static auto fromCommandLine(const int argc, char *argv[]) -> SkeletonOptions {
+        auto options = SkeletonOptions{};
+        for (auto i = 1; i < argc; i++) {
+            const auto arg = string{argv[i]};
+            if (arg == "--type=float") {
+                options.dataType = FLOAT;
+            } else if (arg == "--type=half") {
+                options.dataType = HALF;
+            } else if (arg.rfind("--vertex=", 0) == 0) {
+                options.variant = vertexVariantFromString(arg.substr(std::string("--vertex=").size()));
+            } else if (arg == "--benchmark-vertices") {
+                options.benchmarkVertices = true;
+            } else if (arg.rfind("--stream-batches=", 0) == 0) {
+                options.streamBatches = std::stoul(arg.substr(std::string("--stream-batches=").size()));
+            } else if (arg.rfind("--items=", 0) == 0) {
+                auto items = std::istringstream(arg.substr(std::string("--items=").size()));
+                for (string item; std::getline(items, item, ',');) {
+                    options.itemSweep.push_back(std::stoul(item));
+                }
+            }
+        }
+        return options;
+    }
+};
 
 auto getIpuDevice(const unsigned int numIpus = 1) -> optional<Device> {
     DeviceManager manager = DeviceManager::createDeviceManager();
@@ -53,8 +123,9 @@ auto getIpuDevice(const unsigned int numIpus = 1) -> optional<Device> {
     return device;
 }
 
-auto createGraphAndAddCodelets(const optional<Device> &device) -> Graph {
-    auto graph = poplar::Graph(device->getTarget());
+auto createGraphAndAddCodelets(const optional<Device> &device, const ipu::Replication &replication) -> Graph {
+    // With --replicas=N, the graph is built for one replica and Poplar runs N copies on independent data
+    auto graph = replication.createGraph(*device);
 
     // Add our custom codelet, building from CPP source
     // with the given popc compiler options
@@ -65,35 +136,78 @@ auto createGraphAndAddCodelets(const optional<Device> &device) -> Graph {
     return graph;
 }
 
-auto buildComputeGraph(Graph &graph, map<string, Tensor> &tensors, map<string, Program> &programs, const int numTiles) {
+// The fastest vertex whose assumptions hold for a slice starting offsetBytes into its tile's part of the tensor
+auto chooseVariant(const size_t offsetBytes, const size_t numElements, const size_t elementBytes) -> VertexVariant {
+    if (offsetBytes % 8 != 0) return VertexVariant::Scalar; // ONE_PTR, 8 would make Poplar copy to realign it
+    const auto simdWidth = 8 / elementBytes;
+    return numElements >= simdWidth ? VertexVariant::Simd : VertexVariant::Aligned;
+}
+
+// Adds one vertex per piece of data each worker processes, picking the variant per piece when variant is Auto.
+// The vertices only touch the first "items" elements, which the host can change without recompiling
+auto addSkeletonVertices(Graph &graph, ComputeSet &cs, const Tensor &data, const ipu::WorkerIntervals &split,
+                         const VertexVariant variant, const ipu::RuntimeSizes &sizes) {
+    const auto elementBytes = graph.getTarget().getTypeSize(data.elementType());
+    for (auto tileNum = 0u; tileNum < split.size(); tileNum++) {
+        auto offsetInTile = size_t{0};
+        for (const auto &pieces: split[tileNum]) {
+            for (const auto &interval: pieces) {
+                const auto chosen = variant == VertexVariant::Auto
+                                    ? chooseVariant(offsetInTile * elementBytes, interval.size(), elementBytes)
+                                    : variant;
+                auto v = graph.addVertex(cs, poputil::templateVertex(vertexName(chosen), data.elementType()), {
+                        {"data",        data.slice(interval)},
+                        {"activeItems", sizes.on("items", tileNum)}
+                });
+                if (chosen != VertexVariant::Scalar) {
+                    graph.setInitialValue(v["size"], static_cast<unsigned>(interval.size()));
+                }
+                graph.setInitialValue(v["firstItem"], static_cast<unsigned>(interval.begin()));
+                graph.setInitialValue(v["howMuchToAdd"], static_cast<float>(tileNum));
+                graph.setPerfEstimate(v, 100); // Ideally you'd get this as right as possible
+                graph.setTileMapping(v, tileNum);
+                offsetInTile += interval.size();
+            }
+        }
+    }
+}
+
+auto buildComputeGraph(Graph &graph, map<string, Tensor> &tensors, map<string, Program> &programs, const int numTiles,
+                       const SkeletonOptions &options, const ipu::RuntimeSizes &sizes, ipu::CycleCounter &cycles) {
     // Add tensors
-    tensors["data"] = graph.addVariable(poplar::FLOAT, {NUM_DATA_ITEMS}, "data");
-    poputil::mapTensorLinearly(graph, tensors["data"]);
+    tensors["data"] = graph.addVariable(options.dataType, {NUM_DATA_ITEMS}, "data");
+    // Each tile gets an 8-byte aligned slice, and we wire the vertices to exactly the slice their tile holds
+    const auto dataMapping = ipu::LinearTileMapping{}.tiles(0, numTiles).apply(graph, tensors["data"]);
+    // ...and split each tile's slice between all its workers, keeping the split points 8-byte aligned
+    const auto simdWidth = 8 / graph.getTarget().getTypeSize(options.dataType);
+    const auto workSplit = ipu::splitAcrossWorkers(dataMapping, graph.getTarget().getNumWorkerContexts(), simdWidth);
+    ipu::reportWorkBalance(workSplit);
 
 
     // Add programs and wire up data
-    const auto NumElemsPerTile = NUM_DATA_ITEMS / numTiles;
     auto cs = graph.addComputeSet("loopBody");
-    for (auto tileNum = 0; tileNum < numTiles; tileNum++) {
-        const auto sliceEnd = std::min((tileNum + 1) * NumElemsPerTile, (int)   NUM_DATA_ITEMS);
-        const auto sliceStart = tileNum * NumElemsPerTile;
-
-        auto v = graph.addVertex(cs, "SkeletonVertex", {
-                {"data", tensors["data"].slice(sliceStart, sliceEnd)}
-        });
-        graph.setInitialValue(v["howMuchToAdd"], tileNum);
-        graph.setPerfEstimate(v, 100); // Ideally you'd get this as right as possible
-        graph.setTileMapping(v, tileNum);
-    }
+    addSkeletonVertices(graph, cs, tensors["data"], workSplit, options.variant, sizes);
     auto executeIncrementVertex = Execute(cs);
 
     auto mainProgram = Repeat(10, executeIncrementVertex, "repeat10x");
     programs["main"] = mainProgram; // Program 0 will be the main program
+
+    if (options.benchmarkVertices) {
+        // The same work with every variant forced, so their on-device cycle counts can be compared
+        auto variants = Sequence{};
+        for (const auto variant: ALL_VERTEX_VARIANTS) {
+            auto variantCs = graph.addComputeSet("benchmark/" + vertexName(variant));
+            addSkeletonVertices(graph, variantCs, tensors["data"], workSplit, variant, sizes);
+            variants.add(cycles.wrap(vertexName(variant), Execute(variantCs)));
+        }
+        programs["benchmark_vertices"] = Repeat(10, variants, "benchmarkVertices");
+    }
 }
 
 auto defineDataStreams(Graph &graph, map<string, Tensor> &tensors, map<string, Program> &programs) {
-    auto toIpuStream = graph.addHostToDeviceFIFO("TO_IPU", FLOAT, NUM_DATA_ITEMS);
-    auto fromIpuStream = graph.addDeviceToHostFIFO("FROM_IPU", FLOAT, NUM_DATA_ITEMS);
+    const auto type = tensors["data"].elementType();
+    auto toIpuStream = graph.addHostToDeviceFIFO("TO_IPU", type, NUM_DATA_ITEMS);
+    auto fromIpuStream = graph.addDeviceToHostFIFO("FROM_IPU", type, NUM_DATA_ITEMS);
 
     auto copyToIpuProgram = Copy(toIpuStream, tensors["data"]);
     auto copyToHostProgram = Copy(tensors["data"], fromIpuStream);
@@ -102,6 +216,96 @@ auto defineDataStreams(Graph &graph, map<string, Tensor> &tensors, map<string, P
     programs["copy_to_host"] = copyToHostProgram;
 }
 
+// One engine.run for a whole sequence of batches: Poplar prefetches batch k+1 from the host data source while the
+// tiles compute batch k, and the host data sink's consumer thread handles batch k-1 meanwhile
+auto defineStreamingProgram(Graph &graph, map<string, Tensor> &tensors, map<string, Program> &programs,
+                            const unsigned numBatches) {
+    const auto type = tensors["data"].elementType();
+    auto inStream = graph.addHostToDeviceFIFO("STREAM_TO_IPU", type, NUM_DATA_ITEMS);
+    auto outStream = graph.addDeviceToHostFIFO("STREAM_FROM_IPU", type, NUM_DATA_ITEMS);
+
+    programs["stream"] = Repeat(numBatches, Sequence{
+            Copy(inStream, tensors["data"]),
+            programs["main"],
+            Copy(tensors["data"], outStream)
+    }, "streamBatches");
+}
+
+// Compares batches/s of the three blocking engine.runs per batch against the overlapped streaming program
+auto benchmarkStreaming(Engine &engine, map<string, int> &programIds, const poplar::Target &target,
+                        const SkeletonOptions &options, const ipu::Replication &replication, void *streamData) {
+    const auto numBatches = options.streamBatches;
+    const auto batchBytes = NUM_DATA_ITEMS * target.getTypeSize(options.dataType);
+    const auto replicas = replication.replicas();
+
+    // Fills a batch with its batch number, in the device's format
+    const auto fillBatch = [&target, &options, batchBytes](void *buffer, const uint64_t batch) {
+        auto values = vector<float>(NUM_DATA_ITEMS, static_cast<float>(batch));
+        if (options.dataType == HALF) {
+            poplar::copyFloatToDeviceHalf(target, values.data(), buffer, NUM_DATA_ITEMS);
+        } else {
+            std::memcpy(buffer, values.data(), batchBytes);
+        }
+    };
+
+    // Every replica processes its own batches, so N replicas get through N times as many
+    auto baseline = ipu::Benchmark::fromEnvironment("skeletonBlockingBatches", 1, 5)
+            .throughput("batches", numBatches * replicas)
+            .tag("replicas", std::to_string(replicas));
+    baseline.run([&]() {
+        for (auto batch = 0u; batch < numBatches; batch++) {
+            for (auto replica = 0u; replica < replicas; replica++) {
+                fillBatch(static_cast<char *>(streamData) + replica * batchBytes, batch * replicas + replica);
+            }
+            engine.run(programIds["copy_to_ipu"]);
+            engine.run(programIds["main"]);
+            engine.run(programIds["copy_to_host"]);
+        }
+    });
+
+    // The callbacks serve all the replicas, which take batches from the same source in whatever order they ask
+    auto streaming = ipu::Benchmark::fromEnvironment("skeletonStreamingBatches", 1, 5)
+            .throughput("batches", numBatches * replicas)
+            .tag("replicas", std::to_string(replicas));
+    const auto totalBatches = uint64_t{numBatches} * replicas * (streaming.warmups() + streaming.runs());
+    auto source = ipu::HostDataSource(batchBytes, [&](char *buffer, const size_t, const uint64_t batch) -> bool {
+        if (batch >= totalBatches) return false;
+        fillBatch(buffer, batch);
+        return true;
+    }, 3);
+    auto sink = ipu::HostDataSink(batchBytes, [](const char *buffer, const size_t bytes, const uint64_t batch) {
+        // A real program would write the results out here
+    }, 3);
+    source.connect(engine, "STREAM_TO_IPU", replicas);
+    sink.connect(engine, "STREAM_FROM_IPU");
+    streaming.run([&]() { engine.run(programIds["stream"]); });
+    sink.drain();
+
+    const auto blockingStats = baseline.report();
+    const auto streamingStats = streaming.report();
+    source.report();
+    sink.report();
+    std::cout << "Streaming is " << std::setprecision(3) << blockingStats.median / streamingStats.median
+              << "x the batches/s of blocking runs" << std::endl;
+}
+
+// Times the main program on smaller and smaller problems without recompiling: only the "items" size changes
+auto sweepItems(Engine &engine, map<string, int> &programIds, ipu::RuntimeSizes &sizes,
+                const SkeletonOptions &options, const ipu::Replication &replication) {
+    for (const auto items: options.itemSweep) {
+        sizes.set("items", items);
+        engine.run(programIds["set_sizes"]);
+        auto benchmark = ipu::Benchmark::fromEnvironment("skeletonItems", 1, 5)
+                .throughput("items", double(items) * replication.replicas())
+                .tag("items", std::to_string(items))
+                .tag("replicas", std::to_string(replication.replicas()));
+        benchmark.run([&]() { engine.run(programIds["main"]); });
+        benchmark.report();
+    }
+    sizes.set("items", sizes.max("items"));
+    engine.run(programIds["set_sizes"]);
+}
+
 auto serializeGraph(const Graph &graph) {
     std::ofstream graphSerOfs;
     graphSerOfs.open("serialized_graph.capnp", std::ofstream::out | std::ofstream::trunc);
@@ -111,38 +315,43 @@ auto serializeGraph(const Graph &graph) {
 }
 
 int main(int argc, char *argv[]) {
+    const auto options = SkeletonOptions::fromCommandLine(argc, argv);
+    const auto replication = ipu::Replication::fromCommandLine(argc, argv);
+
     std::cout << "STEP 1: Connecting to an IPU device" << std::endl;
-    auto device = getIpuDevice(1);
+    auto device = getIpuDevice(replication.replicas()); // One IPU per replica
     if (!device.has_value()) {
         std::cerr << "Could not attach to an IPU device. Aborting" << std::endl;
         return EXIT_FAILURE;
     }
 
     std::cout << "STEP 2: Create graph and compile codelets" << std::endl;
-    auto graph = createGraphAndAddCodelets(device);
+    auto graph = createGraphAndAddCodelets(device, replication);
 
 
     std::cout << "STEP 3: Building the compute graph" << std::endl;
     auto tensors = map<string, Tensor>{};
     auto programs = map<string, Program>{};
-    buildComputeGraph(graph, tensors, programs, device->getTarget().getNumTiles());
+    auto cycles = ipu::CycleCounter(graph, 0, options.benchmarkVertices);
+    // The number of items to process is read on the device, so the sweep below reuses this one graph
+    auto sizes = ipu::RuntimeSizes(graph, {{"items", NUM_DATA_ITEMS}});
+    programs["set_sizes"] = sizes.program();
+    buildComputeGraph(graph, tensors, programs, graph.getTarget().getNumTiles(), options, sizes, cycles);
 
     std::cout << "STEP 4: Define data streams" << std::endl;
     defineDataStreams(graph, tensors, programs);
+    if (options.streamBatches > 0) {
+        defineStreamingProgram(graph, tensors, programs, options.streamBatches);
+    }
 
     std::cout << "STEP 5: Create engine and compile graph" << std::endl;
-    auto ENGINE_OPTIONS = OptionFlags{
-            {"target.saveArchive",                "archive.a"},
-            {"debug.instrument",                  "true"},
-            {"debug.instrumentCompute",           "true"},
-            {"debug.loweredVarDumpFile",          "vars.capnp"},
-            {"debug.instrumentControlFlow",       "true"},
-            {"debug.computeInstrumentationLevel", "tile"},
-            {"debug.outputAllSymbols",            "true"},
-            {"autoReport.all",                    "true"},
-            {"autoReport.outputSerializedGraph",  "true"},
-            {"debug.retainDebugInformation",      "true"},
-    };
+    // Choose release, light-profile or full-debug engine options with --engine-profile=<name>
+    // or the IPU_ENGINE_PROFILE environment variable
+    auto engineBuilder = ipu::EngineBuilder::fromCommandLine(argc, argv);
+    if (options.streamBatches > 0) {
+        engineBuilder.option("exchange.enablePrefetch", "true");
+    }
+    const auto ENGINE_OPTIONS = engineBuilder.options();
 
     auto programIds = map<string, int>();
     auto programsList = vector<Program>(programs.size());
@@ -156,23 +365,61 @@ int main(int argc, char *argv[]) {
 
     std::cout << "STEP 6: Load compiled graph onto the IPU tiles" << std::endl;
     engine.load(*device);
-    engine.enableExecutionProfiling();
+    if (engineBuilder.isProfiling()) {
+        engine.enableExecutionProfiling();
+    }
+    cycles.connect(engine);
+    sizes.connect(engine);
+    engine.run(programIds["set_sizes"]); // Every item to start with
 
 
     std::cout << "STEP 7: Attach data streams" << std::endl;
-    auto hostData = vector<float>(NUM_DATA_ITEMS, 0.0f);
-    engine.connectStream("TO_IPU", hostData.data());
-    engine.connectStream("FROM_IPU", hostData.data());
+    // One slice of NUM_DATA_ITEMS per replica, each starting from its replica number so their results differ
+    const auto numHostItems = NUM_DATA_ITEMS * replication.replicas();
+    auto hostData = vector<float>(numHostItems, 0.0f);
+    for (auto i = 0u; i < numHostItems; i++) {
+        hostData[i] = static_cast<float>(i / NUM_DATA_ITEMS);
+    }
+    // Half data crosses the stream in the device's 16-bit format, so we convert on the host either side
+    auto hostHalfData = vector<uint16_t>(options.dataType == HALF ? numHostItems : 0);
+    void *streamData = options.dataType == HALF ? (void *) hostHalfData.data() : (void *) hostData.data();
+    const auto bytesPerReplica = NUM_DATA_ITEMS * graph.getTarget().getTypeSize(options.dataType);
+    replication.connectStream(engine, "TO_IPU", streamData, bytesPerReplica);
+    replication.connectStream(engine, "FROM_IPU", streamData, bytesPerReplica);
 
     std::cout << "STEP 8: Run programs" << std::endl;
+    if (options.dataType == HALF) {
+        poplar::copyFloatToDeviceHalf(device->getTarget(), hostData.data(), hostHalfData.data(), numHostItems);
+    }
     engine.run(programIds["copy_to_ipu"]); // Copy to IPU
     engine.run(programIds["main"]); // Main program
     engine.run(programIds["copy_to_host"]); // Copy from IPU
+    if (options.dataType == HALF) {
+        poplar::copyDeviceHalfToFloat(device->getTarget(), hostHalfData.data(), hostData.data(), numHostItems);
+    }
+    if (replication.isReplicated()) {
+        replication.reportPerReplica<float>("Sum of each replica's results", hostData.data(), NUM_DATA_ITEMS,
+                                            [](const float *data, const size_t n) {
+                                                return std::accumulate(data, data + n, 0.0);
+                                            });
+    }
+    if (options.benchmarkVertices) {
+        engine.run(programIds["benchmark_vertices"]);
+        cycles.report();
+    }
+    if (!options.itemSweep.empty()) {
+        sweepItems(engine, programIds, sizes, options, replication);
+    }
+    if (options.streamBatches > 0) {
+        benchmarkStreaming(engine, programIds, device->getTarget(), options, replication, streamData);
+    }
 
     std::cout << "STEP 9: Capture debug and profile info" << std::endl;
     serializeGraph(graph);
-    engine.printProfileSummary(std::cout,
-                               OptionFlags{{"showExecutionSteps", "false"}});
+    if (engineBuilder.isProfiling()) {
+        engine.printProfileSummary(std::cout,
+                                   OptionFlags{{"showExecutionSteps", "false"}});
+    }
 
     return EXIT_SUCCESS;
 }
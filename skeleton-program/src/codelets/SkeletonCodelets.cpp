@@ -10,15 +10,106 @@
 
 using namespace poplar;
 
+template<typename T>
+T min(const T a, const T b) {
+    return a < b ? a : b;
+}
+
+// Each vertex only updates its elements below activeItems, so a graph compiled for the maximum number of items
+// can run smaller problems. firstItem is the index of the vertex's first element in the whole data tensor
+
+// The SIMD type the IPU's 64-bit loads and arithmetic work on for each element type
+template<typename T>
+struct Simd;
+
+template<>
+struct Simd<float> {
+    using type = float2;
+    static constexpr unsigned width = 2;
+};
+
+template<>
+struct Simd<half> {
+    using type = half4;
+    static constexpr unsigned width = 4;
+};
+
+// The general case: any alignment and size, but 32-bit loads and no guaranteed vectorisation
+template<typename T>
 class SkeletonVertex : public Vertex {
 public:
-    InOut <Vector<float>> data;
-    int howMuchToAdd;
+    InOut <Vector<T>> data;
+    T howMuchToAdd;
+    Input<unsigned> activeItems;
+    unsigned firstItem;
+
+    auto compute() -> bool {
+        if (*activeItems <= firstItem) return true;
+        const auto active = min<unsigned>(data.size(), *activeItems - firstItem);
+        for (auto i = 0u; i < active; i++) {
+            data[i] += howMuchToAdd;
+        }
+        return true;
+    }
+};
+
+template class SkeletonVertex<float>;
+template class SkeletonVertex<half>;
+
+// An 8-byte aligned vector with the size wired in, which leaves popc free to vectorise the loop
+template<typename T>
+class SkeletonVertexAligned : public Vertex {
+public:
+    InOut <Vector<T, VectorLayout::ONE_PTR, 8>> data;
+    unsigned size;
+    T howMuchToAdd;
+    Input<unsigned> activeItems;
+    unsigned firstItem;
 
     auto compute() -> bool {
-        for (auto i = 0; i < data.size(); i++) {
+        if (*activeItems <= firstItem) return true;
+        const auto active = min(size, *activeItems - firstItem);
+        for (auto i = 0u; i < active; i++) {
             data[i] += howMuchToAdd;
         }
         return true;
     }
-};
\ No newline at end of file
+};
+
+template class SkeletonVertexAligned<float>;
+template class SkeletonVertexAligned<half>;
+
+// Explicit float2/half4 SIMD with 64-bit loads and stores, then a scalar loop for the last few elements
+template<typename T>
+class SkeletonVertexSimd : public Vertex {
+public:
+    InOut <Vector<T, VectorLayout::ONE_PTR, 8>> data;
+    unsigned size;
+    T howMuchToAdd;
+    Input<unsigned> activeItems;
+    unsigned firstItem;
+
+    auto compute() -> bool {
+        if (*activeItems <= firstItem) return true;
+        const auto active = min(size, *activeItems - firstItem);
+        using V = typename Simd<T>::type;
+        constexpr auto width = Simd<T>::width;
+
+        V toAdd;
+        for (auto j = 0u; j < width; j++) {
+            toAdd[j] = howMuchToAdd;
+        }
+        auto vectors = reinterpret_cast<V *>(&data[0]);
+        const auto numVectors = active / width;
+        for (auto i = 0u; i < numVectors; i++) {
+            vectors[i] += toAdd;
+        }
+        for (auto i = numVectors * width; i < active; i++) {
+            data[i] += howMuchToAdd;
+        }
+        return true;
+    }
+};
+
+template class SkeletonVertexSimd<float>;
+template class SkeletonVertexSimd<half>;
@@ -0,0 +1,326 @@
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <poplar/IPUModel.hpp>
+#include <popops/codelets.hpp>
+#include "cxxopts.hpp"
+#include "GraphcoreUtils.hpp"
+#include "CommonIpuUtils.hpp"
+#include "HaloRegionStrategies.hpp"
+
+/**
+ * Measures how the host-side costs of an IPU program grow with its size, so we can see where graph construction
+ * or compilation stops scaling linearly. For every (strategy, tiles, vertices per tile) configuration we build a
+ * fresh graph on an IPUModel with that many tiles, and record
+ *   - graph build time (adding tensors, vertices and programs)
+ *   - codelet compile time (popc, when adding codelets)
+ *   - engine compile time (compileGraph, always uncached)
+ *   - peak host memory (VmHWM, reset before each configuration)
+ *   - the size of the compiled executable and of the serialized graph and control programs
+ *
+ * The halo strategies from HaloRegionApproaches put a fixed number of vertices on each tile, so use the synthetic
+ * "fillVertices" strategy (N Fill vertices per tile in one compute set) to sweep vertices per tile.
+ */
+
+namespace {
+    const auto FillVerticesStrategy = std::string{"fillVertices"};
+
+    /** Counts the bytes written to it without storing them */
+    class CountingBuffer : public std::streambuf {
+        std::size_t t_bytes = 0;
+
+    protected:
+        auto overflow(int_type c) -> int_type override {
+            if (c != traits_type::eof()) t_bytes++;
+            return c;
+        }
+
+        auto xsputn(const char *, std::streamsize n) -> std::streamsize override {
+            t_bytes += n;
+            return n;
+        }
+
+    public:
+        [[nodiscard]] auto bytes() const -> std::size_t { return t_bytes; }
+    };
+
+    template<typename F>
+    auto bytesWrittenBy(F &&write) -> std::size_t {
+        auto buffer = CountingBuffer{};
+        auto os = std::ostream{&buffer};
+        write(os);
+        return buffer.bytes();
+    }
+
+    template<typename F>
+    auto secondsFor(F &&f) -> double {
+        const auto tic = std::chrono::high_resolution_clock::now();
+        f();
+        const auto toc = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::duration<double >>(toc - tic).count();
+    }
+
+    /** Resets the peak resident set size, so VmHWM measures just the next configuration (Linux only) */
+    auto resetPeakRss() -> void {
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        if (clearRefs) clearRefs << "5";
+    }
+
+    /** Peak resident set size in KiB since the last reset, or 0 if we can't tell */
+    auto peakRssKiB() -> std::size_t {
+        std::ifstream status("/proc/self/status");
+        auto line = std::string{};
+        while (std::getline(status, line)) {
+            if (line.rfind("VmHWM:", 0) == 0) {
+                return std::stoul(line.substr(6));
+            }
+        }
+        return 0;
+    }
+
+    auto parseList(const std::string &list) -> std::vector<std::string> {
+        auto result = std::vector<std::string>{};
+        auto ss = std::stringstream{list};
+        auto item = std::string{};
+        while (std::getline(ss, item, ',')) {
+            if (!item.empty()) result.push_back(item);
+        }
+        return result;
+    }
+
+    auto parseUnsignedList(const std::string &list) -> std::vector<unsigned> {
+        auto result = std::vector<unsigned>{};
+        for (const auto &item: parseList(list)) result.push_back((unsigned) std::stoul(item));
+        return result;
+    }
+
+    /** A program with verticesPerTile Fill vertices on every tile, each writing its own small tensor */
+    auto fillVerticesStrategy(Graph &graph, const unsigned numTiles, const unsigned verticesPerTile,
+                              const unsigned elementsPerVertex) -> std::vector<Program> {
+        auto data = graph.addVariable(FLOAT, {numTiles, verticesPerTile, elementsPerVertex}, "data");
+        auto cs = graph.addComputeSet("fill");
+        for (auto tile = 0u; tile < numTiles; tile++) {
+            graph.setTileMapping(data[tile], tile);
+            for (auto v = 0u; v < verticesPerTile; v++) {
+                fill(graph, data[tile][v], (float) v, tile, cs);
+            }
+        }
+        return {Sequence{}, Sequence{Execute(cs)}};
+    }
+
+    struct Measurement {
+        std::string strategy;
+        unsigned tiles;
+        unsigned verticesPerTile;
+        unsigned vertices;
+        double codeletSeconds;
+        double buildSeconds;
+        double compileSeconds;
+        std::size_t peakRssKiB;
+        std::size_t executableBytes;
+        std::size_t programBytes;
+    };
+
+    auto measure(const std::string &strategy, const std::string &ipuVersion, const unsigned tiles,
+                 const unsigned verticesPerTile, const unsigned blockSize,
+                 const unsigned numIters) -> Measurement {
+        resetPeakRss();
+
+        auto ipuModel = IPUModel(ipuVersion.c_str());
+        ipuModel.numIPUs = 1;
+        ipuModel.tilesPerIPU = tiles;
+        ipuModel.compileIPUCode = true;
+        auto device = ipuModel.createDevice();
+        auto graph = Graph(device);
+
+        auto m = Measurement{strategy, tiles, verticesPerTile};
+        m.codeletSeconds = secondsFor([&]() {
+            graph.addCodelets("codelets/HaloRegionApproachesCodelets.cpp");
+            popops::addCodelets(graph);
+        });
+
+        auto programs = std::vector<Program>{};
+        auto cycles = ipu::CycleCounter(graph, 0, false);
+        m.buildSeconds = secondsFor([&]() {
+            if (strategy == FillVerticesStrategy) {
+                programs = fillVerticesStrategy(graph, tiles, verticesPerTile, blockSize);
+            } else {
+                auto extents = haloGridExtents(graph, tiles, blockSize);
+                programs = buildHaloStrategy(strategy, graph, tiles, blockSize, numIters, cycles, extents).value();
+                programs.push_back(extents.program());
+            }
+        });
+        m.vertices = graph.getNumVertices();
+        if (strategy != FillVerticesStrategy) m.verticesPerTile = m.vertices / tiles;
+
+        auto exe = std::optional<Executable>{};
+        m.compileSeconds = secondsFor([&]() { exe = compileGraph(graph, programs); });
+
+        m.peakRssKiB = peakRssKiB();
+        m.executableBytes = bytesWrittenBy([&](std::ostream &os) { exe->serialize(os); });
+        m.programBytes = bytesWrittenBy([&](std::ostream &os) {
+            graph.serialize(os, programs, SerializationFormat::Binary);
+        });
+        return m;
+    }
+
+    /** Local scaling exponent between two sizes: 1 is linear, 2 is quadratic */
+    auto exponent(const double t1, const double t2, const double n1, const double n2) -> double {
+        if (t1 <= 0 || t2 <= 0 || n1 <= 0 || n2 <= n1) return NAN;
+        return std::log(t2 / t1) / std::log(n2 / n1);
+    }
+
+    /**
+     * Prints each cost against vertex count for one strategy, with the local scaling exponent between consecutive
+     * sizes. Exponents well above 1 mark where that cost starts to grow superlinearly
+     */
+    auto printCurves(const std::vector<Measurement> &ms, const double superlinearExponent) -> void {
+        std::cout << std::endl << "[" << ms.front().strategy << "]" << std::endl;
+        std::cout << std::setw(8) << "tiles" << std::setw(10) << "v/tile" << std::setw(10) << "vertices"
+                  << std::setw(12) << "build (s)" << std::setw(8) << "exp"
+                  << std::setw(14) << "compile (s)" << std::setw(8) << "exp"
+                  << std::setw(12) << "popc (s)" << std::setw(12) << "RSS (MiB)"
+                  << std::setw(12) << "exe (KiB)" << std::setw(14) << "progs (KiB)" << std::endl;
+
+        auto superlinear = std::vector<std::string>{};
+        for (auto i = 0u; i < ms.size(); i++) {
+            const auto &m = ms[i];
+            auto buildExp = (double) NAN;
+            auto compileExp = (double) NAN;
+            if (i > 0) {
+                const auto &p = ms[i - 1];
+                buildExp = exponent(p.buildSeconds, m.buildSeconds, p.vertices, m.vertices);
+                compileExp = exponent(p.compileSeconds, m.compileSeconds, p.vertices, m.vertices);
+                for (const auto &[what, e]: {std::make_pair("graph build", buildExp),
+                                             std::make_pair("engine compile", compileExp)}) {
+                    if (e > superlinearExponent) {
+                        std::stringstream ss;
+                        ss << what << " grows as vertices^" << std::setprecision(2) << e << " between "
+                           << p.vertices << " and " << m.vertices << " vertices";
+                        superlinear.push_back(ss.str());
+                    }
+                }
+            }
+            std::cout << std::fixed
+                      << std::setw(8) << m.tiles << std::setw(10) << m.verticesPerTile << std::setw(10) << m.vertices
+                      << std::setw(12) << std::setprecision(3) << m.buildSeconds
+                      << std::setw(8) << std::setprecision(2) << buildExp
+                      << std::setw(14) << std::setprecision(3) << m.compileSeconds
+                      << std::setw(8) << std::setprecision(2) << compileExp
+                      << std::setw(12) << std::setprecision(3) << m.codeletSeconds
+                      << std::setw(12) << std::setprecision(1) << m.peakRssKiB / 1024.0
+                      << std::setw(12) << m.executableBytes / 1024.0
+                      << std::setw(14) << m.programBytes / 1024.0 << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+        for (const auto &s: superlinear) std::cout << "  superlinear: " << s << std::endl;
+    }
+
+    auto writeCsv(const std::string &path, const std::vector<Measurement> &ms) -> void {
+        std::ofstream csv(path, std::ios::trunc);
+        csv << "strategy,sdk,tiles,verticesPerTile,vertices,codeletSeconds,buildSeconds,compileSeconds,"
+               "peakRssKiB,executableBytes,programBytes" << std::endl;
+        for (const auto &m: ms) {
+            csv << std::setprecision(9) << m.strategy << ",\"" << poplar::versionString() << "\"," << m.tiles << ","
+                << m.verticesPerTile << "," << m.vertices << "," << m.codeletSeconds << "," << m.buildSeconds << ","
+                << m.compileSeconds << "," << m.peakRssKiB << "," << m.executableBytes << "," << m.programBytes
+                << std::endl;
+        }
+        std::cout << std::endl << "Results written to " << path << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string tilesList;
+    std::string strategiesList;
+    std::string verticesPerTileList;
+    std::string ipuVersion;
+    std::string output;
+    unsigned blockSize;
+    unsigned numIters;
+    double superlinearExponent;
+
+    cxxopts::Options options(argv[0],
+                             " - Measures how graph build, codelet compile and engine compile times scale with "
+                             "the number of tiles and vertices");
+    options.add_options()
+            ("tiles", "Comma-separated tile counts (each a multiple of 2)",
+             cxxopts::value<std::string>(tilesList)->default_value("16,64,256,1216"))
+            ("strategies", "Comma-separated strategies: fillVertices or any halo strategy of halox_approaches",
+             cxxopts::value<std::string>(strategiesList)->default_value("fillVertices,implicit,explicitOneTensor"))
+            ("vertices-per-tile", "Comma-separated vertices per tile for the fillVertices strategy",
+             cxxopts::value<std::string>(verticesPerTileList)->default_value("1,6,24"))
+            ("b,block-size", "Block size per tile for halo strategies (elements per vertex for fillVertices)",
+             cxxopts::value<unsigned>(blockSize)->default_value("16"))
+            ("n,num-iters", "Iterations in the halo strategies' main loop",
+             cxxopts::value<unsigned>(numIters)->default_value("1"))
+            ("ipu-version", "IPUModel to compile for {ipu1,ipu2}",
+             cxxopts::value<std::string>(ipuVersion)->default_value("ipu1"))
+            ("superlinear", "Flag scaling exponents above this",
+             cxxopts::value<double>(superlinearExponent)->default_value("1.1"))
+            ("o,output", "CSV file for the results",
+             cxxopts::value<std::string>(output)->default_value("compile_scaling.csv"));
+
+    auto tiles = std::vector<unsigned>{};
+    auto strategies = std::vector<std::string>{};
+    auto verticesPerTile = std::vector<unsigned>{};
+    try {
+        options.parse(argc, argv);
+        tiles = parseUnsignedList(tilesList);
+        strategies = parseList(strategiesList);
+        verticesPerTile = parseUnsignedList(verticesPerTileList);
+    } catch (cxxopts::OptionParseException &) {
+        std::cerr << options.help() << std::endl;
+        return EXIT_FAILURE;
+    } catch (std::logic_error &e) {
+        std::cerr << "Could not parse a list: " << e.what() << std::endl << options.help() << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (const auto &strategy: strategies) {
+        if (strategy != FillVerticesStrategy &&
+            std::find(HaloStrategies.begin(), HaloStrategies.end(), strategy) == HaloStrategies.end()) {
+            std::cerr << "Unknown strategy " << strategy << std::endl << options.help() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    for (const auto numTiles: tiles) {
+        if (numTiles == 0 || numTiles % NumTilesInIpuCol != 0) {
+            std::cerr << "Tile counts must be multiples of " << NumTilesInIpuCol << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::sort(tiles.begin(), tiles.end());
+    std::sort(verticesPerTile.begin(), verticesPerTile.end());
+
+    auto all = std::vector<Measurement>{};
+    for (const auto &strategy: strategies) {
+        auto curve = std::vector<Measurement>{};
+        const auto vptSweep = strategy == FillVerticesStrategy ? verticesPerTile : std::vector<unsigned>{0};
+        for (const auto vpt: vptSweep) {
+            for (const auto numTiles: tiles) {
+                std::cout << "Measuring " << strategy << " on " << numTiles << " tiles";
+                if (strategy == FillVerticesStrategy) std::cout << " with " << vpt << " vertices per tile";
+                std::cout << "..." << std::endl;
+                curve.push_back(measure(strategy, ipuVersion, numTiles, vpt, blockSize, numIters));
+            }
+        }
+        // Order by graph size, so the exponents compare neighbouring sizes
+        std::stable_sort(curve.begin(), curve.end(), [](const Measurement &a, const Measurement &b) {
+            return a.vertices < b.vertices;
+        });
+        printCurves(curve, superlinearExponent);
+        all.insert(all.end(), curve.begin(), curve.end());
+    }
+
+    writeCsv(output, all);
+    return EXIT_SUCCESS;
+}
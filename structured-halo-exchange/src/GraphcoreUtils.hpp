@@ -15,6 +15,7 @@
 #include <iostream>
 #include <fstream>
 #include "StructuredGridUtils.hpp"
+#include "DeviceFactory.hpp"
 
 using namespace poplar;
 using namespace poplar::program;
@@ -34,11 +35,9 @@ namespace utils {
 
     const auto POPLAR_ENGINE_OPTIONS_NODEBUG = OptionFlags{};
 
+    /** An emulated Mk1 (1216 tiles per IPU), which is what the partitioning strategies here assume by default */
     auto getIpuModel(const unsigned short numIpus = 1) -> std::optional <Device> {
-        IPUModel ipuModel;
-        ipuModel.numIPUs = numIpus;
-        ipuModel.tilesPerIPU = 1216;
-        return {ipuModel.createDevice()};
+        return {ipu::getIpuModel("mk1", numIpus)};
     }
 
     auto serializeGraph(const Graph &graph) {
@@ -50,20 +49,7 @@ namespace utils {
     }
 
     auto getIpuDevice(unsigned int numIpus = 1) -> std::optional <Device> {
-        DeviceManager manager = DeviceManager::createDeviceManager();
-
-        // Attempt to connect to a single IPU
-        for (auto &d : manager.getDevices(poplar::TargetType::IPU, numIpus)) {
-            std::cerr << "Trying to attach to IPU " << d.getId();
-            if (d.attach()) {
-                std::cerr << " - attached" << std::endl;
-                return {std::move(d)};
-            } else {
-                std::cerr << std::endl;
-            }
-        }
-        std::cerr << "Error attaching to device" << std::endl;
-        return std::nullopt;
+        return ipu::getIpuDevice(numIpus);
     }
 
     auto createDebugEngine(Graph &graph, ArrayRef <Program> programs) -> Engine {
@@ -100,6 +86,19 @@ namespace utils {
                                1);
     };
 
+    auto applySlice(const Tensor &tensor, const grids::Slice3D &slice) -> Tensor {
+        return tensor.slice({slice.planes().from(), slice.rows().from(), slice.cols().from()},
+                            {slice.planes().to(), slice.rows().to(), slice.cols().to()});
+    }
+
+    /** Maps each brick of a {planes, rows, cols} tensor to the tile its target names */
+    auto mapBricksToTiles(Graph &graph, const Tensor &cells, const grids::GridPartitioning3D &tileMappings) {
+        const auto numTilesPerIpu = graph.getTarget().getTilesPerIPU();
+        for (const auto &[target, brick]: tileMappings) {
+            graph.setTileMapping(applySlice(cells, brick), target.virtualTile(numTilesPerIpu));
+        }
+    }
+
     auto stitchHalos(const Tensor &nw, const Tensor &n, const Tensor &ne,
                      const Tensor &w, const Tensor &m, const Tensor &e,
                      const Tensor &sw, const Tensor &s, const Tensor &se) -> Tensor {
@@ -110,18 +109,6 @@ namespace utils {
                       }, 1);
     }
 
-
-    const auto timedStep = [](const std::string description, auto f) -> double {
-        std::cerr << std::setw(60) << description;
-        auto tic = std::chrono::high_resolution_clock::now();
-        f();
-        auto toc = std::chrono::high_resolution_clock::now();
-        auto diff = std::chrono::duration_cast < std::chrono::duration < double >> (toc - tic).count();
-        std::cerr << " took " << std::right << std::setw(12) << std::setprecision(5) << diff << "s" << std::endl;
-        return diff;
-    };
-
-
 }
 
 #endif //LBM_GRAPHCORE_GRAPHCOREUTILS_H
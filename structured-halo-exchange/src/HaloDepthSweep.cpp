@@ -0,0 +1,157 @@
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <popops/codelets.hpp>
+#include "cxxopts.hpp"
+#include "StructuredGridUtils.hpp"
+#include "GraphcoreUtils.hpp"
+#include "CommonIpuUtils.hpp"
+#include "HaloRegionStrategies.hpp"
+
+namespace {
+    auto parseList(const std::string &list) -> std::vector<unsigned> {
+        auto result = std::vector<unsigned>{};
+        std::stringstream ss(list);
+        for (std::string item; std::getline(ss, item, ',');) result.push_back(std::stoul(item));
+        return result;
+    }
+
+    struct Measurement {
+        unsigned blockSize;
+        unsigned haloDepth;
+        double cellsPerSecond;
+        double cyclesPerSweep;
+        double predictedCyclesPerSweep;
+    };
+}
+
+/**
+ * Finds the best halo depth for each block size: runs the deepHalo strategy (temporal blocking) for every
+ * combination, and prints the measured throughput next to the cost model's prediction. Deeper halos mean fewer
+ * exchange phases and syncs but more redundant compute, and the balance shifts with the block size
+ */
+int main(int argc, char *argv[]) {
+    unsigned numIters = 12u;
+    std::string blockSizes = "16,32,64,128";
+    std::string haloDepths = "1,2,4,8";
+    std::string deviceSpec;
+    double cyclesPerCell = 10.0;
+    double exchangeCycles = 1000.0;
+
+    cxxopts::Options options(argv[0], " - Finds the best halo depth for each block size of a Moore neighbourhood "
+                                      "average stencil");
+    options.add_options()
+            ("n,num-iters", "Number of iterations (2 sweeps each), rounded up to a multiple of each halo depth",
+             cxxopts::value<unsigned>(numIters)->default_value("12"))
+            ("block-sizes", "Comma-separated block sizes per tile",
+             cxxopts::value<std::string>(blockSizes)->default_value("16,32,64,128"))
+            ("halo-depths", "Comma-separated halo depths, each no bigger than the block size",
+             cxxopts::value<std::string>(haloDepths)->default_value("1,2,4,8"))
+            ("cycles-per-cell", "The cost model's cycles to update one cell",
+             cxxopts::value<double>(cyclesPerCell)->default_value("10"))
+            ("exchange-cycles", "The cost model's fixed cycles per exchange phase (sync and setup)",
+             cxxopts::value<double>(exchangeCycles)->default_value("1000"))
+            ("device", "Device spec [auto|hw|model:]{mk1,mk2}[:<ipus>[x<tiles>]], e.g. model:mk2:4 "
+                       "(defaults to $IPU_DEVICE or one IPU)",
+             cxxopts::value<std::string>(deviceSpec));
+
+    auto sizes = std::vector<unsigned>{};
+    auto depths = std::vector<unsigned>{};
+    try {
+        options.parse(argc, argv);
+        sizes = parseList(blockSizes);
+        depths = parseList(haloDepths);
+        if (sizes.empty() || depths.empty() || std::count(depths.begin(), depths.end(), 0u) > 0) {
+            std::cerr << options.help() << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (cxxopts::OptionParseException &) {
+        std::cerr << options.help() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto spec = deviceSpec.empty() ? ipu::DeviceSpec::fromEnvironment() : ipu::DeviceSpec::parse(deviceSpec);
+    auto device = ipu::createDevice(spec);
+    if (!device.has_value()) {
+        return EXIT_FAILURE;
+    }
+    const auto &target = device->getTarget();
+    const auto numTiles = target.getNumTiles();
+
+    auto model = grids::TileCostModel::forTarget(target, cyclesPerCell);
+    model.cyclesPerExchange = exchangeCycles;
+
+    const auto engineBuilder = ipu::EngineBuilder::fromCommandLine(argc, argv);
+    auto measurements = std::vector<Measurement>{};
+    for (const auto blockSize: sizes) {
+        for (const auto haloDepth: depths) {
+            if (haloDepth > blockSize) continue;
+            const auto iters = (numIters + haloDepth - 1) / haloDepth * haloDepth;
+            std::cout << "Running " << blockSize << "x" << blockSize << " blocks on " << numTiles
+                      << " tiles with " << haloDepth << "-deep halos for " << iters << " iterations" << std::endl;
+
+            auto graph = Graph(target);
+            graph.addCodelets("codelets/HaloRegionApproachesCodelets.cpp");
+            popops::addCodelets(graph);
+            // Only the whole main loop is timed: counting each exchange and compute set would add a sync and a copy
+            // to the host to every superstep, which is exactly the cost deeper halos are meant to save
+            auto untimed = ipu::CycleCounter(graph, 0, false);
+            auto cycles = ipu::CycleCounter(graph);
+            auto extents = haloGridExtents(graph, numTiles, blockSize);
+            auto programs = deepHaloStrategy(graph, numTiles, blockSize, iters, untimed, extents, haloDepth);
+            programs[1] = cycles.wrap("mainLoop", programs[1]);
+            programs.push_back(extents.program());
+
+            auto engine = engineBuilder.build(graph, programs, *device);
+            cycles.connect(engine);
+            extents.connect(engine);
+            engine.run(2);
+            engine.run(0);
+
+            // Each iteration is 2 sweeps, each updating every cell once
+            const auto cellsPerRun = 2.0 * extents.max("rows") * extents.max("cols") * iters;
+            auto bench = ipu::Benchmark::fromEnvironment("haloDepthSweep", 1, 10)
+                    .throughput("cells", cellsPerRun)
+                    .tag("numIpus", std::to_string(spec.numIpus))
+                    .tag("blockSize", std::to_string(blockSize))
+                    .tag("haloDepth", std::to_string(haloDepth))
+                    .tag("numIters", std::to_string(iters))
+                    .afterWarmups([&]() { cycles.reset(); });
+            bench.run([&]() { engine.run(1); });
+            const auto stats = bench.report();
+            cycles.report();
+            const auto measuredCyclesPerSweep = (double) cycles.cycles("mainLoop") / cycles.calls("mainLoop") /
+                                                (2.0 * iters);
+            measurements.push_back({blockSize, haloDepth, cellsPerRun / stats.median, measuredCyclesPerSweep,
+                                    grids::cyclesPerSweep(blockSize, blockSize, model.withHaloDepth(haloDepth))});
+        }
+    }
+
+    std::cout << std::endl << std::setw(8) << "block" << std::setw(8) << "depth" << std::setw(14) << "cells/s"
+              << std::setw(12) << "cyc/sweep" << std::setw(18) << "model cyc/sweep" << std::endl;
+    for (const auto &m: measurements) {
+        std::cout << std::setw(8) << m.blockSize << std::setw(8) << m.haloDepth << std::setw(14)
+                  << std::setprecision(4) << m.cellsPerSecond << std::fixed << std::setprecision(0)
+                  << std::setw(12) << m.cyclesPerSweep << std::setw(18) << m.predictedCyclesPerSweep
+                  << std::defaultfloat << std::endl;
+    }
+    std::cout << std::endl;
+    const auto maxDepth = *std::max_element(depths.begin(), depths.end());
+    for (const auto blockSize: sizes) {
+        auto best = std::optional<Measurement>{};
+        for (const auto &m: measurements) {
+            if (m.blockSize == blockSize && (!best.has_value() || m.cellsPerSecond > best->cellsPerSecond)) best = m;
+        }
+        if (!best.has_value()) continue;
+        std::cout << "Best halo depth for " << blockSize << "x" << blockSize << " blocks: " << best->haloDepth
+                  << " (the cost model predicts " << grids::bestHaloDepth(blockSize, blockSize, model, maxDepth)
+                  << ")" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
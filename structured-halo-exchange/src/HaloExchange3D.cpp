@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <popops/codelets.hpp>
+#include "cxxopts.hpp"
+#include "StructuredGridUtils.hpp"
+#include "GraphcoreUtils.hpp"
+#include "CommonIpuUtils.hpp"
+#include "HaloRegionStrategies.hpp"
+
+/**
+ * Times a 27-point average stencil on a 3D grid, split into bricks over the IPUs, tiles and workers with
+ * 26-neighbour halos. A brick's halo grows with its surface while its work grows with its volume, so the
+ * decomposition favours near-cubic bricks
+ */
+int main(int argc, char *argv[]) {
+    unsigned numIters = 1u;
+    std::string gridSize = "128x128x128";
+    std::string deviceSpec;
+    bool periodic = false;
+    bool explain = false;
+
+    cxxopts::Options options(argv[0], " - Prints timing for a run of a 27-point average stencil on a 3D grid");
+    options.add_options()
+            ("n,num-iters", "Number of iterations", cxxopts::value<unsigned>(numIters)->default_value("1"))
+            ("s,size", "Grid size as <depth>x<rows>x<cols>",
+             cxxopts::value<std::string>(gridSize)->default_value("128x128x128"))
+            ("periodic", "Wrap the halos around the edges of the grid instead of using a fixed zero boundary")
+            ("explain", "Print how the grid was split between each IPU's tiles, and the alternatives")
+            ("device", "Device spec [auto|hw|model:]{mk1,mk2}[:<ipus>[x<tiles>]], e.g. model:mk2:4 "
+                       "(defaults to $IPU_DEVICE or one IPU)",
+             cxxopts::value<std::string>(deviceSpec));
+
+    auto extents = std::vector<size_t>{};
+    try {
+        auto opts = options.parse(argc, argv);
+        periodic = opts["periodic"].as<bool>();
+        explain = opts["explain"].as<bool>();
+        std::stringstream ss(gridSize);
+        for (std::string extent; std::getline(ss, extent, 'x');) extents.push_back(std::stoul(extent));
+        if (extents.size() != 3) {
+            std::cerr << "The grid size must look like <depth>x<rows>x<cols>, not '" << gridSize << "'" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (cxxopts::OptionParseException &) {
+        std::cerr << options.help() << std::endl;
+        return EXIT_FAILURE;
+    }
+    const auto size = grids::Size3D{extents[0], extents[1], extents[2]};
+
+    const auto spec = deviceSpec.empty() ? ipu::DeviceSpec::fromEnvironment() : ipu::DeviceSpec::parse(deviceSpec);
+    auto device = ipu::createDevice(spec);
+    if (!device.has_value()) {
+        return EXIT_FAILURE;
+    }
+
+    auto graph = Graph(device->getTarget());
+    graph.addCodelets("codelets/HaloRegionApproachesCodelets.cpp");
+    popops::addCodelets(graph);
+
+    std::cout << "Running a 27-point stencil on a " << gridSize << (periodic ? " periodic" : "") << " grid on "
+              << spec.numIpus << " IPUs for " << numIters << " iterations" << std::endl;
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
+    const auto programs = implicit3DStrategy(graph, size, periodic, numIters, cycles,
+                                             explain ? &std::cout : nullptr);
+
+    const auto engineBuilder = ipu::EngineBuilder::fromCommandLine(argc, argv);
+    auto engine = engineBuilder.build(graph, programs, *device);
+    cycles.connect(engine);
+
+    engine.run(0);
+    auto bench = ipu::Benchmark::fromEnvironment("haloExchange3D", 1, 10)
+            .throughput("cells", 2.0 * size.cells() * numIters) // Each iteration updates the grid twice
+            .tag("size", gridSize)
+            .tag("periodic", periodic ? "true" : "false")
+            .tag("numIpus", std::to_string(spec.numIpus))
+            .tag("numIters", std::to_string(numIters))
+            .afterWarmups([&]() { cycles.reset(); });
+    bench.run([&]() { engine.run(1); });
+    bench.report();
+    cycles.report();
+
+    return EXIT_SUCCESS;
+}
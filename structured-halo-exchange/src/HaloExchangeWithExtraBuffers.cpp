@@ -287,11 +287,12 @@ auto stencil(Graph &graph, std::map<std::string, Tensor> tensors) -> Sequence {
 
 int main(int argc, char *argv[]) {
 
-//    auto device = std::optional<Device>{getIpuModel()};
-    auto device = ipu::getIpuDevice(NumIpus);
-    device = device->createVirtualDevice(TotalNumTilesToUse / NumIpus);
+    const auto deviceSpec = ipu::DeviceSpec::fromEnvironment(
+            {ipu::DeviceKind::Auto, "any", NumIpus, TotalNumTilesToUse / NumIpus});
+    auto device = ipu::createDevice(deviceSpec);
     if (!device.has_value()) {
         std::cerr << "Could not attach to IPU device. Aborting" << std::endl;
+        return EXIT_FAILURE;
     }
 
     auto graph = poplar::Graph(device->getTarget());
@@ -318,15 +319,28 @@ int main(int argc, char *argv[]) {
 
     Sequence initProgram = initialise(graph, tensors);
 
-    Program timestepProgram = Repeat{20, Sequence{haloExchange(graph, tensors), stencil(graph, tensors)}};
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
+    Program timestepProgram = Repeat{20, Sequence{cycles.wrap("haloExchange", haloExchange(graph, tensors)),
+                                                  cycles.wrap("stencil", stencil(graph, tensors))}};
+
+    // Fail now rather than after compiling if BufferSize etc. don't fit: each tile has an init, a pack,
+    // 2 unpack and NumWorkers stencil vertices
+    ipu::MemoryBudget(graph)
+            .addTensors(tensors)
+            .addVerticesOnEveryTile(4 + NumWorkers)
+            .enforce();
 
     std::cout << "Compiling..." <<
               std::endl;
     auto tic = std::chrono::high_resolution_clock::now();
 
 
+    // Pick the engine profile with --engine-profile=<name> or IPU_ENGINE_PROFILE, and which iterations are
+    // profiled with --profile-iterations=<spec> or IPU_PROFILE_ITERATIONS (by default only iteration 2)
+    const auto engineBuilder = ipu::EngineBuilder::fromCommandLine(argc, argv);
+    const auto profileSampler = engineBuilder.profileSampler("2");
     auto engine = Engine(graph, {copyToDevice, initProgram, timestepProgram, copyBackToHost},
-                         ipu::POPLAR_ENGINE_OPTIONS_DEBUG);
+                         engineBuilder.options());
 
     auto toc = std::chrono::high_resolution_clock::now();
     auto diff = std::chrono::duration_cast<std::chrono::duration<double >>(toc - tic).count();
@@ -335,6 +349,7 @@ int main(int argc, char *argv[]) {
 
     engine.load(*device);
     engine.disableExecutionProfiling();
+    cycles.connect(engine);
 
     auto dataBuf = std::make_unique<std::vector<char>>(BufferSize * TotalNumTilesToUse * 20);
 
@@ -349,26 +364,23 @@ int main(int argc, char *argv[]) {
 
 
 
+    // The first iteration is a warmup, the rest are summarised at the end. Each one runs 20 stencil steps.
+    auto bench = ipu::Benchmark("haloExchangeWithExtraBuffers", 1, MaxIters - 1)
+            .throughput("cells", 20.0 * TotalNumTilesToUse * NumCellsInTileSide * NumCellsInTileSide);
     for (int iter = 1; iter <= MaxIters; iter++) {
         std::cout << "Running iteration " << iter << ":" << std::endl;
-        if (iter == 2) {
-            engine.enableExecutionProfiling();
-
-        }
-        tic = std::chrono::high_resolution_clock::now();
-        engine.run(2);
-        toc = std::chrono::high_resolution_clock::now();
-        if (iter == 2) {
-            engine.disableExecutionProfiling();
-        }
-
+        profileSampler.beginIteration(engine, iter);
+        diff = bench.measure([&]() { engine.run(2); });
+        profileSampler.endIteration(engine, iter);
 
-        diff = std::chrono::duration_cast<std::chrono::duration<double >>(toc - tic).count();
         std::cout << " took " << std::right << std::setw(12) << std::setprecision(5) << diff << "s" <<
                   std::endl;
         engine.run(3); // Copy back
+        if (iter == 1) cycles.reset(); // Don't count the warmup
 
     }
+    bench.report();
+    cycles.report();
 
     return EXIT_SUCCESS;
 }
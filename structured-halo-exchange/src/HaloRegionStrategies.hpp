@@ -0,0 +1,1029 @@
+#ifndef HALOREGIONSTRATEGIES_HPP
+#define HALOREGIONSTRATEGIES_HPP
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <stdexcept>
+#include <poplar/Graph.hpp>
+#include <poplar/Program.hpp>
+#include <popops/Zero.hpp>
+#include "GraphcoreUtils.hpp"
+#include "CommonIpuUtils.hpp"
+#include "PartitionPlan.hpp"
+
+/**
+ * The halo exchange strategies compared by HaloRegionApproaches (and whose graph build and compile times are
+ * measured by CompileScaling). Each builds its tensors on numTiles tiles and returns {init, main loop} programs.
+ * The stencil only updates the cells inside the runtime extents from haloGridExtents.
+ */
+
+constexpr auto NumTilesInIpuCol = 2u;
+
+auto fill(Graph &graph, const Tensor &tensor, const float value, const unsigned tileNumber, ComputeSet &cs) -> void {
+    auto v = graph.addVertex(cs,
+                             "Fill<float>",
+                             {
+                                     {"result", tensor.flatten()},
+                                     {"val",    value}
+                             }
+    );
+    graph.setPerfEstimate(v, 100);
+    graph.setTileMapping(v, tileNumber);
+}
+
+/**
+ * The active rows and columns of the whole grid, read by the stencil vertices at runtime. The grid is compiled
+ * for numTiles blocks of blockSizePerTile x blockSizePerTile, and a smaller problem just sets smaller extents.
+ * Cells outside the extents are never updated, so they keep their initial values and act as a fixed boundary
+ */
+auto haloGridExtents(Graph &graph, const unsigned numTiles, const unsigned blockSizePerTile) -> ipu::RuntimeSizes {
+    return ipu::RuntimeSizes(graph, {{"rows", numTiles / NumTilesInIpuCol * blockSizePerTile},
+                                     {"cols", NumTilesInIpuCol * blockSizePerTile}});
+}
+
+/** A stencil vertex for the tile's block (with its halos), which only updates the cells inside the extents */
+auto addStencilVertex(Graph &graph, ComputeSet &cs, const Tensor &in, const Tensor &out, const unsigned tile,
+                      const unsigned blockSizePerTile, const ipu::RuntimeSizes &extents) -> void {
+    auto v = graph.addVertex(cs,
+                             "IncludedHalosApproach<float>",
+                             {
+                                     {"in",         in},
+                                     {"out",        out},
+                                     {"activeRows", extents.on("rows", tile)},
+                                     {"activeCols", extents.on("cols", tile)}
+                             }
+    );
+    graph.setInitialValue(v["firstRow"], tile / NumTilesInIpuCol * blockSizePerTile);
+    graph.setInitialValue(v["firstCol"], tile % NumTilesInIpuCol * blockSizePerTile);
+    graph.setPerfEstimate(v, 100);
+    graph.setTileMapping(v, tile);
+}
+
+auto implicitStrategy(Graph &graph, const unsigned numTiles,
+                      const unsigned blockSizePerTile, const unsigned numIters,
+                      ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents) -> std::vector<Program> {
+    const auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+    auto in = graph.addVariable(FLOAT, {NumTilesInIpuRow * blockSizePerTile, NumTilesInIpuCol * blockSizePerTile},
+                                "in");
+    auto out = graph.addVariable(FLOAT, {NumTilesInIpuRow * blockSizePerTile, NumTilesInIpuCol * blockSizePerTile},
+                                 "out");
+
+    // Place the blocks of in and out on the right tiles
+    auto z = std::vector<float>(blockSizePerTile, 0.f);
+
+    auto initCs = graph.addComputeSet("init");
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+        auto startRowInTensor = ipuRow * blockSizePerTile;
+        auto endRowInTensor = startRowInTensor + blockSizePerTile;
+        auto startColInTensor = ipuCol * blockSizePerTile;
+        auto endColInTensor = startColInTensor + blockSizePerTile;
+        auto block = [=](const Tensor &t) -> Tensor {
+            return t.slice({startRowInTensor, startColInTensor}, {endRowInTensor, endColInTensor});
+        };
+        graph.setTileMapping(block(in), tile);
+        graph.setTileMapping(block(out), tile);
+        fill(graph, block(in), (float) tile + 1, tile, initCs);
+    }
+
+    auto stencilProgram = [&]() -> Program {
+        ComputeSet compute1 = graph.addComputeSet("implicitCompute1");
+        ComputeSet compute2 = graph.addComputeSet("implicitCompute2");
+        for (auto tile = 0u; tile < numTiles; tile++) {
+
+
+            auto ipuRow = tile / NumTilesInIpuCol;
+            auto ipuCol = tile % NumTilesInIpuCol;
+            auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+            auto maybeZerosVector = std::optional<Tensor>{};
+            auto maybeZeroScalar = std::optional<Tensor>{};
+
+            if (ipuRow == 0 || ipuRow == NumTilesInIpuRow - 1 || ipuCol == 0 || ipuCol == NumTilesInIpuCol - 1) {
+                maybeZerosVector = {graph.addConstant(FLOAT, {blockSizePerTile}, z.data(), "{0...}")};
+                graph.setTileMapping(*maybeZerosVector, tile);
+                maybeZeroScalar = {graph.addConstant(FLOAT, {1, 1}, 0.f, "0")};
+                graph.setTileMapping(*maybeZeroScalar, tile);
+            }
+
+            const auto block = [&](const Tensor &t, const int rowOffsetBlocks,
+                                   const int colOffsetBlocks) -> Tensor {
+                const auto startRow = ipuRow * blockSizePerTile + rowOffsetBlocks * blockSizePerTile;
+                const auto startCol = ipuCol * blockSizePerTile + colOffsetBlocks * blockSizePerTile;
+                return t.slice({startRow, startCol}, {startRow + blockSizePerTile, startCol + blockSizePerTile});
+            };
+
+            const auto n = [&](const Tensor &t) -> Tensor {
+                return ipuRow > 0
+                       ? block(t, -1, 0).slice({blockSizePerTile - 1, 0},
+                                               {blockSizePerTile, blockSizePerTile})
+                       : maybeZerosVector->reshape({1, blockSizePerTile});
+            };
+            const auto s = [&](const Tensor &t) -> Tensor {
+                return ipuRow < NumTilesInIpuRow - 1
+                       ? block(t, 1, 0).slice({0, 0},
+                                              {1, blockSizePerTile})
+                       : maybeZerosVector->reshape({1, blockSizePerTile});
+            };
+            const auto e = [&](const Tensor &t) -> Tensor {
+                return ipuCol < NumTilesInIpuCol - 1
+                       ? block(t, 0, 1).slice({0, 0},
+                                              {blockSizePerTile, 1})
+                       : maybeZerosVector->reshape({blockSizePerTile, 1});
+            };
+            const auto w = [&](const Tensor &t) -> Tensor {
+                return ipuCol > 0
+                       ? block(t, 0, -1).slice({0, blockSizePerTile - 1},
+                                               {blockSizePerTile, blockSizePerTile})
+                       : maybeZerosVector->reshape({blockSizePerTile, 1});
+            };
+            const auto nw = [&](const Tensor &t) -> Tensor {
+                return ipuCol > 0 && ipuRow > 0
+                       ? block(t, -1, -1)[blockSizePerTile - 1][blockSizePerTile - 1].reshape({1, 1})
+                       : maybeZeroScalar->reshape({1, 1});
+            };
+            const auto ne = [&](const Tensor &t) -> Tensor {
+                return ipuCol < NumTilesInIpuCol - 1 && ipuRow > 0
+                       ? block(t, -1, 1)[blockSizePerTile - 1][0].reshape({1, 1})
+                       : maybeZeroScalar->reshape({1, 1});
+            };
+            const auto sw = [&](const Tensor &t) -> Tensor {
+                return ipuCol > 0 && ipuRow < NumTilesInIpuRow - 1
+                       ? block(t, 1, -1)[0][blockSizePerTile - 1].reshape({1, 1})
+                       : maybeZeroScalar->reshape({1, 1});
+            };
+            const auto se = [&](const Tensor &t) -> Tensor {
+                return ipuCol < NumTilesInIpuCol - 1 && ipuRow < NumTilesInIpuRow - 1
+                       ? block(t, 1, 1)[0][0].reshape({1, 1})
+                       : maybeZeroScalar->reshape({1, 1});
+            };
+
+
+            const auto stitchHalos = [&](const Tensor b) -> Tensor {
+                return concat({
+                                      concat({nw(b), w(b), sw(b)}),
+                                      concat({n(b), block(b, 0, 0), s(b)}),
+                                      concat({ne(b), e(b), se(b)})
+                              }, 1);
+            };
+
+
+            addStencilVertex(graph, compute1, stitchHalos(in), block(out, 0, 0), tile, blockSizePerTile, extents);
+            addStencilVertex(graph, compute2, stitchHalos(out), block(in, 0, 0), tile, blockSizePerTile, extents);
+        }
+        // Poplar inserts the halo exchange before each compute set, so we can't time it separately here
+        return Sequence{cycles.wrap("implicitExchangeAndCompute", Execute(compute1)),
+                        cycles.wrap("implicitExchangeAndCompute", Execute(compute2))};
+    };
+
+    return {Execute(initCs), Repeat{numIters, stencilProgram()}};
+}
+
+auto explicitManyTensorStrategy(Graph &graph, const unsigned numTiles,
+                                const unsigned blockSizePerTile, const unsigned numIters,
+                                ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents)
+-> std::vector<Program> {
+    const auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+    // Place the blocks of in and out on the right tiles
+
+    auto blocksForIncludedHalosIn = std::vector<Tensor>{numTiles};
+    auto blocksForIncludedHalosOut = std::vector<Tensor>{numTiles};
+
+    auto initialiseProgram = Sequence{};
+    auto initialiseCs = graph.addComputeSet("init");
+
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+
+        blocksForIncludedHalosIn[tile] = graph.addVariable(FLOAT, {blockSizePerTile + 2, blockSizePerTile + 2},
+                                                           "in" + std::to_string(tile));
+        blocksForIncludedHalosOut[tile] = graph.addVariable(FLOAT, {blockSizePerTile + 2, blockSizePerTile + 2},
+                                                            "in" + std::to_string(tile));
+        graph.setTileMapping(blocksForIncludedHalosIn[tile], tile);
+        graph.setTileMapping(blocksForIncludedHalosOut[tile], tile);
+        fill(graph, blocksForIncludedHalosIn[tile].slice({1, 1}, {blockSizePerTile + 1, blockSizePerTile + 1}),
+             (float) tile + 1, tile, initialiseCs);
+        fill(graph, blocksForIncludedHalosOut[tile].slice({1, 1}, {blockSizePerTile + 1, blockSizePerTile + 1}),
+             (float) tile + 1, tile, initialiseCs);
+        //  zero out the tlbr grids' halos appropriately
+        if (ipuRow == 0) {
+            popops::zero(graph, blocksForIncludedHalosIn[tile][0], initialiseProgram, "zeroTopHaloEdge");
+            popops::zero(graph, blocksForIncludedHalosOut[tile][0], initialiseProgram, "zeroTopHaloEdge");
+        }
+        if (ipuRow == NumTilesInIpuRow - 1) {
+            popops::zero(graph, blocksForIncludedHalosIn[tile][blockSizePerTile + 1], initialiseProgram,
+                         "zeroBottomEdge");
+            popops::zero(graph, blocksForIncludedHalosOut[tile][blockSizePerTile + 1], initialiseProgram,
+                         "zeroBottomEdge");
+        }
+        if (ipuCol == 0) {
+            popops::zero(graph, blocksForIncludedHalosIn[tile].slice({0, 0}, {blockSizePerTile + 2, 1}),
+                         initialiseProgram,
+                         "zeroLeftHaloEdge");
+            popops::zero(graph, blocksForIncludedHalosOut[tile].slice({0, 0}, {blockSizePerTile + 2, 1}),
+                         initialiseProgram,
+                         "zeroLeftHaloEdge");
+        }
+        if (ipuCol == NumTilesInIpuCol - 1) {
+            popops::zero(graph, blocksForIncludedHalosIn[tile].slice({0, blockSizePerTile + 1},
+                                                                     {blockSizePerTile + 2, blockSizePerTile + 2}),
+                         initialiseProgram, "zeroRightHaloEdge");
+            popops::zero(graph, blocksForIncludedHalosOut[tile].slice({0, blockSizePerTile + 1},
+                                                                      {blockSizePerTile + 2, blockSizePerTile + 2}),
+                         initialiseProgram, "zeroRightHaloEdge");
+        }
+    }
+
+    auto stencilProgram = [&]() -> Sequence {
+        ComputeSet compute1 = graph.addComputeSet("explicitCompute1");
+        ComputeSet compute2 = graph.addComputeSet("explicitCompute2");
+        auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+        const auto haloExchangeFn = [&](std::vector<Tensor> &t) -> Sequence {
+            auto s = Sequence{};
+            for (auto tile = 0u; tile < numTiles; tile++) {
+                const auto ipuRow = tile / NumTilesInIpuCol;
+                const auto ipuCol = tile % NumTilesInIpuCol;
+
+                const auto ghostRegionWidth = (blockSizePerTile + 2);
+                const auto ghostRegionHeight = (blockSizePerTile + 2);
+
+                const auto ghostTopRow = 0;
+                const auto ghostBottomRow = ghostRegionHeight - 1;
+                const auto ghostLeftCol = 0;
+                const auto ghostRightCol = ghostRegionWidth - 1;
+
+                const auto northTile = tile - ipuCol;
+                const auto southTile = tile + ipuCol;
+                const auto eastTile = tile + 1;
+                const auto westTile = tile - 1;
+                const auto northWestTile = northTile - 1;
+                const auto southWestTile = southTile - 1;
+                const auto northEastTile = northTile + 1;
+                const auto southEastTile = southTile + 1;
+
+                const auto borderBottomRow = ghostBottomRow - 1;
+                const auto borderLeftCol = ghostLeftCol + 1;
+                const auto borderTopRow = ghostTopRow + 1;
+                const auto borderRightCol = ghostRightCol - 1;
+
+
+                // copy my north neighbour's bottom border to my top ghost
+                if (ipuRow > 0) {
+                    s.add(
+                            Copy(t[northTile].slice({borderBottomRow, borderLeftCol},
+                                                    {borderBottomRow + 1,
+                                                     borderRightCol + 1}),
+                                 t[tile].slice({ghostTopRow, ghostLeftCol + 1}, {ghostTopRow + 1, ghostRightCol})));
+
+                    // copy my northEast neighbour's bottom left cell to my top right ghost cell
+                    if (ipuCol < NumTilesInIpuCol - 1) {
+                        s.add(Copy(t[northEastTile][borderBottomRow][borderLeftCol],
+                                   t[tile][ghostTopRow][ghostRightCol]));
+                    }
+
+                    // copy my northWest neighbour's bottom right cell to my top left ghost cell
+                    if (ipuCol > 0) {
+                        s.add(Copy(t[northWestTile][borderBottomRow][borderRightCol],
+                                   t[tile][ghostTopRow][ghostLeftCol]));
+                    }
+
+
+                }
+                // copy my south neighbour's top border to my bottom ghost
+                if (ipuRow < NumTilesInIpuRow - 1) {
+                    s.add(
+                            Copy(t[southTile].slice({borderTopRow, borderLeftCol},
+                                                    {borderTopRow + 1,
+                                                     borderRightCol + 1}),
+                                 t[tile].slice({ghostBottomRow, ghostLeftCol + 1},
+                                               {ghostBottomRow + 1, ghostRightCol})));
+
+                    // copy my southEast neighbour's top left cell to my bottom right ghost cell
+                    if (ipuCol < NumTilesInIpuCol - 1) {
+                        s.add(Copy(t[southEastTile][borderTopRow][borderLeftCol],
+                                   t[tile][ghostBottomRow][ghostRightCol]));
+                    }
+
+                    // copy my southWest neighbour's top right cell to my bottom left ghost cell
+                    if (ipuCol > 0) {
+                        s.add(Copy(t[southWestTile][borderTopRow][borderRightCol],
+                                   t[tile][ghostBottomRow][ghostLeftCol]));
+                    }
+                }
+
+//                 copy my east neighbour's left border to my right ghost
+                if (ipuCol < NumTilesInIpuCol - 1) {
+                    s.add(
+                            Copy(t[eastTile].slice({borderTopRow, borderLeftCol},
+                                                   {borderBottomRow + 1,
+                                                    borderLeftCol + 1}),
+                                 t[tile].slice({ghostTopRow + 1, ghostRightCol}, {ghostBottomRow, ghostRightCol + 1})));
+                }
+                // copy my west neighbour's right border to my left ghost region
+                if (ipuCol > 0) {
+                    s.add(
+                            Copy(t[westTile].slice({borderTopRow, borderRightCol},
+                                                   {borderBottomRow + 1,
+                                                    borderRightCol + 1}),
+                                 t[tile].slice({ghostTopRow + 1, ghostLeftCol}, {ghostBottomRow, ghostLeftCol + 1})));
+                }
+
+            }
+            return s;
+        };
+
+        auto haloExchange1 = haloExchangeFn(blocksForIncludedHalosIn);
+        auto haloExchange2 = haloExchangeFn(blocksForIncludedHalosOut);
+
+        for (auto tile = 0u; tile < numTiles; tile++) {
+            addStencilVertex(graph, compute1, blocksForIncludedHalosIn[tile], blocksForIncludedHalosOut[tile],
+                             tile, blockSizePerTile, extents);
+            addStencilVertex(graph, compute2, blocksForIncludedHalosOut[tile], blocksForIncludedHalosIn[tile],
+                             tile, blockSizePerTile, extents);
+        }
+
+
+        return Sequence{cycles.wrap("haloExchange", haloExchange1), cycles.wrap("compute", Execute(compute1)),
+                        cycles.wrap("haloExchange", haloExchange2), cycles.wrap("compute", Execute(compute2))};
+    };
+    Sequence printTensors;
+    for (auto i = 0u; i < numTiles; i++) {
+        printTensors.add(PrintTensor(blocksForIncludedHalosIn[i]));
+    }
+    for (auto i = 0u; i < numTiles; i++) {
+        printTensors.add(PrintTensor(blocksForIncludedHalosOut[i]));
+    }
+    return {Sequence{initialiseProgram, Execute(initialiseCs)},
+            Repeat{numIters, stencilProgram()}};
+
+}
+
+auto explicitOneTensorStrategy2Wave(Graph &graph, const unsigned numTiles,
+                                    const unsigned blockSizePerTile, const unsigned numIters,
+                                    ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents)
+-> std::vector<Program> {
+    const auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+    auto expandedIn = graph.addVariable(FLOAT,
+                                        {NumTilesInIpuRow * (blockSizePerTile + 2),
+                                         NumTilesInIpuCol * (blockSizePerTile + 2)},
+                                        "expandedIn");
+    auto expandedOut = graph.addVariable(FLOAT,
+                                         {NumTilesInIpuRow * (blockSizePerTile + 2),
+                                          NumTilesInIpuCol * (blockSizePerTile + 2)},
+                                         "expandedOut");
+
+
+    auto initialiseProgram = Sequence{};
+    auto initialiseCs = graph.addComputeSet("init");
+
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+
+        const auto blockWithHalo = [&](const Tensor &t) -> Tensor {
+            const auto startRow = ipuRow * (blockSizePerTile + 2);
+            const auto startCol = ipuCol * (blockSizePerTile + 2);
+            return t.slice({startRow, startCol},
+                           {startRow + blockSizePerTile + 2, startCol + blockSizePerTile + 2});
+        };
+        graph.setTileMapping(blockWithHalo(expandedIn), tile);
+        graph.setTileMapping(blockWithHalo(expandedOut), tile);
+
+    }
+    popops::zero(graph, expandedIn, initialiseProgram);
+    popops::zero(graph, expandedOut, initialiseProgram);
+
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+
+        const auto block = [&](const Tensor &t) -> Tensor {
+            const auto startRow = ipuRow * (blockSizePerTile + 2) + 1;
+            const auto startCol = ipuCol * (blockSizePerTile + 2) + 1;
+            return t.slice({startRow, startCol}, {startRow + blockSizePerTile, startCol + blockSizePerTile});
+        };
+        fill(graph, block(expandedIn), (float) tile + 1, tile, initialiseCs);
+        fill(graph, block(expandedOut), (float) tile + 1, tile, initialiseCs);
+    }
+
+    auto stencilProgram = [&]() -> Sequence {
+        ComputeSet compute1 = graph.addComputeSet("explicitCompute1");
+        ComputeSet compute2 = graph.addComputeSet("explicitCompute2");
+        auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+        const auto haloExchangeFn = [&](Tensor &t) -> Sequence {
+            auto northSouthWave = Sequence{};
+            auto eastWestWave = Sequence{};
+            for (auto tile = 0u; tile < numTiles; tile++) {
+                auto ipuRow = tile / NumTilesInIpuCol;
+                auto ipuCol = tile % NumTilesInIpuCol;
+
+                const auto borderWidth = blockSizePerTile;
+                const auto borderHeight = blockSizePerTile;
+                const auto ghostRegionWidth = (blockSizePerTile + 2);
+                const auto ghostRegionHeight = (blockSizePerTile + 2);
+
+                const auto myGhostTopRow = ipuRow * ghostRegionHeight;
+                const auto myGhostBottomRow = myGhostTopRow + ghostRegionHeight - 1;
+                const auto myGhostLeftCol = ipuCol * ghostRegionWidth;
+                const auto myGhostRightCol = myGhostLeftCol + ghostRegionWidth - 1;
+
+                const auto northNeighbourBorderBottomRow = myGhostTopRow - 2;
+                const auto northNeighbourBorderLeftCol = myGhostLeftCol + 1;
+                const auto southNeighbourBorderTopRow = myGhostBottomRow + 2;
+                const auto southNeighbourBorderLeftCol = northNeighbourBorderLeftCol;
+                const auto westNeighbourBorderRightCol = myGhostLeftCol - 2;
+                const auto westNeighbourBorderTopRow = myGhostTopRow + 1;
+                const auto eastNeighbourBorderTopRow = myGhostTopRow + 1;
+                const auto eastNeighbourBorderLeftCol = myGhostRightCol + 2;
+
+
+                // copy my north neighbour's bottom border (+ one more cell) to my top ghost ( less left cell)
+                if (ipuRow > 0) {
+                    northSouthWave.add(
+                            Copy(t.slice({northNeighbourBorderBottomRow, northNeighbourBorderLeftCol},
+                                         {northNeighbourBorderBottomRow + 1,
+                                          northNeighbourBorderLeftCol + borderWidth + 1}),
+                                 t.slice({myGhostTopRow, myGhostLeftCol + 1},
+                                         {myGhostTopRow + 1, myGhostRightCol + 1})));
+                }
+                // copy my south neighbour's top border (+ one more cell)  to my bottom ghost ( less left cell)
+                if (ipuRow < NumTilesInIpuRow - 1) {
+                    northSouthWave.add(
+                            Copy(t.slice({southNeighbourBorderTopRow, southNeighbourBorderLeftCol},
+                                         {southNeighbourBorderTopRow + 1,
+                                          southNeighbourBorderLeftCol + borderWidth + 1}),
+                                 t.slice({myGhostBottomRow, myGhostLeftCol + 1},
+                                         {myGhostBottomRow + 1, myGhostRightCol + 1})));
+                }
+
+                // copy my east neighbour's left border + one cell to top and bottom to my right ghost
+                if (ipuCol < NumTilesInIpuCol - 1) {
+                    eastWestWave.add(
+                            Copy(t.slice({eastNeighbourBorderTopRow - 1, eastNeighbourBorderLeftCol},
+                                         {eastNeighbourBorderTopRow + borderHeight + 1,
+                                          eastNeighbourBorderLeftCol + 1}),
+                                 t.slice({myGhostTopRow, myGhostRightCol},
+                                         {myGhostBottomRow + 1, myGhostRightCol + 1})));
+                }
+                // copy my west neighbour's right   border + one cell to top and bottom to my left ghost region
+                if (ipuCol > 0) {
+                    eastWestWave.add(Copy(t.slice({westNeighbourBorderTopRow - 1, westNeighbourBorderRightCol},
+                                                  {westNeighbourBorderTopRow + borderHeight + 1,
+                                                   westNeighbourBorderRightCol + 1}),
+                                          t.slice({myGhostTopRow, myGhostLeftCol},
+                                                  {myGhostBottomRow + 1, myGhostLeftCol + 1})));
+                }
+            }
+            return Sequence{northSouthWave, eastWestWave};
+        };
+
+        auto haloExchange1 = haloExchangeFn(expandedIn);
+        auto haloExchange2 = haloExchangeFn(expandedOut);
+
+        for (auto tile = 0u; tile < numTiles; tile++) {
+            auto ipuRow = tile / NumTilesInIpuCol;
+            auto ipuCol = tile % NumTilesInIpuCol;
+
+            const auto topHaloRow = ipuRow * (blockSizePerTile + 2);
+            const auto bottomHaloRow = topHaloRow + blockSizePerTile + 1;
+            const auto leftHaloCol = ipuCol * (blockSizePerTile + 2);
+            const auto rightHaloCol = leftHaloCol + blockSizePerTile + 1;
+
+            const auto block = [&](const Tensor &t) -> Tensor {
+                return t.slice({topHaloRow, leftHaloCol}, {bottomHaloRow + 1, rightHaloCol + 1});
+            };
+            addStencilVertex(graph, compute1, block(expandedIn), block(expandedOut), tile, blockSizePerTile, extents);
+            addStencilVertex(graph, compute2, block(expandedOut), block(expandedIn), tile, blockSizePerTile, extents);
+        }
+
+
+        return Sequence{cycles.wrap("haloExchange", haloExchange1), cycles.wrap("compute", Execute(compute1)),
+                        cycles.wrap("haloExchange", haloExchange2), cycles.wrap("compute", Execute(compute2))};
+    };
+    return {Sequence{initialiseProgram, Execute(initialiseCs)},
+            Repeat{numIters, stencilProgram()}
+    };
+}
+
+
+auto explicitOneTensorStrategy(Graph &graph, const unsigned numTiles,
+                               const unsigned blockSizePerTile, const unsigned numIters,
+                               ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents,
+                               bool groupDirs = false) -> std::vector<Program> {
+    const auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+    auto expandedIn = graph.addVariable(FLOAT,
+                                        {NumTilesInIpuRow * (blockSizePerTile + 2),
+                                         NumTilesInIpuCol * (blockSizePerTile + 2)},
+                                        "expandedIn");
+    auto expandedOut = graph.addVariable(FLOAT,
+                                         {NumTilesInIpuRow * (blockSizePerTile + 2),
+                                          NumTilesInIpuCol * (blockSizePerTile + 2)},
+                                         "expandedOut");
+
+
+    auto initialiseProgram = Sequence{};
+    auto initialiseCs = graph.addComputeSet("init");
+
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+
+        const auto blockWithHalo = [&](const Tensor &t) -> Tensor {
+            const auto startRow = ipuRow * (blockSizePerTile + 2);
+            const auto startCol = ipuCol * (blockSizePerTile + 2);
+            return t.slice({startRow, startCol},
+                           {startRow + blockSizePerTile + 2, startCol + blockSizePerTile + 2});
+        };
+        graph.setTileMapping(blockWithHalo(expandedIn), tile);
+        graph.setTileMapping(blockWithHalo(expandedOut), tile);
+
+    }
+    popops::zero(graph, expandedIn, initialiseProgram);
+    popops::zero(graph, expandedOut, initialiseProgram);
+
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        auto ipuRow = tile / NumTilesInIpuCol;
+        auto ipuCol = tile % NumTilesInIpuCol;
+
+        const auto block = [&](const Tensor &t) -> Tensor {
+            const auto startRow = ipuRow * (blockSizePerTile + 2) + 1;
+            const auto startCol = ipuCol * (blockSizePerTile + 2) + 1;
+            return t.slice({startRow, startCol}, {startRow + blockSizePerTile, startCol + blockSizePerTile});
+        };
+        fill(graph, block(expandedIn), (float) tile + 1, tile, initialiseCs);
+        fill(graph, block(expandedOut), (float) tile + 1, tile, initialiseCs);
+    }
+
+    auto stencilProgram = [&]() -> Sequence {
+        ComputeSet compute1 = graph.addComputeSet("explicitCompute1");
+        ComputeSet compute2 = graph.addComputeSet("explicitCompute2");
+        auto NumTilesInIpuRow = numTiles / NumTilesInIpuCol;
+
+        const auto haloExchangeFn = [&](Tensor &t) -> Sequence {
+            auto s = Sequence{};
+            for (auto copyType = 0; copyType < 8; copyType++) {
+                for (auto tile = 0u; tile < numTiles; tile++) {
+                    const auto ipuRow = tile / NumTilesInIpuCol;
+                    const auto ipuCol = tile % NumTilesInIpuCol;
+
+                    const auto borderWidth = blockSizePerTile;
+                    const auto borderHeight = blockSizePerTile;
+                    const auto ghostRegionWidth = (blockSizePerTile + 2);
+                    const auto ghostRegionHeight = (blockSizePerTile + 2);
+
+                    const auto myGhostTopRow = ipuRow * ghostRegionHeight;
+                    const auto myGhostBottomRow = myGhostTopRow + ghostRegionHeight - 1;
+                    const auto myGhostLeftCol = ipuCol * ghostRegionWidth;
+                    const auto myGhostRightCol = myGhostLeftCol + ghostRegionWidth - 1;
+
+                    const auto northNeighbourBorderBottomRow = myGhostTopRow - 2;
+                    const auto northNeighbourBorderLeftCol = myGhostLeftCol + 1;
+                    const auto southNeighbourBorderTopRow = myGhostBottomRow + 2;
+                    const auto southNeighbourBorderLeftCol = northNeighbourBorderLeftCol;
+                    const auto westNeighbourBorderRightCol = myGhostLeftCol - 2;
+                    const auto westNeighbourBorderTopRow = myGhostTopRow + 1;
+                    const auto eastNeighbourBorderTopRow = myGhostTopRow + 1;
+                    const auto eastNeighbourBorderLeftCol = myGhostRightCol + 2;
+                    const auto northWestNeighbourBorderBottomRow = northNeighbourBorderBottomRow;
+                    const auto northWestNeighbourBorderRightCol = northNeighbourBorderLeftCol - 2;
+                    const auto northEastNeighbourBorderBottomRow = northNeighbourBorderBottomRow;
+                    const auto northEastNeighbourBorderLeftCol = northNeighbourBorderLeftCol + ghostRegionWidth;
+                    const auto southWestNeighbourBorderTopRow = southNeighbourBorderTopRow;
+                    const auto southWestNeighbourBorderRightCol = northWestNeighbourBorderRightCol;
+                    const auto southEastNeighbourBorderLeftCol = northEastNeighbourBorderLeftCol;
+                    const auto southEastNeighbourBorderTopRow = southNeighbourBorderTopRow;
+
+                    // copy my north neighbour's bottom border to my top ghost
+                    if (ipuRow > 0) {
+                        if (!groupDirs || copyType == 0)
+                            s.add(
+                                    Copy(t.slice({northNeighbourBorderBottomRow, northNeighbourBorderLeftCol},
+                                                 {northNeighbourBorderBottomRow + 1,
+                                                  northNeighbourBorderLeftCol + borderWidth}),
+                                         t.slice({myGhostTopRow, myGhostLeftCol + 1},
+                                                 {myGhostTopRow + 1, myGhostRightCol})));
+
+                        // copy my northEast neighbour's bottom left cell to my top right ghost cell
+                        if (ipuCol < NumTilesInIpuCol - 1) {
+                            if (!groupDirs || copyType == 1)
+
+                                s.add(Copy(t[northEastNeighbourBorderBottomRow][northEastNeighbourBorderLeftCol],
+                                           t[myGhostTopRow][myGhostRightCol]));
+                        }
+
+                        // copy my northWest neighbour's bottom right cell to my top left ghost cell
+
+                        if (ipuCol > 0) {
+                            if (!groupDirs || copyType == 2)
+
+                                s.add(Copy(t[northWestNeighbourBorderBottomRow][northWestNeighbourBorderRightCol],
+                                           t[myGhostTopRow][myGhostLeftCol]));
+                        }
+
+
+                    }
+                    // copy my south neighbour's top border to my bottom ghost
+                    if (ipuRow < NumTilesInIpuRow - 1) {
+                        if (!groupDirs || copyType == 3)
+
+                            s.add(
+                                    Copy(t.slice({southNeighbourBorderTopRow, southNeighbourBorderLeftCol},
+                                                 {southNeighbourBorderTopRow + 1,
+                                                  southNeighbourBorderLeftCol + borderWidth}),
+                                         t.slice({myGhostBottomRow, myGhostLeftCol + 1},
+                                                 {myGhostBottomRow + 1, myGhostRightCol})));
+
+                        // copy my southEast neighbour's top left cell to my bottom right ghost cell
+                        if (ipuCol < NumTilesInIpuCol - 1) {
+                            if (!groupDirs || copyType == 4)
+
+                                s.add(Copy(t[southEastNeighbourBorderTopRow][southEastNeighbourBorderLeftCol],
+                                           t[myGhostBottomRow][myGhostRightCol]));
+                        }
+
+                        // copy my southWest neighbour's top right cell to my bottom left ghost cell
+                        if (ipuCol > 0) {
+                            if (!groupDirs || copyType == 5)
+
+                                s.add(Copy(t[southWestNeighbourBorderTopRow][southWestNeighbourBorderRightCol],
+                                           t[myGhostBottomRow][myGhostLeftCol]));
+                        }
+                    }
+
+                    // copy my east neighbour's left border to my right ghost
+                    if (ipuCol < NumTilesInIpuCol - 1) {
+                        if (!groupDirs || copyType == 6)
+
+                            s.add(
+                                    Copy(t.slice({eastNeighbourBorderTopRow, eastNeighbourBorderLeftCol},
+                                                 {eastNeighbourBorderTopRow + borderHeight,
+                                                  eastNeighbourBorderLeftCol + 1}),
+                                         t.slice({myGhostTopRow + 1, myGhostRightCol},
+                                                 {myGhostBottomRow, myGhostRightCol + 1})));
+                    }
+                    // copy my west neighbour's right border to my left ghost region
+                    if (ipuCol > 0) {
+                        if (!groupDirs || copyType == 7)
+
+                            s.add(Copy(t.slice({westNeighbourBorderTopRow, westNeighbourBorderRightCol},
+                                               {westNeighbourBorderTopRow + borderHeight,
+                                                westNeighbourBorderRightCol + 1}),
+                                       t.slice({myGhostTopRow + 1, myGhostLeftCol},
+                                               {myGhostBottomRow, myGhostLeftCol + 1})));
+                    }
+
+
+                }
+                if (!groupDirs) {
+                    break;
+                }
+            }
+            return s;
+        };
+
+        auto haloExchange1 = haloExchangeFn(expandedIn);
+        auto haloExchange2 = haloExchangeFn(expandedOut);
+
+        for (auto tile = 0u; tile < numTiles; tile++) {
+            auto ipuRow = tile / NumTilesInIpuCol;
+            auto ipuCol = tile % NumTilesInIpuCol;
+
+            const auto topHaloRow = ipuRow * (blockSizePerTile + 2);
+            const auto bottomHaloRow = topHaloRow + blockSizePerTile + 1;
+            const auto leftHaloCol = ipuCol * (blockSizePerTile + 2);
+            const auto rightHaloCol = leftHaloCol + blockSizePerTile + 1;
+
+            const auto block = [&](const Tensor &t) -> Tensor {
+                return t.slice({topHaloRow, leftHaloCol}, {bottomHaloRow + 1, rightHaloCol + 1});
+            };
+            addStencilVertex(graph, compute1, block(expandedIn), block(expandedOut), tile, blockSizePerTile, extents);
+            addStencilVertex(graph, compute2, block(expandedOut), block(expandedIn), tile, blockSizePerTile, extents);
+        }
+
+
+        return Sequence{cycles.wrap("haloExchange", haloExchange1), cycles.wrap("compute", Execute(compute1)),
+                        cycles.wrap("haloExchange", haloExchange2), cycles.wrap("compute", Execute(compute2))};
+    };
+    return {Sequence{initialiseProgram, Execute(initialiseCs)},
+            Repeat{numIters, stencilProgram()}
+    };
+}
+
+/**
+ * The block layout the strategies above share, NumTilesInIpuCol blocks across with tile t's block in row
+ * t / NumTilesInIpuCol, as a GridPartitioning of tiles
+ */
+auto blockLayoutPartitioning(const Target &target, const unsigned numTiles,
+                             const unsigned blockSizePerTile) -> grids::GridPartitioning {
+    const auto tilesPerIpu = target.getTilesPerIPU();
+    auto result = grids::GridPartitioning{tilesPerIpu, 1};
+    result.reserve(numTiles);
+    for (auto tile = 0u; tile < numTiles; tile++) {
+        const auto row = tile / NumTilesInIpuCol * blockSizePerTile;
+        const auto col = tile % NumTilesInIpuCol * blockSizePerTile;
+        result.insert({grids::PartitioningTarget{tile / tilesPerIpu, tile % tilesPerIpu},
+                       {{row, row + blockSizePerTile}, {col, col + blockSizePerTile}}});
+    }
+    return result;
+}
+
+/**
+ * One Copy of every transfer, so a whole halo exchange is a single phase and a single exchange program however
+ * many tiles and directions it covers. blocks[i] is the i-th tile of tiles' slice with haloDepth-deep halos all
+ * round, and transfers come from grids::haloTransfers (ideally through grids::coalesceHaloTransfers)
+ */
+auto plannedHaloExchange(const std::vector<Tensor> &blocks, const grids::GridPartitioning &tiles,
+                         const std::vector<grids::HaloTransfer> &transfers, const unsigned haloDepth) -> Program {
+    auto from = std::vector<Tensor>{};
+    auto to = std::vector<Tensor>{};
+    from.reserve(transfers.size());
+    to.reserve(transfers.size());
+    for (const auto &transfer: transfers) {
+        const auto source = tiles.find(transfer.source);
+        const auto destination = tiles.find(transfer.destination);
+        const auto &region = transfer.region;
+        const auto sourceRow = region.rows().from() - source->second.rows().from() + haloDepth;
+        const auto sourceCol = region.cols().from() - source->second.cols().from() + haloDepth;
+        const auto haloRow = (size_t) (transfer.rowOffset + haloDepth);
+        const auto haloCol = (size_t) (transfer.colOffset + haloDepth);
+        from.push_back(blocks[source - tiles.begin()].slice({sourceRow, sourceCol},
+                                                            {sourceRow + region.height(),
+                                                             sourceCol + region.width()}).flatten());
+        to.push_back(blocks[destination - tiles.begin()].slice({haloRow, haloCol},
+                                                               {haloRow + region.height(),
+                                                                haloCol + region.width()}).flatten());
+    }
+    if (from.empty()) return Sequence{};
+    return Copy(concat(from), concat(to));
+}
+
+/**
+ * Temporal blocking with deep halos over any partitioning of the grid between tiles: each tile keeps its slice
+ * with a haloDepth-deep halo all round, and all the halos are exchanged in one planned copy (see
+ * plannedHaloExchange) every haloDepth sweeps instead of a 1-cell halo every sweep. Between exchanges each tile
+ * runs haloDepth sweeps over a shrinking region, redoing the part of its neighbours' work that its later sweeps
+ * read. That trades haloDepth times fewer exchange phases (and syncs) for some redundant compute, so the best depth
+ * depends on the block size (see HaloDepthSweep). Like the other strategies, an iteration is 2 sweeps, and
+ * numIters must be a multiple of the plan's halo depth. With the plan's wrap set, 1-deep halos wrap around the
+ * edges of the grid instead of holding a fixed boundary of zeros
+ */
+auto partitionedHaloStrategy(Graph &graph, const grids::PartitionPlan &plan, const unsigned numIters,
+                             ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents) -> std::vector<Program> {
+    const auto haloDepth = (unsigned) plan.key.haloDepth;
+    if (haloDepth == 0) {
+        throw std::invalid_argument("The halo depth must be at least 1");
+    }
+    if (numIters % haloDepth != 0) {
+        throw std::invalid_argument("The number of iterations must be a multiple of the halo depth (" +
+                                    std::to_string(haloDepth) + ")");
+    }
+    if (plan.key.wrap && haloDepth > 1) {
+        // The sweeps never update cells outside the grid, which wrapped deep halos would need
+        throw std::invalid_argument("Deep halos can't wrap around the grid");
+    }
+    const auto k = haloDepth;
+    const auto tilesPerIpu = graph.getTarget().getTilesPerIPU();
+    const auto &tiles = plan.tiles;
+
+    auto in = std::vector<Tensor>{};
+    auto out = std::vector<Tensor>{};
+    auto initialiseProgram = Sequence{};
+    auto initialiseCs = graph.addComputeSet("init");
+    for (const auto &[target, slice]: tiles) {
+        const auto tile = target.virtualTile(tilesPerIpu);
+        in.push_back(graph.addVariable(FLOAT, {slice.height() + 2 * k, slice.width() + 2 * k}, "in"));
+        out.push_back(graph.addVariable(FLOAT, {slice.height() + 2 * k, slice.width() + 2 * k}, "out"));
+        for (const auto &block: {in.back(), out.back()}) {
+            graph.setTileMapping(block, tile);
+            fill(graph, block.slice({k, k}, {k + slice.height(), k + slice.width()}), (float) tile + 1, tile,
+                 initialiseCs);
+        }
+    }
+    // Halos beyond the edge of the grid are never written, so they stay 0 as the fixed boundary
+    const auto flattened = [](const std::vector<Tensor> &blocks) {
+        auto result = std::vector<Tensor>{};
+        for (const auto &block: blocks) result.push_back(block.flatten());
+        return concat(result);
+    };
+    popops::zero(graph, flattened(in), initialiseProgram, "zeroDeepHalos");
+    popops::zero(graph, flattened(out), initialiseProgram, "zeroDeepHalos");
+    const auto haloExchange = [&](const std::vector<Tensor> &blocks) -> Program {
+        return plannedHaloExchange(blocks, tiles, plan.transfers, k);
+    };
+
+    const auto addSweepVertex = [&](ComputeSet &cs, const std::vector<Tensor> &from, const std::vector<Tensor> &to,
+                                    const size_t i, const unsigned margin) {
+        const auto &[target, slice] = *(tiles.begin() + i);
+        const auto tile = target.virtualTile(tilesPerIpu);
+        auto v = graph.addVertex(cs,
+                                 "DeepHaloSweep<float>",
+                                 {
+                                         {"in",         from[i]},
+                                         {"out",        to[i]},
+                                         {"activeRows", extents.on("rows", tile)},
+                                         {"activeCols", extents.on("cols", tile)}
+                                 }
+        );
+        graph.setInitialValue(v["originRow"], (int) slice.rows().from() - (int) k);
+        graph.setInitialValue(v["originCol"], (int) slice.cols().from() - (int) k);
+        graph.setInitialValue(v["margin"], margin);
+        graph.setPerfEstimate(v, 100);
+        graph.setTileMapping(v, tile);
+    };
+
+    // An exchange into t's halos, then haloDepth sweeps bouncing between t and other. The result ends up in t if
+    // haloDepth is even, and in other if it's odd
+    const auto exchangeAndSweeps = [&](const std::vector<Tensor> &t, const std::vector<Tensor> &other) -> Sequence {
+        auto s = Sequence{cycles.wrap("haloExchange", haloExchange(t))};
+        for (auto sweep = 1u; sweep <= k; sweep++) {
+            auto cs = graph.addComputeSet("deepHaloSweep" + std::to_string(sweep));
+            for (auto i = 0ul; i < tiles.size(); i++) {
+                addSweepVertex(cs, sweep % 2 == 1 ? t : other, sweep % 2 == 1 ? other : t, i, sweep);
+            }
+            s.add(cycles.wrap("compute", Execute(cs)));
+        }
+        return s;
+    };
+
+    // Both buffers start with the same blocks and halos, so the cells outside the active extents (which are never
+    // updated) read the same whichever buffer a sweep reads
+    const auto fromIn = exchangeAndSweeps(in, out);
+    const auto fromOut = k % 2 == 0 ? fromIn : exchangeAndSweeps(out, in);
+    return {Sequence{initialiseProgram, Execute(initialiseCs), haloExchange(in), haloExchange(out)},
+            Repeat{numIters / k, Sequence{fromIn, fromOut}}
+    };
+}
+
+/** A plan's bytes per cell for the deep halo strategies: an in and an out buffer */
+constexpr auto DeepHaloBytesPerCell = 2 * sizeof(float);
+
+/**
+ * partitionedHaloStrategy on the block layout the other strategies use. The plan comes from the PlanCache, since
+ * working out the transfers between thousands of tiles takes a while
+ */
+auto deepHaloStrategy(Graph &graph, const unsigned numTiles,
+                      const unsigned blockSizePerTile, const unsigned numIters,
+                      ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents,
+                      const unsigned haloDepth) -> std::vector<Program> {
+    const auto &target = graph.getTarget();
+    const auto gridSize = grids::Size2D{numTiles / NumTilesInIpuCol * blockSizePerTile,
+                                        NumTilesInIpuCol * blockSizePerTile};
+    // The grid size pins down the layout: blockSizePerTile = cols / NumTilesInIpuCol, and the number of tiles
+    auto key = grids::PlanKey::forTarget(gridSize, target, DeepHaloBytesPerCell, haloDepth);
+    key.partitioner = "blocks";
+    const auto plan = grids::PlanCache::fromEnvironment().getOrBuild(key, [&](const grids::PlanKey &planKey) {
+        return grids::PartitionPlan::fromTiles(planKey, blockLayoutPartitioning(target, numTiles, blockSizePerTile));
+    });
+    return partitionedHaloStrategy(graph, *plan, numIters, cycles, extents);
+}
+
+/**
+ * partitionedHaloStrategy on the same grid as the other strategies, but split between the tiles by the cost model
+ * in StructuredGridUtils instead of the fixed block layout. Where the tiles' boundaries don't line up, as between
+ * IPUs, the planner folds corners into the edge copies beside them. The plan comes from the PlanCache
+ */
+auto plannedStrategy(Graph &graph, const unsigned numIters, ipu::CycleCounter &cycles,
+                     const ipu::RuntimeSizes &extents, const unsigned haloDepth) -> std::vector<Program> {
+    const auto &target = graph.getTarget();
+    const auto gridSize = grids::Size2D{extents.max("rows"), extents.max("cols")};
+    const auto key = grids::PlanKey::forTarget(gridSize, target, DeepHaloBytesPerCell, haloDepth, false,
+                                               9.0 / target.getNumWorkerContexts());
+    const auto plan = grids::PlanCache::fromEnvironment().getOrBuild(key);
+    if (!plan.has_value()) {
+        throw std::invalid_argument("A " + std::to_string(gridSize.rows()) + "x" + std::to_string(gridSize.cols()) +
+                                    " grid doesn't fit on the device");
+    }
+    return partitionedHaloStrategy(graph, *plan, numIters, cycles, extents);
+}
+
+/**
+ * A 27-point stencil over a 3D grid of depth x rows x cols. The grid is split into bricks per IPU, tile and worker
+ * by the cost model in StructuredGridUtils, and each worker's vertex reads its brick with the 26 halo regions around
+ * it, which Poplar's implicit exchange brings over from the neighbouring tiles. With periodic set the halos wrap
+ * around; otherwise the grid is surrounded by a fixed boundary of zeros
+ */
+auto implicit3DStrategy(Graph &graph, const grids::Size3D size, const bool periodic, const unsigned numIters,
+                        ipu::CycleCounter &cycles, std::ostream *explain = nullptr) -> std::vector<Program> {
+    const auto &target = graph.getTarget();
+    constexpr auto bytesPerCell = 2 * sizeof(float); // in and out
+    const auto ipuBricks = grids::partitionForIpus3D(size, target, bytesPerCell);
+    if (!ipuBricks.has_value()) {
+        throw std::invalid_argument("A " + std::to_string(size.depth()) + "x" + std::to_string(size.rows()) + "x" +
+                                    std::to_string(size.cols()) + " grid doesn't fit on the device");
+    }
+    const auto model = grids::TileCostModel::forTarget(target, 27.0 / target.getNumWorkerContexts());
+    const auto tileBricks = grids::toTilePartitions3D(*ipuBricks, target, bytesPerCell, model,
+                                                      grids::DefaultMinEdgePerBrick, explain);
+    const auto workerBricks = grids::toWorkerPartitions3D(tileBricks, target.getNumWorkerContexts());
+
+    auto in = graph.addVariable(FLOAT, {size.depth(), size.rows(), size.cols()}, "in");
+    auto out = graph.addVariable(FLOAT, {size.depth(), size.rows(), size.cols()}, "out");
+    utils::mapBricksToTiles(graph, in, tileBricks);
+    utils::mapBricksToTiles(graph, out, tileBricks);
+
+    auto initCs = graph.addComputeSet("init");
+    for (const auto &[brickTarget, brick]: tileBricks) {
+        const auto tile = brickTarget.virtualTile(target.getTilesPerIPU());
+        fill(graph, utils::applySlice(in, brick), (float) tile + 1, tile, initCs);
+    }
+
+    // The brick with its halos: the 3x3x3 arrangement of regions around it stitched into one tensor, with zeros
+    // standing in for regions outside a non-periodic grid
+    const auto withHalos = [&](const Tensor &t, const grids::Slice3D &brick, const unsigned tile) -> Tensor {
+        const auto halos = periodic ? grids::Halos3D::forSliceWithWraparound(brick, size)
+                                    : grids::Halos3D::forSliceNoWrap(brick, size);
+        auto planes = std::vector<Tensor>{};
+        for (auto dPlane = -1; dPlane <= 1; dPlane++) {
+            auto rows = std::vector<Tensor>{};
+            for (auto dRow = -1; dRow <= 1; dRow++) {
+                auto cols = std::vector<Tensor>{};
+                for (auto dCol = -1; dCol <= 1; dCol++) {
+                    if (dPlane == 0 && dRow == 0 && dCol == 0) {
+                        cols.push_back(utils::applySlice(t, brick));
+                    } else if (const auto &region = halos.at(dPlane, dRow, dCol); region.has_value()) {
+                        cols.push_back(utils::applySlice(t, *region));
+                    } else {
+                        auto zeros = graph.addConstant(FLOAT, {dPlane == 0 ? brick.depth() : 1,
+                                                               dRow == 0 ? brick.height() : 1,
+                                                               dCol == 0 ? brick.width() : 1}, 0.f, "boundary");
+                        graph.setTileMapping(zeros, tile);
+                        cols.push_back(zeros);
+                    }
+                }
+                rows.push_back(concat(cols, 2));
+            }
+            planes.push_back(concat(rows, 1));
+        }
+        return concat(planes, 0).reshape({(brick.depth() + 2) * (brick.height() + 2), brick.width() + 2});
+    };
+
+    const auto addStencil = [&](ComputeSet &cs, const Tensor &from, const Tensor &to,
+                                const grids::Slice3D &brick, const unsigned tile) {
+        auto v = graph.addVertex(cs,
+                                 "Stencil27Point<float>",
+                                 {
+                                         {"in",  withHalos(from, brick, tile)},
+                                         {"out", utils::applySlice(to, brick)
+                                                 .reshape({brick.depth() * brick.height(), brick.width()})}
+                                 }
+        );
+        graph.setInitialValue(v["planes"], static_cast<unsigned>(brick.depth()));
+        graph.setInitialValue(v["rows"], static_cast<unsigned>(brick.height()));
+        graph.setPerfEstimate(v, 100);
+        graph.setTileMapping(v, tile);
+    };
+
+    auto compute1 = graph.addComputeSet("implicit3DCompute1");
+    auto compute2 = graph.addComputeSet("implicit3DCompute2");
+    for (const auto &[workerTarget, brick]: workerBricks) {
+        const auto tile = workerTarget.virtualTile(target.getTilesPerIPU());
+        addStencil(compute1, in, out, brick, tile);
+        addStencil(compute2, out, in, brick, tile);
+    }
+
+    // Poplar inserts the halo exchange before each compute set, so we can't time it separately here
+    return {Execute(initCs),
+            Repeat{numIters, Sequence{cycles.wrap("implicit3DExchangeAndCompute", Execute(compute1)),
+                                      cycles.wrap("implicit3DExchangeAndCompute", Execute(compute2))}}};
+}
+
+const auto HaloStrategies = std::vector<std::string>{
+        "implicit", "explicitManyTensors", "explicitOneTensor", "explicitOneTensor2Wave",
+        "explicitOneTensorGroupedDirs", "deepHalo", "planned"};
+
+/**
+ * Builds the named strategy, or returns nullopt if there is no strategy with that name. Only deepHalo and planned
+ * use haloDepth: the others always exchange 1-cell halos every sweep
+ */
+auto buildHaloStrategy(const std::string &strategy, Graph &graph, const unsigned numTiles,
+                       const unsigned blockSizePerTile, const unsigned numIters,
+                       ipu::CycleCounter &cycles, const ipu::RuntimeSizes &extents, const unsigned haloDepth = 1)
+-> std::optional<std::vector<Program>> {
+    if (strategy == "implicit") {
+        return implicitStrategy(graph, numTiles, blockSizePerTile, numIters, cycles, extents);
+    } else if (strategy == "explicitManyTensors") {
+        return explicitManyTensorStrategy(graph, numTiles, blockSizePerTile, numIters, cycles, extents);
+    } else if (strategy == "explicitOneTensor") {
+        return explicitOneTensorStrategy(graph, numTiles, blockSizePerTile, numIters, cycles, extents, false);
+    } else if (strategy == "explicitOneTensorGroupedDirs") {
+        return explicitOneTensorStrategy(graph, numTiles, blockSizePerTile, numIters, cycles, extents, true);
+    } else if (strategy == "explicitOneTensor2Wave") {
+        return explicitOneTensorStrategy2Wave(graph, numTiles, blockSizePerTile, numIters, cycles, extents);
+    } else if (strategy == "deepHalo") {
+        return deepHaloStrategy(graph, numTiles, blockSizePerTile, numIters, cycles, extents, haloDepth);
+    } else if (strategy == "planned") {
+        return plannedStrategy(graph, numIters, cycles, extents, haloDepth);
+    }
+    return std::nullopt;
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef HALOSTRATEGYTUNER_HPP
+#define HALOSTRATEGYTUNER_HPP
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <poplar/Device.hpp>
+#include <poplar/Graph.hpp>
+#include <poplar/exceptions.hpp>
+#include <popops/codelets.hpp>
+#include "CommonIpuUtils.hpp"
+#include "HaloRegionStrategies.hpp"
+
+/** On-device cycles per iteration of one strategy's main loop */
+struct StrategyTiming {
+    std::string strategy;
+    double cyclesPerIteration;
+};
+
+/**
+ * The tuning database key for a configuration: the strategies see the same grid whenever the device's target, the
+ * number of replicas it's split into, the block size and the halo depth are the same
+ */
+auto haloTuningKey(const Target &target, const unsigned replicas, const unsigned blockSizePerTile,
+                   const unsigned haloDepth) -> std::string {
+    return "haloStrategy/" + target.getTargetArchString() + "/" + std::to_string(target.getNumIPUs()) + "x" +
+           std::to_string(target.getTilesPerIPU()) + "/r" + std::to_string(replicas) + "/b" +
+           std::to_string(blockSizePerTile) + "/d" + std::to_string(haloDepth);
+}
+
+/**
+ * Times each strategy's main loop on the device with poplar::cycleCount, fastest first. All the strategies go in
+ * one graph, each with its own init and main loop programs, so there's a single compile (and a single executable
+ * cache entry) for the lot. If they don't all fit in tile memory together, each is compiled and timed on its own.
+ * numIters must be a multiple of haloDepth
+ */
+auto timeHaloStrategies(Device &device, const ipu::Replication &replication, const ipu::EngineBuilder &engineBuilder,
+                        const std::vector<std::string> &strategies, const unsigned blockSizePerTile,
+                        const unsigned numIters, const unsigned haloDepth, const unsigned runs = 5)
+-> std::vector<StrategyTiming> {
+    const auto timeTogether = [&](const std::vector<std::string> &names) -> std::vector<StrategyTiming> {
+        auto graph = replication.createGraph(device);
+        const auto numTiles = graph.getTarget().getNumTiles();
+        graph.addCodelets("codelets/HaloRegionApproachesCodelets.cpp");
+        popops::addCodelets(graph);
+
+        // Only whole main loops are timed: counting each exchange and compute set separately would add a sync and
+        // a copy to the host to every superstep
+        auto untimed = ipu::CycleCounter(graph, 0, false);
+        auto timer = ipu::CycleCounter(graph);
+        auto extents = haloGridExtents(graph, numTiles, blockSizePerTile);
+        auto programs = std::vector<Program>{extents.program()}; // Then init and main loop for each strategy
+        for (const auto &name: names) {
+            const auto strategyPrograms = buildHaloStrategy(name, graph, numTiles, blockSizePerTile, numIters,
+                                                            untimed, extents, haloDepth).value();
+            programs.push_back(strategyPrograms[0]);
+            programs.push_back(timer.wrap(name, strategyPrograms[1]));
+        }
+
+        auto engine = engineBuilder.build(graph, programs, device);
+        timer.connect(engine);
+        extents.connect(engine);
+        engine.run(0);
+
+        auto result = std::vector<StrategyTiming>{};
+        for (auto i = 0u; i < names.size(); i++) {
+            engine.run(1 + 2 * i);
+            engine.run(2 + 2 * i); // Warmup
+            const auto before = timer.cycles(names[i]);
+            for (auto run = 0u; run < runs; run++) engine.run(2 + 2 * i);
+            result.push_back({names[i], (double) (timer.cycles(names[i]) - before) / runs / numIters});
+        }
+        return result;
+    };
+
+    auto result = std::vector<StrategyTiming>{};
+    try {
+        result = timeTogether(strategies);
+    } catch (const poplar::graph_memory_allocation_error &) {
+        std::cout << "The strategies don't all fit on the device together, so timing them one at a time"
+                  << std::endl;
+        for (const auto &strategy: strategies) {
+            try {
+                const auto timing = timeTogether({strategy});
+                result.insert(result.end(), timing.begin(), timing.end());
+            } catch (const poplar::graph_memory_allocation_error &) {
+                std::cout << "  " << strategy << " doesn't fit" << std::endl;
+            }
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const StrategyTiming &a, const StrategyTiming &b) {
+        return a.cyclesPerIteration < b.cyclesPerIteration;
+    });
+    return result;
+}
+
+/**
+ * The fastest strategy for this configuration according to the tuning database, timing them all (and recording
+ * the winner) if it has no entry yet or retune is set. Returns nullopt if no strategy fits
+ */
+auto tunedHaloStrategy(Device &device, const ipu::Replication &replication, const ipu::EngineBuilder &engineBuilder,
+                       const unsigned blockSizePerTile, const unsigned numIters, const unsigned haloDepth,
+                       const bool retune = false) -> std::optional<std::string> {
+    const auto database = ipu::TuningDatabase::fromEnvironment();
+    const auto key = haloTuningKey(device.getTarget(), replication.replicas(), blockSizePerTile, haloDepth);
+    const auto entry = database.find(key);
+    const auto known = entry.has_value() &&
+                       std::find(HaloStrategies.begin(), HaloStrategies.end(), entry->choice) != HaloStrategies.end();
+    if (known && !retune) {
+        std::cout << "Tuned strategy for " << key << ": " << entry->choice << " (" << entry->cost
+                  << " cycles per iteration, from " << database.path().string() << ")" << std::endl;
+        return entry->choice;
+    }
+
+    std::cout << "Tuning the halo exchange strategy for " << key << std::endl;
+    const auto timings = timeHaloStrategies(device, replication, engineBuilder, HaloStrategies, blockSizePerTile,
+                                            numIters, haloDepth);
+    if (timings.empty()) return std::nullopt;
+    for (const auto &timing: timings) {
+        std::cout << "  " << std::setw(30) << std::left << timing.strategy << std::right << std::setw(14)
+                  << std::fixed << std::setprecision(0) << timing.cyclesPerIteration << std::defaultfloat
+                  << " cycles per iteration" << std::endl;
+    }
+    database.record(key, {timings.front().strategy, timings.front().cyclesPerIteration});
+    if (database.enabled()) {
+        std::cout << "Recorded " << timings.front().strategy << " in " << database.path().string() << std::endl;
+    }
+    return timings.front().strategy;
+}
+
+#endif
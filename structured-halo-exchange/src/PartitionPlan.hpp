@@ -0,0 +1,674 @@
+// A partitioning of a 2D grid down to workers, with the halo transfers it implies, that can be saved, cached
+// between runs and memory-mapped for inspection
+
+#ifndef STRUCTURED_HALO_EXCHANGE_PARTITIONPLAN_HPP
+#define STRUCTURED_HALO_EXCHANGE_PARTITIONPLAN_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poplar/Target.hpp>
+#include "FileUtils.hpp"
+#include "StructuredGridUtils.hpp"
+
+namespace grids {
+    namespace fs = std::filesystem;
+
+    /**
+     * Cells that the destination needs in its halo, and the source target that owns them. region is where the
+     * cells are in the grid; rowOffset and colOffset are where they go relative to the top left of the
+     * destination's slice, e.g. (-1, 0) for the row above it. With wraparound the two differ at the grid's edges
+     */
+    struct HaloTransfer {
+        PartitioningTarget source;
+        PartitioningTarget destination;
+        Slice2D region;
+        int64_t rowOffset;
+        int64_t colOffset;
+    };
+
+    /**
+     * The parts of the range of depth cells beside [from, to) in direction d (-1 before, 1 after) that are in the
+     * grid, as {part, unwrapped start} pairs. Without wraparound the range is cut off at the grid's edge; with it,
+     * a range crossing the edge comes back as two parts
+     */
+    auto haloRanges(const Range range, const int d, const size_t extent, const size_t depth, const bool wrap)
+    -> std::vector<std::pair<Range, int64_t>> {
+        const auto from = d < 0 ? (int64_t) range.from() - (int64_t) depth : (int64_t) range.to();
+        const auto to = from + (int64_t) depth;
+        auto result = std::vector<std::pair<Range, int64_t>>{};
+        const auto n = (int64_t) extent;
+        for (auto start = from; start < to;) {
+            // The run of cells from start that doesn't cross a multiple of the extent
+            const auto wrapped = ((start % n) + n) % n;
+            const auto end = min(to, start + (n - wrapped));
+            if (wrap || (start >= 0 && start < n)) {
+                result.push_back({Range{(size_t) wrapped, (size_t) (wrapped + end - start)}, start});
+            }
+            start = end;
+        }
+        return result;
+    }
+
+    /**
+     * The rectangles of region owned by each target, found a band of rows at a time: every row of a band crosses
+     * the same slices. Cells no slice owns are left out
+     */
+    auto splitByOwner(const CellOwners &owners, const Slice2D region)
+    -> std::vector<std::pair<PartitioningTarget, Slice2D>> {
+        auto result = std::vector<std::pair<PartitioningTarget, Slice2D>>{};
+        for (auto row = region.rows().from(); row < region.rows().to();) {
+            auto bandEnd = region.rows().to();
+            auto band = std::vector<std::pair<PartitioningTarget, Range>>{};
+            for (auto col = region.cols().from(); col < region.cols().to();) {
+                const auto entry = owners.entryAt(row, col);
+                if (entry == nullptr) {
+                    col++;
+                    bandEnd = row + 1;
+                    continue;
+                }
+                const auto &[target, slice] = *entry;
+                const auto colEnd = min(slice.cols().to(), region.cols().to());
+                bandEnd = min(bandEnd, slice.rows().to());
+                band.push_back({target, {col, colEnd}});
+                col = colEnd;
+            }
+            for (const auto &[target, cols]: band) result.push_back({target, {{row, bandEnd}, cols}});
+            row = bandEnd;
+        }
+        return result;
+    }
+
+    /**
+     * Every halo transfer between tiles for a stencil with haloDepth-deep halos (all 8 neighbours) over a grid of
+     * gridSize split by partitioning. Transfers between workers on the same tile don't need an exchange, so they
+     * are left out, unless they wrap around the grid: then the cells land somewhere else in the tile's halo (e.g. a
+     * single column of tiles wraps onto its own opposite edge), so they still need copying. Transfers come in
+     * destination order, and each destination's in direction order
+     */
+    auto haloTransfers(const GridPartitioning &partitioning, const Size2D gridSize, const size_t haloDepth = 1,
+                       const bool wrap = false) -> std::vector<HaloTransfer> {
+        const auto owners = CellOwners{partitioning};
+        auto result = std::vector<HaloTransfer>{};
+        for (const auto &[destination, slice]: partitioning) {
+            for (auto dRow = -1; dRow <= 1; dRow++) {
+                for (auto dCol = -1; dCol <= 1; dCol++) {
+                    if (dRow == 0 && dCol == 0) continue;
+                    const auto rowParts = dRow == 0
+                                          ? std::vector<std::pair<Range, int64_t>>{
+                                    {slice.rows(), (int64_t) slice.rows().from()}}
+                                          : haloRanges(slice.rows(), dRow, gridSize.rows(), haloDepth, wrap);
+                    const auto colParts = dCol == 0
+                                          ? std::vector<std::pair<Range, int64_t>>{
+                                    {slice.cols(), (int64_t) slice.cols().from()}}
+                                          : haloRanges(slice.cols(), dCol, gridSize.cols(), haloDepth, wrap);
+                    for (const auto &[rows, unwrappedRow]: rowParts) {
+                        for (const auto &[cols, unwrappedCol]: colParts) {
+                            for (const auto &[source, part]: splitByOwner(owners, {rows, cols})) {
+                                const auto wrapped = unwrappedRow != (int64_t) rows.from() ||
+                                                     unwrappedCol != (int64_t) cols.from();
+                                if (source.ipu() == destination.ipu() && source.tile() == destination.tile() &&
+                                    !wrapped) {
+                                    continue;
+                                }
+                                result.push_back({source, destination, part,
+                                                  unwrappedRow + (int64_t) (part.rows().from() - rows.from()) -
+                                                  (int64_t) slice.rows().from(),
+                                                  unwrappedCol + (int64_t) (part.cols().from() - cols.from()) -
+                                                  (int64_t) slice.cols().from()});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Merges transfers between the same two tiles whose regions share a whole edge and land side by side in the
+     * destination's halo, until no more merge. This folds a corner into the edge beside it when one neighbour
+     * owns both, which happens wherever tile boundaries don't line up (e.g. across IPUs), and joins the pieces of
+     * a region that haloTransfers found separately. Wrapped transfers only merge with ones wrapped the same way.
+     * The transfers must come in destination order, as haloTransfers gives them, and the result keeps the order
+     * of each pair of tiles' first transfer
+     */
+    auto coalesceHaloTransfers(const std::vector<HaloTransfer> &transfers) -> std::vector<HaloTransfer> {
+        const auto sameTiles = [](const HaloTransfer &a, const HaloTransfer &b) {
+            return a.source == b.source && a.destination == b.destination;
+        };
+        // Where a region's cells go relative to where they are. Equal for two regions of the same destination
+        // means putting them together in the grid puts them together in the halo
+        const auto shift = [](const HaloTransfer &t) {
+            return std::make_pair(t.rowOffset - (int64_t) t.region.rows().from(),
+                                  t.colOffset - (int64_t) t.region.cols().from());
+        };
+        const auto tryMerge = [&](HaloTransfer &into, const HaloTransfer &other) -> bool {
+            if (shift(into) != shift(other)) return false;
+            const auto &a = into.region;
+            const auto &b = other.region;
+            auto merged = std::optional<Slice2D>{};
+            if (a.rows().from() == b.rows().from() && a.rows().to() == b.rows().to()) {
+                if (a.cols().to() == b.cols().from()) merged = Slice2D{a.rows(), {a.cols().from(), b.cols().to()}};
+                if (b.cols().to() == a.cols().from()) merged = Slice2D{a.rows(), {b.cols().from(), a.cols().to()}};
+            } else if (a.cols().from() == b.cols().from() && a.cols().to() == b.cols().to()) {
+                if (a.rows().to() == b.rows().from()) merged = Slice2D{{a.rows().from(), b.rows().to()}, a.cols()};
+                if (b.rows().to() == a.rows().from()) merged = Slice2D{{b.rows().from(), a.rows().to()}, a.cols()};
+            }
+            if (!merged.has_value()) return false;
+            into.rowOffset = std::min(into.rowOffset, other.rowOffset);
+            into.colOffset = std::min(into.colOffset, other.colOffset);
+            into.region = *merged;
+            return true;
+        };
+
+        auto result = std::vector<HaloTransfer>{};
+        result.reserve(transfers.size());
+        auto done = std::vector<bool>(transfers.size(), false);
+        for (auto i = 0ul; i < transfers.size(); i++) {
+            if (done[i]) continue;
+            // Each destination gets its transfers together, so the others between these tiles are close by
+            auto group = std::vector<HaloTransfer>{};
+            for (auto j = i; j < transfers.size() && transfers[j].destination == transfers[i].destination; j++) {
+                if (!done[j] && sameTiles(transfers[i], transfers[j])) {
+                    group.push_back(transfers[j]);
+                    done[j] = true;
+                }
+            }
+            for (auto merging = true; merging;) {
+                merging = false;
+                for (auto a = 0ul; a < group.size() && !merging; a++) {
+                    for (auto b = a + 1; b < group.size() && !merging; b++) {
+                        if (tryMerge(group[a], group[b])) {
+                            group.erase(group.begin() + b);
+                            merging = true;
+                        }
+                    }
+                }
+            }
+            result.insert(result.end(), group.begin(), group.end());
+        }
+        return result;
+    }
+
+    /**
+     * How many contiguous runs of cells an exchange of these transfers copies: one per row of each region, as
+     * rows are contiguous in both the source's and the destination's block. This is roughly the number of
+     * exchange instructions it compiles to
+     */
+    auto haloExchangeIntervals(const std::vector<HaloTransfer> &transfers) -> size_t {
+        auto result = 0ul;
+        for (const auto &t: transfers) result += t.region.height();
+        return result;
+    }
+
+    /**
+     * Bump this whenever a change to the partitioners or the halo planning changes the plans they build, so that
+     * plans cached by older code are rebuilt rather than loaded
+     */
+    constexpr auto PartitionerVersion = 2u;
+
+    /** The PlanKey partitioner for PartitionPlan::build. Layouts given to PartitionPlan::fromTiles name their own */
+    constexpr auto CostModelPartitioner = "costModel";
+
+    /** Everything that determines a plan: the grid, the halos, the device, and how the grid is partitioned */
+    struct PlanKey {
+        Size2D gridSize;
+        size_t haloDepth = 1;
+        bool wrap = false;
+        size_t bytesPerCell = 4;
+        PartitioningDevice device = {};
+        std::string partitioner = CostModelPartitioner; // At most 15 characters, as it's stored in the plan file
+        TileCostModel model = {}; // Its bytesPerCell and haloDepth are always the key's (see costModel)
+
+        static auto forTarget(const Size2D gridSize, const poplar::Target &target, const size_t bytesPerCell,
+                              const size_t haloDepth = 1, const bool wrap = false,
+                              const double cyclesPerCell = 1.0) -> PlanKey {
+            return {gridSize, haloDepth, wrap, bytesPerCell, PartitioningDevice::fromTarget(target),
+                    CostModelPartitioner, TileCostModel::forTarget(target, cyclesPerCell, bytesPerCell)};
+        }
+
+        /** The model the partitioner weighs splits with, for the key's cells and halos */
+        [[nodiscard]] auto costModel() const -> TileCostModel {
+            auto result = model.withHaloDepth(haloDepth);
+            result.bytesPerCell = bytesPerCell;
+            return result;
+        }
+
+        /** Readable, and unique for each key, so it doubles as the plan's file name in a PlanCache */
+        [[nodiscard]] auto str() const -> std::string {
+            std::stringstream ss;
+            ss << gridSize.rows() << "x" << gridSize.cols() << "-halo" << haloDepth << (wrap ? "-wrap" : "") << "-"
+               << bytesPerCell << "B-" << device.numIpus << "ipu-" << device.tilesPerIpu << "t-"
+               << device.workersPerTile << "w-" << device.bytesPerTile << "B-" << partitioner << "-"
+               << model.cyclesPerCell << "c-" << model.cyclesPerHaloByte << "h-" << model.cyclesPerExchange << "x-v"
+               << PartitionerVersion;
+            return ss.str();
+        }
+    };
+
+    // The binary format: a PlanFileHeader, then the IPU, tile and worker slices as PlanFileSlices, then the
+    // transfers as PlanFileTransfers. Every record is fixed size and 8-byte aligned, so a memory-mapped file can be
+    // read in place (see MappedPlan). Integers are in the host's byte order
+    struct PlanFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t haloDepth;
+        uint64_t rows;
+        uint64_t cols;
+        uint32_t wrap;
+        uint32_t bytesPerCell;
+        uint32_t numIpus;
+        uint32_t tilesPerIpu;
+        uint32_t workersPerTile;
+        uint32_t partitionerVersion;
+        uint64_t bytesPerTile;
+        char partitioner[16];
+        double cyclesPerCell;
+        double cyclesPerHaloByte;
+        double cyclesPerExchange;
+        uint64_t numIpuSlices;
+        uint64_t numTileSlices;
+        uint64_t numWorkerSlices;
+        uint64_t numTransfers;
+    };
+
+    struct PlanFileSlice {
+        uint32_t ipu;
+        uint32_t tile;
+        uint32_t worker;
+        uint32_t reserved;
+        uint64_t rowsFrom;
+        uint64_t rowsTo;
+        uint64_t colsFrom;
+        uint64_t colsTo;
+    };
+
+    struct PlanFileTransfer {
+        uint32_t sourceIpu;
+        uint32_t sourceTile;
+        uint32_t sourceWorker;
+        uint32_t destinationIpu;
+        uint32_t destinationTile;
+        uint32_t destinationWorker;
+        uint64_t rowsFrom;
+        uint64_t rowsTo;
+        uint64_t colsFrom;
+        uint64_t colsTo;
+        int64_t rowOffset;
+        int64_t colOffset;
+    };
+
+    static_assert(sizeof(PlanFileHeader) == 136 && sizeof(PlanFileSlice) == 48 && sizeof(PlanFileTransfer) == 72,
+                  "The plan file records must not be padded");
+
+    constexpr char PlanFileMagic[8] = {'G', 'R', 'I', 'D', 'P', 'L', 'A', 'N'};
+    constexpr auto PlanFileVersion = 2u;
+
+    /**
+     * A grid split into IPU, tile and worker slices, and the halo transfers between the tiles. Building one for a
+     * big grid on many IPUs means partitioning tens of thousands of tiles and working out their halos, so save it
+     * (or use a PlanCache) and load it on later runs instead
+     */
+    class PartitionPlan {
+        static auto toRecord(const PartitioningTarget &target, const Slice2D &slice) -> PlanFileSlice {
+            return {(uint32_t) target.ipu(), (uint32_t) target.tile(), (uint32_t) target.worker(), 0,
+                    slice.rows().from(), slice.rows().to(), slice.cols().from(), slice.cols().to()};
+        }
+
+        static auto fromRecords(const PlanFileSlice *records, const size_t count, const size_t tilesPerIpu,
+                                const size_t workersPerTile) -> GridPartitioning {
+            auto result = GridPartitioning{tilesPerIpu, workersPerTile};
+            result.reserve(count);
+            for (auto i = 0ul; i < count; i++) {
+                const auto &r = records[i];
+                result.insert({PartitioningTarget{r.ipu, r.tile, r.worker},
+                               {{r.rowsFrom, r.rowsTo}, {r.colsFrom, r.colsTo}}});
+            }
+            return result;
+        }
+
+        /** Splits the tiles between their workers and plans the halo transfers between them */
+        static auto withTiles(const PlanKey &key, GridPartitioning ipus, GridPartitioning tiles) -> PartitionPlan {
+            auto plan = PartitionPlan{key, std::move(ipus), std::move(tiles)};
+            plan.workers = toWorkerPartitions(plan.tiles, key.device.workersPerTile);
+            plan.transfers = coalesceHaloTransfers(haloTransfers(plan.tiles, key.gridSize, key.haloDepth,
+                                                                 key.wrap));
+            return plan;
+        }
+
+    public:
+        PlanKey key;
+        GridPartitioning ipus;
+        GridPartitioning tiles;
+        GridPartitioning workers;
+        std::vector<HaloTransfer> transfers;
+
+        /**
+         * Partitions the grid for the key's device with the key's cost model, or returns nullopt if it doesn't fit.
+         * The key's partitioner must be CostModelPartitioner
+         */
+        static auto build(const PlanKey &key) -> std::optional<PartitionPlan> {
+            if (key.partitioner != CostModelPartitioner) {
+                throw std::invalid_argument("PartitionPlan::build can't make '" + key.partitioner +
+                                            "' plans; use PartitionPlan::fromTiles");
+            }
+            const auto &device = key.device;
+            const auto maxCellsPerTile = device.maxCellsPerTile(key.bytesPerCell);
+            auto ipus = partitionForIpus(key.gridSize, device.numIpus, device.tilesPerIpu * maxCellsPerTile);
+            if (!ipus.has_value()) return std::nullopt;
+            auto tiles = toTilePartitions(*ipus, device.tilesPerIpu, DefaultMinRowsPerTile, DefaultMinColsPerTile,
+                                          key.costModel(), maxCellsPerTile);
+            return withTiles(key, std::move(*ipus), std::move(tiles));
+        }
+
+        /**
+         * The plan for a tile layout made some other way (name it with the key's partitioner). Each IPU's slice is
+         * the bounding box of its tiles' slices, so the tiles on an IPU should cover a rectangle
+         */
+        static auto fromTiles(const PlanKey &key, GridPartitioning tiles) -> PartitionPlan {
+            auto bounds = std::map<size_t, Slice2D>{};
+            for (const auto &[target, slice]: tiles) {
+                const auto [it, added] = bounds.insert({target.ipu(), slice});
+                if (!added) {
+                    const auto &b = it->second;
+                    it->second = {{min(b.rows().from(), slice.rows().from()), max(b.rows().to(), slice.rows().to())},
+                                  {min(b.cols().from(), slice.cols().from()), max(b.cols().to(), slice.cols().to())}};
+                }
+            }
+            auto ipus = GridPartitioning{key.device.tilesPerIpu, key.device.workersPerTile};
+            for (const auto &[ipu, slice]: bounds) ipus.insert({PartitioningTarget{ipu}, slice});
+            return withTiles(key, std::move(ipus), std::move(tiles));
+        }
+
+        auto save(const fs::path &path) const -> void {
+            auto header = PlanFileHeader{};
+            std::memcpy(header.magic, PlanFileMagic, sizeof(PlanFileMagic));
+            header.version = PlanFileVersion;
+            header.haloDepth = key.haloDepth;
+            header.rows = key.gridSize.rows();
+            header.cols = key.gridSize.cols();
+            header.wrap = key.wrap;
+            header.bytesPerCell = key.bytesPerCell;
+            header.numIpus = key.device.numIpus;
+            header.tilesPerIpu = key.device.tilesPerIpu;
+            header.workersPerTile = key.device.workersPerTile;
+            header.partitionerVersion = PartitionerVersion;
+            header.bytesPerTile = key.device.bytesPerTile;
+            if (key.partitioner.size() >= sizeof(header.partitioner)) {
+                throw std::invalid_argument("The partitioner name '" + key.partitioner + "' is too long");
+            }
+            std::memcpy(header.partitioner, key.partitioner.data(), key.partitioner.size()); // Zero-padded
+            header.cyclesPerCell = key.model.cyclesPerCell;
+            header.cyclesPerHaloByte = key.model.cyclesPerHaloByte;
+            header.cyclesPerExchange = key.model.cyclesPerExchange;
+            header.numIpuSlices = ipus.size();
+            header.numTileSlices = tiles.size();
+            header.numWorkerSlices = workers.size();
+            header.numTransfers = transfers.size();
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            for (const auto *partitioning: {&ipus, &tiles, &workers}) {
+                auto records = std::vector<PlanFileSlice>{};
+                records.reserve(partitioning->size());
+                for (const auto &[target, slice]: *partitioning) records.push_back(toRecord(target, slice));
+                file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(PlanFileSlice));
+            }
+            auto records = std::vector<PlanFileTransfer>{};
+            records.reserve(transfers.size());
+            for (const auto &t: transfers) {
+                records.push_back({(uint32_t) t.source.ipu(), (uint32_t) t.source.tile(),
+                                   (uint32_t) t.source.worker(), (uint32_t) t.destination.ipu(),
+                                   (uint32_t) t.destination.tile(), (uint32_t) t.destination.worker(),
+                                   t.region.rows().from(), t.region.rows().to(), t.region.cols().from(),
+                                   t.region.cols().to(), t.rowOffset, t.colOffset});
+            }
+            file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(PlanFileTransfer));
+            file.close(); // Flushes, so a failed write shows up in the stream's state
+            if (!file) throw std::runtime_error("Couldn't write the partition plan to " + path.string());
+        }
+
+        /**
+         * Reads a plan written by save, or returns nullopt if the file isn't a plan in this version's format or was
+         * built by another version of the partitioners
+         */
+        static auto load(const fs::path &path) -> std::optional<PartitionPlan> {
+            std::ifstream file(path, std::ios::binary);
+            auto header = PlanFileHeader{};
+            if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+                std::memcmp(header.magic, PlanFileMagic, sizeof(PlanFileMagic)) != 0 ||
+                header.version != PlanFileVersion || header.partitionerVersion != PartitionerVersion) {
+                return std::nullopt;
+            }
+            auto key = PlanKey{{header.rows, header.cols}, header.haloDepth, header.wrap != 0, header.bytesPerCell,
+                               {header.numIpus, header.tilesPerIpu, header.workersPerTile, header.bytesPerTile},
+                               std::string(header.partitioner, strnlen(header.partitioner,
+                                                                       sizeof(header.partitioner)))};
+            key.model.cyclesPerCell = header.cyclesPerCell;
+            key.model.cyclesPerHaloByte = header.cyclesPerHaloByte;
+            key.model.cyclesPerExchange = header.cyclesPerExchange;
+            auto partitionings = std::vector<GridPartitioning>{};
+            for (const auto count: {header.numIpuSlices, header.numTileSlices, header.numWorkerSlices}) {
+                auto records = std::vector<PlanFileSlice>(count);
+                if (!file.read(reinterpret_cast<char *>(records.data()), count * sizeof(PlanFileSlice))) {
+                    return std::nullopt;
+                }
+                partitionings.push_back(fromRecords(records.data(), count, header.tilesPerIpu,
+                                                    header.workersPerTile));
+            }
+            auto records = std::vector<PlanFileTransfer>(header.numTransfers);
+            if (!file.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(PlanFileTransfer))) {
+                return std::nullopt;
+            }
+            auto plan = PartitionPlan{key, partitionings[0], partitionings[1], partitionings[2]};
+            plan.transfers.reserve(records.size());
+            for (const auto &r: records) {
+                plan.transfers.push_back({PartitioningTarget{r.sourceIpu, r.sourceTile, r.sourceWorker},
+                                          PartitioningTarget{r.destinationIpu, r.destinationTile,
+                                                             r.destinationWorker},
+                                          {{r.rowsFrom, r.rowsTo}, {r.colsFrom, r.colsTo}},
+                                          r.rowOffset, r.colOffset});
+            }
+            return plan;
+        }
+
+        /** The plan as JSON, for reading or for tools that don't want to parse the binary format */
+        auto writeJson(const fs::path &path) const -> void {
+            std::ofstream file(path);
+            const auto writeSlices = [&](const std::string &name, const GridPartitioning &partitioning) {
+                file << "  \"" << name << "\": [";
+                auto comma = false;
+                for (const auto &[target, slice]: partitioning) {
+                    file << (comma ? "," : "") << std::endl << "    {\"ipu\": " << target.ipu() << ", \"tile\": "
+                         << target.tile() << ", \"worker\": " << target.worker() << ", \"rows\": ["
+                         << slice.rows().from() << ", " << slice.rows().to() << "], \"cols\": ["
+                         << slice.cols().from() << ", " << slice.cols().to() << "]}";
+                    comma = true;
+                }
+                file << std::endl << "  ]," << std::endl;
+            };
+            file << "{" << std::endl;
+            file << "  \"rows\": " << key.gridSize.rows() << ", \"cols\": " << key.gridSize.cols()
+                 << ", \"haloDepth\": " << key.haloDepth << ", \"wrap\": " << (key.wrap ? "true" : "false")
+                 << ", \"bytesPerCell\": " << key.bytesPerCell << "," << std::endl;
+            file << "  \"partitioner\": \"" << key.partitioner << "\", \"partitionerVersion\": "
+                 << PartitionerVersion << ", \"model\": {\"cyclesPerCell\": " << key.model.cyclesPerCell
+                 << ", \"cyclesPerHaloByte\": " << key.model.cyclesPerHaloByte << ", \"cyclesPerExchange\": "
+                 << key.model.cyclesPerExchange << "}," << std::endl;
+            file << "  \"device\": {\"numIpus\": " << key.device.numIpus << ", \"tilesPerIpu\": "
+                 << key.device.tilesPerIpu << ", \"workersPerTile\": " << key.device.workersPerTile
+                 << ", \"bytesPerTile\": " << key.device.bytesPerTile << "}," << std::endl;
+            writeSlices("ipus", ipus);
+            writeSlices("tiles", tiles);
+            writeSlices("workers", workers);
+            file << "  \"transfers\": [";
+            auto comma = false;
+            for (const auto &t: transfers) {
+                file << (comma ? "," : "") << std::endl << "    {\"from\": [" << t.source.ipu() << ", "
+                     << t.source.tile() << "], \"to\": [" << t.destination.ipu() << ", " << t.destination.tile()
+                     << "], \"rows\": [" << t.region.rows().from() << ", " << t.region.rows().to()
+                     << "], \"cols\": [" << t.region.cols().from() << ", " << t.region.cols().to()
+                     << "], \"offset\": [" << t.rowOffset << ", " << t.colOffset << "]}";
+                comma = true;
+            }
+            file << std::endl << "  ]" << std::endl << "}" << std::endl;
+        }
+    };
+
+    /**
+     * A plan file mapped read-only into memory, so tools can look at its records in place without loading it.
+     * The records stay valid for the MappedPlan's lifetime
+     */
+    class MappedPlan {
+        void *t_data = MAP_FAILED;
+        size_t t_bytes = 0;
+
+        template<typename T>
+        struct Records {
+            const T *data;
+            size_t count;
+
+            [[nodiscard]] auto begin() const -> const T * { return data; }
+
+            [[nodiscard]] auto end() const -> const T * { return data + count; }
+
+            [[nodiscard]] auto size() const -> size_t { return count; }
+
+            auto operator[](const size_t i) const -> const T & { return data[i]; }
+        };
+
+        [[nodiscard]] auto bytes() const -> const char * { return static_cast<const char *>(t_data); }
+
+        [[nodiscard]] auto slices(const size_t before, const size_t count) const -> Records<PlanFileSlice> {
+            return {reinterpret_cast<const PlanFileSlice *>(bytes() + sizeof(PlanFileHeader) +
+                                                            before * sizeof(PlanFileSlice)), count};
+        }
+
+    public:
+        explicit MappedPlan(const fs::path &path) {
+            const auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Can't open the partition plan " + path.string());
+            struct stat info{};
+            if (::fstat(fd, &info) == 0 && (size_t) info.st_size >= sizeof(PlanFileHeader)) {
+                t_bytes = info.st_size;
+                t_data = ::mmap(nullptr, t_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (t_data == MAP_FAILED) throw std::runtime_error("Can't map the partition plan " + path.string());
+            const auto &h = header();
+            const auto expected = sizeof(PlanFileHeader) +
+                                  (h.numIpuSlices + h.numTileSlices + h.numWorkerSlices) * sizeof(PlanFileSlice) +
+                                  h.numTransfers * sizeof(PlanFileTransfer);
+            if (std::memcmp(h.magic, PlanFileMagic, sizeof(PlanFileMagic)) != 0 || h.version != PlanFileVersion ||
+                t_bytes != expected) {
+                ::munmap(t_data, t_bytes);
+                throw std::runtime_error(path.string() + " isn't a version " + std::to_string(PlanFileVersion) +
+                                         " partition plan");
+            }
+        }
+
+        MappedPlan(const MappedPlan &) = delete;
+
+        auto operator=(const MappedPlan &) -> MappedPlan & = delete;
+
+        ~MappedPlan() { ::munmap(t_data, t_bytes); }
+
+        [[nodiscard]] auto header() const -> const PlanFileHeader & {
+            return *reinterpret_cast<const PlanFileHeader *>(bytes());
+        }
+
+        [[nodiscard]] auto ipuSlices() const -> Records<PlanFileSlice> { return slices(0, header().numIpuSlices); }
+
+        [[nodiscard]] auto tileSlices() const -> Records<PlanFileSlice> {
+            return slices(header().numIpuSlices, header().numTileSlices);
+        }
+
+        [[nodiscard]] auto workerSlices() const -> Records<PlanFileSlice> {
+            return slices(header().numIpuSlices + header().numTileSlices, header().numWorkerSlices);
+        }
+
+        [[nodiscard]] auto transfers() const -> Records<PlanFileTransfer> {
+            const auto &h = header();
+            const auto offset = sizeof(PlanFileHeader) +
+                                (h.numIpuSlices + h.numTileSlices + h.numWorkerSlices) * sizeof(PlanFileSlice);
+            return {reinterpret_cast<const PlanFileTransfer *>(bytes() + offset), h.numTransfers};
+        }
+    };
+
+    /**
+     * An on-disk cache of partition plans, one file per PlanKey, so repeated launches of the same job skip
+     * partitioning and halo planning. Configure with IPU_PLAN_CACHE_DIR (default "plan-cache"); setting it to the
+     * empty string disables the cache
+     */
+    class PlanCache {
+        fs::path t_dir;
+
+    public:
+        static constexpr auto DefaultDir = "plan-cache";
+
+        explicit PlanCache(const fs::path &dir = DefaultDir) : t_dir(dir) {}
+
+        static auto fromEnvironment() -> PlanCache {
+            const auto dir = getenv("IPU_PLAN_CACHE_DIR");
+            return PlanCache{dir != nullptr ? fs::path{dir} : fs::path{DefaultDir}};
+        }
+
+        [[nodiscard]] auto enabled() const -> bool { return !t_dir.empty(); }
+
+        [[nodiscard]] auto pathFor(const PlanKey &key) const -> fs::path { return t_dir / (key.str() + ".plan"); }
+
+        using Builder = std::function<std::optional<PartitionPlan>(const PlanKey &)>;
+
+        /**
+         * Loads the plan for this key, or builds it with build (PartitionPlan::build unless the key names another
+         * partitioner) and stores it. nullopt if the grid doesn't fit
+         */
+        auto getOrBuild(const PlanKey &key, const Builder &build = PartitionPlan::build) const
+        -> std::optional<PartitionPlan> {
+            if (!enabled()) return build(key);
+
+            const auto path = pathFor(key);
+            if (fs::exists(path)) {
+                if (auto plan = PartitionPlan::load(path); plan.has_value() && plan->key.str() == key.str()) {
+                    std::cout << "Plan cache hit [" << key.str() << "]" << std::endl;
+                    return plan;
+                }
+                std::cerr << "Plan cache entry " << path << " could not be loaded, rebuilding it" << std::endl;
+            } else {
+                std::cout << "Plan cache miss [" << key.str() << "]" << std::endl;
+            }
+            auto plan = build(key);
+            if (plan.has_value()) {
+                fs::create_directories(t_dir);
+                // Jobs missing on the same key each write their own file, so they can't interleave their writes
+                const auto tmpPath = ipu::uniqueTempPath(path);
+                try {
+                    plan->save(tmpPath);
+                } catch (const std::runtime_error &e) {
+                    std::error_code ec;
+                    fs::remove(tmpPath, ec);
+                    std::cerr << "Plan cache couldn't store [" << key.str() << "]: " << e.what() << std::endl;
+                    return plan;
+                }
+                fs::rename(tmpPath, path); // So a concurrent job never reads a half-written plan
+            }
+            return plan;
+        }
+    };
+
+}
+
+#endif
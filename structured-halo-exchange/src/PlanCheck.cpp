@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "StructuredGridUtils.hpp"
+#include "PartitionPlan.hpp"
+
+namespace {
+    using Grid = std::vector<std::vector<double>>;
+
+    /**
+     * sweeps of the Moore neighbourhood average over the activeRows x activeCols corner of the whole grid, with a
+     * boundary of zeros or wrapping around. This is what every strategy should compute
+     */
+    auto referenceSweeps(Grid grid, const unsigned sweeps, const size_t activeRows, const size_t activeCols,
+                         const bool wrap) -> Grid {
+        const auto rows = (long) grid.size();
+        const auto cols = (long) grid[0].size();
+        for (auto sweep = 0u; sweep < sweeps; sweep++) {
+            auto next = grid;
+            for (auto y = 0l; y < std::min(rows, (long) activeRows); y++) {
+                for (auto x = 0l; x < std::min(cols, (long) activeCols); x++) {
+                    auto sum = 0.0;
+                    for (auto dy = -1; dy <= 1; dy++) {
+                        for (auto dx = -1; dx <= 1; dx++) {
+                            auto yy = y + dy;
+                            auto xx = x + dx;
+                            if (wrap) {
+                                yy = (yy + rows) % rows;
+                                xx = (xx + cols) % cols;
+                            } else if (yy < 0 || yy >= rows || xx < 0 || xx >= cols) {
+                                continue;
+                            }
+                            sum += grid[yy][xx];
+                        }
+                    }
+                    next[y][x] = sum / 9;
+                }
+            }
+            grid = next;
+        }
+        return grid;
+    }
+
+    /**
+     * Counts the halo cells that the plan's transfers don't fill exactly once from the tile that owns them, plus any
+     * cells they fill that aren't in a halo
+     */
+    auto coverageErrors(const grids::PartitionPlan &plan) -> size_t {
+        const auto rows = (int64_t) plan.key.gridSize.rows();
+        const auto cols = (int64_t) plan.key.gridSize.cols();
+        const auto depth = (int64_t) plan.key.haloDepth;
+        const auto owners = grids::CellOwners{plan.tiles};
+        const auto sameTile = [](const grids::PartitioningTarget &a, const grids::PartitioningTarget &b) {
+            return a.ipu() == b.ipu() && a.tile() == b.tile();
+        };
+
+        auto errors = 0ul;
+        auto filled = std::map<std::tuple<size_t, size_t, int64_t, int64_t>, unsigned>{};
+        for (const auto &t: plan.transfers) {
+            for (auto r = t.region.rows().from(); r < t.region.rows().to(); r++) {
+                for (auto c = t.region.cols().from(); c < t.region.cols().to(); c++) {
+                    if (const auto owner = owners.ownerOf(r, c); !owner.has_value() || !sameTile(*owner, t.source)) {
+                        errors++;
+                    }
+                    const auto haloRow = t.rowOffset + (int64_t) (r - t.region.rows().from());
+                    const auto haloCol = t.colOffset + (int64_t) (c - t.region.cols().from());
+                    filled[{t.destination.ipu(), t.destination.tile(), haloRow, haloCol}]++;
+                }
+            }
+        }
+
+        auto expected = 0ul;
+        for (const auto &[destination, slice]: plan.tiles) {
+            const auto height = (int64_t) slice.height();
+            const auto width = (int64_t) slice.width();
+            for (auto dr = -depth; dr < height + depth; dr++) {
+                for (auto dc = -depth; dc < width + depth; dc++) {
+                    if (dr >= 0 && dr < height && dc >= 0 && dc < width) continue;
+                    auto r = (int64_t) slice.rows().from() + dr;
+                    auto c = (int64_t) slice.cols().from() + dc;
+                    if (!plan.key.wrap && (r < 0 || r >= rows || c < 0 || c >= cols)) continue;
+                    r = (r % rows + rows) % rows;
+                    c = (c % cols + cols) % cols;
+                    expected++;
+                    const auto it = filled.find({destination.ipu(), destination.tile(), dr, dc});
+                    if (it == filled.end() || it->second != 1) errors++;
+                }
+            }
+        }
+        auto total = 0ul;
+        for (const auto &[cell, count]: filled) total += count;
+        return errors + (total > expected ? total - expected : 0);
+    }
+
+    /**
+     * Runs partitionedHaloStrategy's programs on the host: per-tile blocks with haloDepth-deep halos, filled with
+     * the tile number, exchanged with the plan's transfers, and swept like the DeepHaloSweep vertex does. Returns
+     * the biggest difference from referenceSweeps after numIters iterations (2 sweeps each)
+     */
+    auto simulationError(const grids::PartitionPlan &plan, const unsigned numIters, const size_t activeRows,
+                         const size_t activeCols) -> double {
+        const auto k = plan.key.haloDepth;
+        const auto &tiles = plan.tiles;
+        auto grid = Grid(plan.key.gridSize.rows(), std::vector<double>(plan.key.gridSize.cols()));
+        auto in = std::vector<Grid>{};
+        for (const auto &[target, slice]: tiles) {
+            const auto value = (double) target.virtualTile(plan.key.device.tilesPerIpu) + 1;
+            auto block = Grid(slice.height() + 2 * k, std::vector<double>(slice.width() + 2 * k, 0.0));
+            for (auto y = 0ul; y < slice.height(); y++) {
+                for (auto x = 0ul; x < slice.width(); x++) {
+                    block[y + k][x + k] = value;
+                    grid[slice.rows().from() + y][slice.cols().from() + x] = value;
+                }
+            }
+            in.push_back(block);
+        }
+        auto out = in;
+
+        // Like a single Copy: every source is read before any halo is written
+        const auto exchange = [&](std::vector<Grid> &blocks) {
+            auto cells = std::vector<double>{};
+            for (const auto &t: plan.transfers) {
+                const auto source = tiles.find(t.source);
+                const auto row = t.region.rows().from() - source->second.rows().from() + k;
+                const auto col = t.region.cols().from() - source->second.cols().from() + k;
+                for (auto y = 0ul; y < t.region.height(); y++) {
+                    for (auto x = 0ul; x < t.region.width(); x++) {
+                        cells.push_back(blocks[source - tiles.begin()][row + y][col + x]);
+                    }
+                }
+            }
+            auto next = cells.begin();
+            for (const auto &t: plan.transfers) {
+                const auto destination = tiles.find(t.destination);
+                const auto row = (size_t) (t.rowOffset + (int64_t) k);
+                const auto col = (size_t) (t.colOffset + (int64_t) k);
+                for (auto y = 0ul; y < t.region.height(); y++) {
+                    for (auto x = 0ul; x < t.region.width(); x++) {
+                        blocks[destination - tiles.begin()][row + y][col + x] = *next++;
+                    }
+                }
+            }
+        };
+
+        const auto sweep = [&](const std::vector<Grid> &from, std::vector<Grid> &to, const int margin) {
+            auto i = 0ul;
+            for (const auto &[target, slice]: tiles) {
+                const auto &a = from[i];
+                auto &b = to[i];
+                const auto rows = (int) a.size();
+                const auto cols = (int) a[0].size();
+                const auto originRow = (int) slice.rows().from() - (int) k;
+                const auto originCol = (int) slice.cols().from() - (int) k;
+                const auto rowsEnd = std::min(rows - margin, (int) activeRows - originRow);
+                const auto colsEnd = std::min(cols - margin, (int) activeCols - originCol);
+                for (auto y = std::max(margin, -originRow); y < rowsEnd; y++) {
+                    for (auto x = std::max(margin, -originCol); x < colsEnd; x++) {
+                        auto sum = 0.0;
+                        for (auto dy = -1; dy <= 1; dy++) {
+                            for (auto dx = -1; dx <= 1; dx++) sum += a[y + dy][x + dx];
+                        }
+                        b[y][x] = sum / 9;
+                    }
+                }
+                i++;
+            }
+        };
+
+        // An exchange into t's halos, then k sweeps bouncing between t and other. Returns where the result ended up
+        const auto exchangeAndSweeps = [&](std::vector<Grid> &t, std::vector<Grid> &other) -> std::vector<Grid> * {
+            exchange(t);
+            for (auto s = 1u; s <= k; s++) {
+                if (s % 2 == 1) {
+                    sweep(t, other, (int) s);
+                } else {
+                    sweep(other, t, (int) s);
+                }
+            }
+            return k % 2 == 0 ? &t : &other;
+        };
+
+        exchange(in);
+        exchange(out);
+        auto *current = &in;
+        auto *spare = &out;
+        for (auto phase = 0u; phase < 2 * numIters / k; phase++) {
+            auto *result = exchangeAndSweeps(*current, *spare);
+            if (result != current) std::swap(current, spare);
+        }
+
+        const auto expected = referenceSweeps(grid, 2 * numIters, activeRows, activeCols, plan.key.wrap);
+        auto error = 0.0;
+        auto i = 0ul;
+        for (const auto &[target, slice]: tiles) {
+            for (auto y = 0ul; y < slice.height(); y++) {
+                for (auto x = 0ul; x < slice.width(); x++) {
+                    error = std::max(error, std::abs((*current)[i][y + k][x + k] -
+                                                     expected[slice.rows().from() + y][slice.cols().from() + x]));
+                }
+            }
+            i++;
+        }
+        return error;
+    }
+
+    /** Each IPU's tiles' slices, split again between workers, as a layout with a tile per worker */
+    auto tilePerWorker(const grids::GridPartitioning &tiles, const size_t workersPerTile) -> grids::GridPartitioning {
+        auto result = grids::GridPartitioning{tiles.tilesPerIpu() * workersPerTile, 1};
+        for (const auto &[target, slice]: grids::toWorkerPartitions(tiles, workersPerTile)) {
+            result.insert({grids::PartitioningTarget{target.ipu(), target.tile() * workersPerTile + target.worker()},
+                           slice});
+        }
+        return result;
+    }
+}
+
+/**
+ * Checks the halo exchange planner on the host, without a device: for a regular block layout, a single column and
+ * a single row of tiles, the cost model's partitioning and a layout with a tile per worker, at halo depths 1 to 3
+ * (and wrapping around at depth 1), every halo cell must be filled exactly once from its owner, and running the
+ * deep halo stencil over the plan must match sweeping the whole grid, both over the whole grid and over a smaller
+ * active region
+ */
+int main() {
+    constexpr auto numIters = 6u;
+    const auto gridSize = grids::Size2D{37, 29};
+    const auto device = grids::PartitioningDevice{2, 6, 6, grids::DefaultBytesPerTile};
+    constexpr auto bytesPerCell = 2 * sizeof(float);
+
+    // 4 rows of 2 blocks, the last row and column a cell bigger so that not every block is the same size
+    auto blocks = grids::GridPartitioning{device.tilesPerIpu, 1};
+    for (auto t = 0ul; t < 8; t++) {
+        const auto row = t / 2 * 9;
+        const auto col = t % 2 * 14;
+        blocks.insert({grids::PartitioningTarget{t / 4, t % 4},
+                       {{row, row + (t / 2 == 3 ? 10 : 9)}, {col, col + (t % 2 == 1 ? 15 : 14)}}});
+    }
+
+    // A single column and a single row of tiles, one per IPU, whose halos wrap onto their own opposite edges
+    auto column = grids::GridPartitioning{device.tilesPerIpu, 1};
+    column.insert({grids::PartitioningTarget{0, 0}, {{0, 18}, {0, gridSize.cols()}}});
+    column.insert({grids::PartitioningTarget{1, 0}, {{18, gridSize.rows()}, {0, gridSize.cols()}}});
+    auto row = grids::GridPartitioning{device.tilesPerIpu, 1};
+    row.insert({grids::PartitioningTarget{0, 0}, {{0, gridSize.rows()}, {0, 13}}});
+    row.insert({grids::PartitioningTarget{1, 0}, {{0, gridSize.rows()}, {13, gridSize.cols()}}});
+    const auto layouts = std::map<std::string, grids::GridPartitioning>{{"blocks", blocks}, {"column", column},
+                                                                        {"row", row}};
+
+    auto failures = 0u;
+    for (const auto *partitioner: {"blocks", "column", "row", grids::CostModelPartitioner, "tilePerWorker"}) {
+        for (const auto haloDepth: {1ul, 2ul, 3ul}) {
+            for (const auto wrap: {false, true}) {
+                if (wrap && haloDepth > 1) continue; // partitionedHaloStrategy only wraps 1-deep halos
+                auto key = grids::PlanKey{gridSize, haloDepth, wrap, bytesPerCell, device};
+                auto plan = grids::PartitionPlan::build(key);
+                if (!plan.has_value()) {
+                    std::cerr << "Couldn't partition " << key.str() << std::endl;
+                    return EXIT_FAILURE;
+                }
+                key.partitioner = partitioner;
+                if (const auto layout = layouts.find(key.partitioner); layout != layouts.end()) {
+                    plan = grids::PartitionPlan::fromTiles(key, layout->second);
+                } else if (key.partitioner == "tilePerWorker") {
+                    key.device.tilesPerIpu *= device.workersPerTile;
+                    plan = grids::PartitionPlan::fromTiles(key, tilePerWorker(plan->tiles, device.workersPerTile));
+                }
+
+                const auto coverage = coverageErrors(*plan);
+                const auto whole = simulationError(*plan, numIters, gridSize.rows(), gridSize.cols());
+                const auto partial = wrap ? 0.0 : simulationError(*plan, numIters, 20, 25);
+                const auto ok = coverage == 0 && whole < 1e-9 && partial < 1e-9;
+                failures += ok ? 0 : 1;
+                std::cout << (ok ? "ok     " : "FAILED ") << key.str() << ": " << plan->tiles.size() << " tiles, "
+                          << plan->transfers.size() << " transfers, " << coverage << " halo cells wrong, error "
+                          << whole << " over the whole grid";
+                if (!wrap) std::cout << " and " << partial << " over 20x25";
+                std::cout << std::endl;
+            }
+        }
+    }
+    if (failures > 0) {
+        std::cerr << failures << " plans failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "cxxopts.hpp"
+#include "StructuredGridUtils.hpp"
+#include "PartitionPlan.hpp"
+#include "CommonIpuUtils.hpp"
+
+namespace {
+    auto printSummary(const grids::PlanFileHeader &header) -> void {
+        std::cout << header.rows << "x" << header.cols << " grid, " << header.haloDepth << "-deep "
+                  << (header.wrap ? "periodic " : "") << "halos, " << header.bytesPerCell << " bytes per cell on "
+                  << header.numIpus << " IPUs of " << header.tilesPerIpu << " tiles (" << header.workersPerTile
+                  << " workers, " << header.bytesPerTile << " bytes each)" << std::endl;
+        std::cout << "  " << std::string(header.partitioner, strnlen(header.partitioner, sizeof(header.partitioner)))
+                  << " partitioner (version " << header.partitionerVersion << "), " << header.cyclesPerCell
+                  << " cycles per cell, " << header.cyclesPerHaloByte << " per halo byte, " << header.cyclesPerExchange
+                  << " per exchange" << std::endl;
+        std::cout << "  " << header.numIpuSlices << " IPU slices, " << header.numTileSlices << " tile slices, "
+                  << header.numWorkerSlices << " worker slices, " << header.numTransfers << " halo transfers"
+                  << std::endl;
+    }
+}
+
+/**
+ * Builds (or fetches from the plan cache) the partitioning and halo transfers for a grid on a target, and
+ * optionally writes them as JSON. With --inspect, prints a summary of an existing plan file by memory-mapping it
+ */
+int main(int argc, char *argv[]) {
+    std::string gridSize = "1024x1024";
+    std::string deviceSpec;
+    std::string jsonFile;
+    std::string inspectFile;
+    unsigned haloDepth = 1u;
+    unsigned bytesPerCell = sizeof(float);
+    double cyclesPerCell = 1.0;
+    bool periodic = false;
+
+    cxxopts::Options options(argv[0], " - Builds and caches the partitioning and halo exchange plan for a grid");
+    options.add_options()
+            ("s,size", "Grid size as <rows>x<cols>", cxxopts::value<std::string>(gridSize)->default_value("1024x1024"))
+            ("halo-depth", "Cells of halo on each side", cxxopts::value<unsigned>(haloDepth)->default_value("1"))
+            ("bytes-per-cell", "Bytes of tile memory each cell needs",
+             cxxopts::value<unsigned>(bytesPerCell)->default_value("4"))
+            ("cycles-per-cell", "The cost model's cycles for a tile to update one cell",
+             cxxopts::value<double>(cyclesPerCell)->default_value("1"))
+            ("periodic", "Wrap the halos around the edges of the grid instead of using a fixed boundary")
+            ("json", "Also write the plan as JSON to this file", cxxopts::value<std::string>(jsonFile))
+            ("inspect", "Print a summary of this plan file instead of building one",
+             cxxopts::value<std::string>(inspectFile))
+            ("device", "Device spec [auto|hw|model:]{mk1,mk2}[:<ipus>[x<tiles>]] to plan for, e.g. mk2:16 "
+                       "(defaults to $IPU_DEVICE or one IPU)",
+             cxxopts::value<std::string>(deviceSpec));
+
+    auto size = grids::Size2D{1, 1};
+    try {
+        auto opts = options.parse(argc, argv);
+        periodic = opts["periodic"].as<bool>();
+        const auto x = gridSize.find('x');
+        if (x == std::string::npos || haloDepth == 0 || bytesPerCell == 0) {
+            std::cerr << options.help() << std::endl;
+            return EXIT_FAILURE;
+        }
+        size = {std::stoul(gridSize.substr(0, x)), std::stoul(gridSize.substr(x + 1))};
+    } catch (cxxopts::OptionParseException &) {
+        std::cerr << options.help() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!inspectFile.empty()) {
+        const auto plan = grids::MappedPlan{inspectFile};
+        printSummary(plan.header());
+        auto cells = 0ul;
+        for (const auto &transfer: plan.transfers()) {
+            cells += (transfer.rowsTo - transfer.rowsFrom) * (transfer.colsTo - transfer.colsFrom);
+        }
+        std::cout << "  " << cells << " halo cells cross between tiles each exchange" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    // Planning only needs the target's shape, so an IPUModel of the requested device will do
+    const auto spec = deviceSpec.empty() ? ipu::DeviceSpec::fromEnvironment() : ipu::DeviceSpec::parse(deviceSpec);
+    const auto device = ipu::getIpuModel(spec);
+    const auto key = grids::PlanKey::forTarget(size, device.getTarget(), bytesPerCell, haloDepth, periodic,
+                                               cyclesPerCell);
+
+    const auto cache = grids::PlanCache::fromEnvironment();
+    const auto start = std::chrono::steady_clock::now();
+    const auto plan = cache.getOrBuild(key);
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!plan.has_value()) {
+        std::cerr << "A " << gridSize << " grid doesn't fit on " << spec.toString() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Planned " << key.str() << " in " << seconds << "s";
+    if (cache.enabled()) std::cout << " (" << cache.pathFor(key).string() << ")";
+    std::cout << std::endl;
+
+    if (!jsonFile.empty()) {
+        plan->writeJson(jsonFile);
+        std::cout << "Wrote " << jsonFile << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -17,6 +17,19 @@
 #include <cmath>
 #include <functional>
 #include <fstream>
+#include <tuple>
+#include <limits>
+#include <future>
+#include <thread>
+#include <array>
+#include <cstdint>
+#include <poplar/Target.hpp>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <iterator>
+#include <vector>
+#include <algorithm>
 
 
 using namespace std;
@@ -87,10 +100,92 @@ namespace grids {
         }
     };
 
+    class Size3D {
+    private:
+        size_t t_depth;
+        size_t t_rows;
+        size_t t_cols;
+    public:
+
+        Size3D(size_t depth, size_t rows, size_t cols) : t_depth(depth), t_rows(rows), t_cols(cols) {
+            assert(depth > 0);
+            assert(rows > 0);
+            assert(cols > 0);
+        }
+
+        [[nodiscard]] size_t depth() const { return t_depth; }
+
+        [[nodiscard]] size_t rows() const { return t_rows; }
+
+        [[nodiscard]] size_t cols() const { return t_cols; }
+
+        [[nodiscard]] size_t cells() const { return t_depth * t_rows * t_cols; }
+    };
+
+    /** A brick of a 3D grid. Planes are indexed by depth, then rows, then cols, as in a {depth, rows, cols} tensor */
+    class Slice3D {
+    private:
+        Range t_planes;
+        Range t_rows;
+        Range t_cols;
+    public:
+        Slice3D(const Range planes, const Range rows, const Range cols) : t_planes(planes), t_rows(rows),
+                                                                          t_cols(cols) {}
+
+        [[nodiscard]] Range planes() const { return t_planes; }
+
+        [[nodiscard]] Range rows() const { return t_rows; }
+
+        [[nodiscard]] Range cols() const { return t_cols; }
+
+        [[nodiscard]] size_t depth() const { return t_planes.to() - t_planes.from(); }
+
+        [[nodiscard]] size_t height() const { return t_rows.to() - t_rows.from(); }
+
+        [[nodiscard]] size_t width() const { return t_cols.to() - t_cols.from(); }
+
+        [[nodiscard]] Size3D size() const { return Size3D{depth(), height(), width()}; }
+
+        [[nodiscard]] size_t cells() const { return depth() * height() * width(); }
+
+        static std::string print(const Slice3D &slice) {
+            std::stringstream ss;
+            ss << slice.depth() << "x" << slice.height() << "x" << slice.width() << " at  (plane:"
+               << slice.planes().from() << ",row:" << slice.rows().from() << ",col:" << slice.cols().from() << ")";
+            return ss.str();
+        }
+    };
+
     constexpr auto DefaultNumTilesPerIpu = 1216u;
     constexpr auto DefaultNumWorkersPerTile = 6u;
     constexpr auto DefaultMinRowsPerTile = 6u;
     constexpr auto DefaultMinColsPerTile = 6u;
+    // How many times more a halo cell costs to send over IPU-Link than to update on-chip. Tune for your system
+    constexpr auto DefaultInterIpuHaloCost = 8.0;
+    constexpr auto DefaultBytesPerTile = 256u * 1024u; // Mk1
+    constexpr auto DefaultReservedBytesPerTile = 64u * 1024u; // For code, stacks and exchange buffers
+
+    /**
+     * The parts of a device that shape a partitioning. Use fromTarget rather than the Mk1 defaults, so the same code
+     * partitions for Mk2 (1472 tiles with more memory each) or a virtual device using a subset of the tiles
+     */
+    struct PartitioningDevice {
+        size_t numIpus = 1;
+        size_t tilesPerIpu = DefaultNumTilesPerIpu;
+        size_t workersPerTile = DefaultNumWorkersPerTile;
+        size_t bytesPerTile = DefaultBytesPerTile;
+
+        static auto fromTarget(const poplar::Target &target) -> PartitioningDevice {
+            return {target.getNumIPUs(), target.getTilesPerIPU(), target.getNumWorkerContexts(),
+                    target.getBytesPerTile()};
+        }
+
+        /** How many cells of bytesPerCell (halos included) fit on one tile, leaving reservedBytes free */
+        [[nodiscard]] auto maxCellsPerTile(const size_t bytesPerCell,
+                                           const size_t reservedBytes = DefaultReservedBytesPerTile) const -> size_t {
+            return bytesPerTile > reservedBytes ? (bytesPerTile - reservedBytes) / bytesPerCell : 0;
+        }
+    };
 
 
     class PartitioningTarget {
@@ -115,22 +210,233 @@ namespace grids {
             return t_ipu * numTilesPerIpu + t_tile;
         }
 
+        /** Orders by ipu, then tile, then worker, whatever the device's size */
+        bool operator<(const PartitioningTarget &other) const {
+            return std::tie(t_ipu, t_tile, t_worker) < std::tie(other.t_ipu, other.t_tile, other.t_worker);
+        }
+
+        bool operator==(const PartitioningTarget &other) const {
+            return t_ipu == other.t_ipu && t_tile == other.t_tile && t_worker == other.t_worker;
+        }
 
     };
 
 
     struct PartitionTargetComparator {
         bool operator()(const grids::PartitioningTarget &lhs, const grids::PartitioningTarget &rhs) const {
-            auto l = lhs.ipu() * grids::DefaultNumTilesPerIpu * grids::DefaultNumWorkersPerTile +
-                     lhs.tile() * grids::DefaultNumWorkersPerTile + lhs.worker();
-            auto r = rhs.ipu() * grids::DefaultNumTilesPerIpu * grids::DefaultNumWorkersPerTile +
-                     rhs.tile() * grids::DefaultNumWorkersPerTile + rhs.worker();
-            return l < r;
+            return lhs < rhs;
+        }
+    };
+
+
+    /**
+     * The slices (Slice2D or Slice3D) of a grid assigned to each (ipu, tile, worker), stored contiguously in
+     * target order. It iterates
+     * like the std::map it replaced (for (const auto &[target, slice]: partitioning) ...), and finds a target's
+     * slice in O(1) through a dense index over the targets between the first and last. The index is laid out for
+     * tilesPerIpu x workersPerTile, which grows if a target doesn't fit, so it's right for any device.
+     * Inserting targets in order, as all the strategies here do, is O(1) amortised
+     */
+    template<typename Slice>
+    class BasicGridPartitioning {
+    public:
+        using value_type = std::pair<PartitioningTarget, Slice>;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+        using iterator = const_iterator;
+
+    private:
+        static constexpr auto None = std::numeric_limits<uint32_t>::max();
+
+        std::vector<value_type> t_entries;
+        size_t t_tilesPerIpu = DefaultNumTilesPerIpu;
+        size_t t_workersPerTile = DefaultNumWorkersPerTile;
+        size_t t_firstSlot = 0;
+        std::vector<uint32_t> t_index; // slot - t_firstSlot -> position in t_entries, or None
+
+        [[nodiscard]] auto slotOf(const PartitioningTarget &target) const -> size_t {
+            return (target.ipu() * t_tilesPerIpu + target.tile()) * t_workersPerTile + target.worker();
+        }
+
+        auto fits(const PartitioningTarget &target) const -> bool {
+            return target.tile() < t_tilesPerIpu && target.worker() < t_workersPerTile;
+        }
+
+        auto indexEntry(const size_t position) -> void {
+            const auto slot = slotOf(t_entries[position].first);
+            if (slot - t_firstSlot >= t_index.size()) t_index.resize(slot - t_firstSlot + 1, None);
+            t_index[slot - t_firstSlot] = position;
+        }
+
+        auto reindex() -> void {
+            t_index.clear();
+            t_firstSlot = t_entries.empty() ? 0 : slotOf(t_entries.front().first);
+            for (auto i = 0u; i < t_entries.size(); i++) indexEntry(i);
+        }
+
+    public:
+        BasicGridPartitioning() = default;
+
+        explicit BasicGridPartitioning(const size_t tilesPerIpu,
+                                  const size_t workersPerTile = DefaultNumWorkersPerTile) :
+                t_tilesPerIpu(tilesPerIpu), t_workersPerTile(workersPerTile) {}
+
+        /** Like std::map::insert: returns false and keeps the existing slice if the target is already there */
+        auto insert(const value_type &entry) -> bool {
+            const auto &target = entry.first;
+            if (contains(target)) return false;
+            if (t_entries.empty() || t_entries.back().first < target) {
+                t_entries.push_back(entry);
+                if (t_entries.size() == 1) t_firstSlot = slotOf(target);
+                if (fits(target)) {
+                    indexEntry(t_entries.size() - 1);
+                    return true;
+                }
+            } else {
+                t_entries.insert(std::upper_bound(t_entries.begin(), t_entries.end(), entry,
+                                                  [](const value_type &a, const value_type &b) {
+                                                      return a.first < b.first;
+                                                  }), entry);
+            }
+            t_tilesPerIpu = max(t_tilesPerIpu, target.tile() + 1);
+            t_workersPerTile = max(t_workersPerTile, target.worker() + 1);
+            reindex();
+            return true;
+        }
+
+        auto reserve(const size_t n) -> void { t_entries.reserve(n); }
+
+        [[nodiscard]] auto size() const -> size_t { return t_entries.size(); }
+
+        [[nodiscard]] auto empty() const -> bool { return t_entries.empty(); }
+
+        [[nodiscard]] auto begin() const -> const_iterator { return t_entries.begin(); }
+
+        [[nodiscard]] auto end() const -> const_iterator { return t_entries.end(); }
+
+        [[nodiscard]] auto tilesPerIpu() const -> size_t { return t_tilesPerIpu; }
+
+        [[nodiscard]] auto workersPerTile() const -> size_t { return t_workersPerTile; }
+
+        [[nodiscard]] auto find(const PartitioningTarget &target) const -> const_iterator {
+            if (t_entries.empty() || !fits(target)) return end();
+            const auto slot = slotOf(target);
+            if (slot < t_firstSlot || slot - t_firstSlot >= t_index.size()) return end();
+            const auto position = t_index[slot - t_firstSlot];
+            return position == None ? end() : begin() + position;
+        }
+
+        [[nodiscard]] auto contains(const PartitioningTarget &target) const -> bool { return find(target) != end(); }
+
+        [[nodiscard]] auto at(const PartitioningTarget &target) const -> const Slice & {
+            const auto it = find(target);
+            if (it == end()) {
+                throw std::out_of_range("No slice for ipu " + std::to_string(target.ipu()) + " tile " +
+                                        std::to_string(target.tile()) + " worker " +
+                                        std::to_string(target.worker()));
+            }
+            return it->second;
+        }
+
+        /**
+         * Joins partitionings of disjoint targets, e.g. ones built for each IPU on a separate thread. Parts given
+         * in target order are just concatenated
+         */
+        static auto merge(const std::vector<BasicGridPartitioning> &parts) -> BasicGridPartitioning {
+            auto result = BasicGridPartitioning{};
+            auto total = size_t{0};
+            for (const auto &part: parts) {
+                result.t_tilesPerIpu = max(result.t_tilesPerIpu, part.t_tilesPerIpu);
+                result.t_workersPerTile = max(result.t_workersPerTile, part.t_workersPerTile);
+                total += part.size();
+            }
+            result.t_entries.reserve(total);
+            for (const auto &part: parts) {
+                result.t_entries.insert(result.t_entries.end(), part.begin(), part.end());
+            }
+            const auto byTarget = [](const value_type &a, const value_type &b) { return a.first < b.first; };
+            if (!std::is_sorted(result.t_entries.begin(), result.t_entries.end(), byTarget)) {
+                std::stable_sort(result.t_entries.begin(), result.t_entries.end(), byTarget);
+            }
+            result.t_entries.erase(std::unique(result.t_entries.begin(), result.t_entries.end(),
+                                               [](const value_type &a, const value_type &b) {
+                                                   return a.first == b.first;
+                                               }), result.t_entries.end());
+            result.reindex();
+            return result;
         }
     };
 
+    using GridPartitioning = BasicGridPartitioning<Slice2D>;
+    using GridPartitioning3D = BasicGridPartitioning<Slice3D>;
+
+    /**
+     * Which target's slice holds each cell of a partitioned grid, for finding a slice's neighbours. Lookups are two
+     * binary searches over the distinct slice boundaries. Build it once the partitioning is complete, and don't
+     * change the partitioning while using it
+     */
+    class CellOwners {
+        const GridPartitioning &t_partitioning;
+        std::vector<size_t> t_rowStarts;
+        std::vector<size_t> t_colStarts;
+        std::vector<uint32_t> t_owner; // [row block][col block] -> position in the partitioning, or None
+        static constexpr auto None = std::numeric_limits<uint32_t>::max();
+
+        [[nodiscard]] static auto blockOf(const std::vector<size_t> &starts, const size_t i) -> size_t {
+            return std::upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+        }
+
+    public:
+        explicit CellOwners(const GridPartitioning &partitioning) : t_partitioning(partitioning) {
+            for (const auto &[target, slice]: partitioning) {
+                t_rowStarts.push_back(slice.rows().from());
+                t_rowStarts.push_back(slice.rows().to());
+                t_colStarts.push_back(slice.cols().from());
+                t_colStarts.push_back(slice.cols().to());
+            }
+            for (auto starts: {&t_rowStarts, &t_colStarts}) {
+                std::sort(starts->begin(), starts->end());
+                starts->erase(std::unique(starts->begin(), starts->end()), starts->end());
+            }
+            t_owner.assign(t_rowStarts.size() * t_colStarts.size(), None);
+            auto position = uint32_t{0};
+            for (const auto &[target, slice]: partitioning) {
+                for (auto r = blockOf(t_rowStarts, slice.rows().from()); t_rowStarts[r] < slice.rows().to(); r++) {
+                    for (auto c = blockOf(t_colStarts, slice.cols().from());
+                         t_colStarts[c] < slice.cols().to(); c++) {
+                        t_owner[r * t_colStarts.size() + c] = position;
+                    }
+                }
+                position++;
+            }
+        }
+
+        /** The target and slice holding a cell, or nullptr if no slice does */
+        [[nodiscard]] auto entryAt(const size_t row, const size_t col) const -> const GridPartitioning::value_type * {
+            if (t_rowStarts.empty() || row < t_rowStarts.front() || col < t_colStarts.front()) return nullptr;
+            const auto position = t_owner[blockOf(t_rowStarts, row) * t_colStarts.size() + blockOf(t_colStarts, col)];
+            if (position == None) return nullptr;
+            return &*(t_partitioning.begin() + position);
+        }
 
-    typedef std::map<PartitioningTarget, Slice2D, PartitionTargetComparator> GridPartitioning;
+        [[nodiscard]] auto ownerOf(const size_t row, const size_t col) const -> optional<PartitioningTarget> {
+            const auto entry = entryAt(row, col);
+            if (entry == nullptr) return nullopt;
+            return entry->first;
+        }
+
+        /**
+         * The target holding the cell just beyond the given side (or corner) of target's slice, e.g. (-1, 0) is
+         * above its first column and (1, 1) is its bottom-right diagonal neighbour. nullopt at the grid's edge
+         */
+        [[nodiscard]] auto neighbour(const PartitioningTarget &target, const int dRow, const int dCol) const
+        -> optional<PartitioningTarget> {
+            const auto &slice = t_partitioning.at(target);
+            if ((dRow < 0 && slice.rows().from() == 0) || (dCol < 0 && slice.cols().from() == 0)) return nullopt;
+            const auto row = dRow < 0 ? slice.rows().from() - 1 : dRow > 0 ? slice.rows().to() : slice.rows().from();
+            const auto col = dCol < 0 ? slice.cols().from() - 1 : dCol > 0 ? slice.cols().to() : slice.cols().from();
+            return ownerOf(row, col);
+        }
+    };
 
     auto serializeToJson(const GridPartitioning &partitioning, const std::string &filename) {
         ofstream file;
@@ -157,6 +463,35 @@ namespace grids {
         file.close();
     }
 
+    /** Reads back a partitioning written by serializeToJson */
+    auto deserializeFromJson(const std::string &filename) -> GridPartitioning {
+        std::ifstream file(filename);
+        if (!file) throw std::runtime_error("Can't read the partitioning in " + filename);
+        const auto json = std::string{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        auto pos = size_t{0};
+        const auto numberAfter = [&](const std::string &key) -> size_t {
+            pos = json.find("\"" + key + "\"", pos);
+            if (pos == std::string::npos) throw std::runtime_error("Missing '" + key + "' in " + filename);
+            pos = json.find(':', pos) + 1;
+            auto end = size_t{0};
+            const auto value = std::stoull(json.substr(pos, 32), &end);
+            pos += end;
+            return value;
+        };
+        auto result = GridPartitioning{};
+        while (json.find("\"ipu\"", pos) != std::string::npos) {
+            const auto ipu = numberAfter("ipu");
+            const auto tile = numberAfter("tile");
+            const auto worker = numberAfter("worker");
+            const auto rowsFrom = numberAfter("from");
+            const auto rowsTo = numberAfter("to");
+            const auto colsFrom = numberAfter("from");
+            const auto colsTo = numberAfter("to");
+            result.insert({PartitioningTarget{ipu, tile, worker}, {{rowsFrom, rowsTo}, {colsFrom, colsTo}}});
+        }
+        return result;
+    }
+
 
     const auto roundRobinFill(std::vector<size_t> &vec, const size_t numItems) {
         for (auto i = 0u; i < vec.size(); i++) vec[i] = 0u;
@@ -194,7 +529,7 @@ namespace grids {
 
         auto numTilesWhenUsingMinRowsConstraint = slice.height() / minRowsPerTile;
         auto numTilesToUse = min(numTiles, numTilesWhenUsingMinRowsConstraint);
-        auto partitioning = GridPartitioning{};
+        auto partitioning = GridPartitioning{numTiles};
 
         auto numRowsPerTile = (slice.height() / numTilesToUse);
         auto numTilesWithExtra = slice.height() - (numTilesToUse * numRowsPerTile);
@@ -252,7 +587,7 @@ namespace grids {
 
         auto numTilesWhenUsingMinColsConstraint = slice.width() / minColsPerTile;
         auto numTilesToUse = min(numTiles, numTilesWhenUsingMinColsConstraint);
-        auto tileMappings = GridPartitioning{};
+        auto tileMappings = GridPartitioning{numTiles};
 
         auto c = 0ul;
         auto numColsPerTile = (slice.width() / numTilesToUse);
@@ -304,7 +639,8 @@ namespace grids {
     };
 
     /**
-     * The general case grid decomposition for large problems on one ipu
+     * The general case grid decomposition for large problems on one ipu, using the aspect ratio. This often leaves
+     * tiles unused: toTilePartitionsForSingleIpu now uses costModelTileGridStrategy instead
      */
     auto generalTileGridStrategy(const PartitioningTarget target,
                                  const Slice2D slice,
@@ -413,144 +749,429 @@ namespace grids {
 
 
     /**
-     * Split a tile's workload into roughly equal chunks for the 6 workers. We try to assign chunks of rows,
-     * but if there are more than 6x cols than rows we switch to a longAndTall strategy and chunk into cols
+     * A simple model of one superstep on a tile: compute its cells, then exchange its halos with up to 8 neighbours.
+     * The defaults are for a single-precision 5-point stencil; measure your own codelet's cycles per cell (e.g. with
+     * ipu::CycleCounter) and plug them in
      */
-    auto toWorkerPartitions(const PartitioningTarget target, const Slice2D slice,
-                            const size_t numWorkersPerTile = DefaultNumWorkersPerTile) -> GridPartitioning {
-        const auto tile = target.tile();
-        GridPartitioning workerMappings = {};
-
-        // How will work be more evenly split? By rows or by cols? We want most even (least imbalance)
-        float rowImbalance = (float) (slice.height() % numWorkersPerTile) / (float) slice.height();
-        float colImbalance = (float) (slice.width() % numWorkersPerTile) / (float) slice.width();
-
-        if (rowImbalance <= colImbalance) {
-            auto numWorkersToUse = min(slice.height(), numWorkersPerTile);
-
-            auto numRowsPerWorker = (slice.height() / numWorkersToUse);
-            auto numWorkersWithExtra = slice.height() - (numWorkersToUse * numRowsPerWorker);
-            auto r = slice.rows().from();
-            for (auto worker = 0ul; worker < numWorkersToUse; worker++) {
-                auto extra = worker < numWorkersWithExtra;
-                auto numRows = numRowsPerWorker + extra;
-                assert(r < slice.rows().to());
-                assert(r + numRows <= slice.rows().to());
-
-                workerMappings.insert({PartitioningTarget{target.ipu(), tile, worker}, {{r, r + numRows},
-                                                                                        {slice.cols().from(),
-                                                                                         slice.cols().to()}}});
-                r += numRows;
+    struct TileCostModel {
+        double cyclesPerCell = 1.0; // Per tile, i.e. already divided between the workers
+        double bytesPerCell = 4.0;
+        double cyclesPerHaloByte = 0.25; // A tile sends 4 bytes per cycle over the exchange
+        // Temporal blocking: exchange haloDepth-deep halos once, then run haloDepth sweeps on a shrinking region
+        size_t haloDepth = 1;
+        double cyclesPerExchange = 0.0; // The fixed cost of an exchange phase: the sync and setting up the exchange
+
+        /** Takes the exchange bandwidth from the target */
+        static auto forTarget(const poplar::Target &target, const double cyclesPerCell = 1.0,
+                              const double bytesPerCell = 4.0) -> TileCostModel {
+            return {cyclesPerCell, bytesPerCell, 1.0 / target.getExchangeBytesPerCycle()};
+        }
+
+        [[nodiscard]] auto withHaloDepth(const size_t depth) const -> TileCostModel {
+            auto result = *this;
+            result.haloDepth = depth;
+            return result;
+        }
+    };
+
+    /**
+     * The cells a block of extents (with the given number of neighbours along each dimension, 0 to 2) updates in
+     * the haloDepth sweeps between two exchanges. Sweep s still has to update the haloDepth - s deep band of the
+     * halo that the later sweeps read, so the first sweep covers the most cells and the last just the block
+     */
+    template<size_t N>
+    auto sweptCells(const std::array<size_t, N> &extents, const std::array<size_t, N> &neighbours,
+                    const size_t haloDepth) -> size_t {
+        auto result = size_t{0};
+        for (auto band = 0ul; band < haloDepth; band++) {
+            auto cells = size_t{1};
+            for (auto i = 0u; i < N; i++) cells *= extents[i] + neighbours[i] * band;
+            result += cells;
+        }
+        return result;
+    }
+
+    /** The cells in a haloDepth-deep halo around a block of extents with the given number of neighbours */
+    template<size_t N>
+    auto deepHaloCells(const std::array<size_t, N> &extents, const std::array<size_t, N> &neighbours,
+                       const size_t haloDepth) -> size_t {
+        auto cells = size_t{1};
+        auto withHalo = size_t{1};
+        for (auto i = 0u; i < N; i++) {
+            cells *= extents[i];
+            withHalo *= extents[i] + neighbours[i] * haloDepth;
+        }
+        return withHalo - cells;
+    }
+
+    /**
+     * Predicted cycles per sweep for a blockRows x blockCols block surrounded by neighbours, exchanging halos of
+     * the model's depth: the exchange's fixed cost and bytes are shared by haloDepth sweeps, which redo some
+     * of the neighbours' work
+     */
+    auto cyclesPerSweep(const size_t blockRows, const size_t blockCols, const TileCostModel &model) -> double {
+        const auto extents = std::array<size_t, 2>{blockRows, blockCols};
+        const auto neighbours = std::array<size_t, 2>{2, 2};
+        const auto exchange = model.cyclesPerExchange + model.cyclesPerHaloByte * model.bytesPerCell *
+                                                        static_cast<double>(deepHaloCells(extents, neighbours,
+                                                                                          model.haloDepth));
+        const auto compute = model.cyclesPerCell * static_cast<double>(sweptCells(extents, neighbours,
+                                                                                   model.haloDepth));
+        return (exchange + compute) / static_cast<double>(model.haloDepth);
+    }
+
+    /** The halo depth from 1 to maxDepth (and no deeper than the block) with the fewest predicted cycles per sweep */
+    auto bestHaloDepth(const size_t blockRows, const size_t blockCols, const TileCostModel &model,
+                       const size_t maxDepth) -> size_t {
+        auto best = size_t{1};
+        for (auto depth = 2ul; depth <= min(maxDepth, min(blockRows, blockCols)); depth++) {
+            if (cyclesPerSweep(blockRows, blockCols, model.withHaloDepth(depth)) <
+                cyclesPerSweep(blockRows, blockCols, model.withHaloDepth(best))) {
+                best = depth;
             }
-        } else {
-            auto numWorkersToUse = min(slice.width(), numWorkersPerTile);
+        }
+        return best;
+    }
 
-            auto numColsPerWorker = (slice.width() / numWorkersToUse);
-            auto numWorkersWithExtra = slice.width() - (numWorkersToUse * numColsPerWorker);
-            auto c = slice.cols().from();
-            for (auto worker = 0ul; worker < numWorkersToUse; worker++) {
-                auto extra = worker < numWorkersWithExtra;
-                auto numCols = numColsPerWorker + extra;
-                assert(c < slice.cols().to());
-                assert(c + numCols <= slice.cols().to());
+    /** A candidate tileRows x tileCols decomposition and its predicted cost for the biggest (slowest) block */
+    struct TileGridChoice {
+        size_t tileRows;
+        size_t tileCols;
+        size_t blockRows;
+        size_t blockCols;
+        double computeCycles;
+        double exchangeCycles;
+        size_t haloDepth = 1; // A superstep is one exchange and haloDepth sweeps
+
+        [[nodiscard]] auto tiles() const -> size_t { return tileRows * tileCols; }
+
+        [[nodiscard]] auto superstepCycles() const -> double { return computeCycles + exchangeCycles; }
+
+        auto explain(ostream &os = cout) const -> void {
+            os << tileRows << "x" << tileCols << " tiles (" << tiles() << " used) of up to " << blockRows << "x"
+               << blockCols << " cells: " << std::fixed << std::setprecision(0) << computeCycles << " compute + "
+               << exchangeCycles << " exchange = " << superstepCycles() << " cycles per superstep"
+               << std::defaultfloat;
+            if (haloDepth > 1) os << " of " << haloDepth << " sweeps";
+            os << endl;
+        }
+    };
+
+    auto tileGridCost(const Slice2D slice, const size_t tileRows, const size_t tileCols,
+                      const TileCostModel &model) -> TileGridChoice {
+        const auto blockRows = (slice.height() + tileRows - 1) / tileRows;
+        const auto blockCols = (slice.width() + tileCols - 1) / tileCols;
+        const auto extents = std::array<size_t, 2>{blockRows, blockCols};
+        const auto neighbours = std::array<size_t, 2>{min(tileRows - 1, (size_t) 2), min(tileCols - 1, (size_t) 2)};
+        const auto haloCells = deepHaloCells(extents, neighbours, model.haloDepth);
+        return {tileRows, tileCols, blockRows, blockCols,
+                model.cyclesPerCell * static_cast<double>(sweptCells(extents, neighbours, model.haloDepth)),
+                model.cyclesPerExchange + model.cyclesPerHaloByte * model.bytesPerCell * static_cast<double>(haloCells),
+                model.haloDepth};
+    }
+
+    /**
+     * Scores every tileRows x tileCols decomposition that fits on numTiles, respects the minimum block size and
+     * whose blocks (with halos of the model's depth) fit in maxCellsPerTile, and returns them cheapest first. Ties go to the one
+     * using fewer tiles, then the one with wider blocks (longer contiguous rows in a row-major grid)
+     */
+    auto rankTileGrids(const Slice2D slice,
+                       const size_t numTiles,
+                       const TileCostModel &model = {},
+                       const size_t minRowsPerTile = DefaultMinRowsPerTile,
+                       const size_t minColsPerTile = DefaultMinColsPerTile,
+                       const size_t maxCellsPerTile = std::numeric_limits<size_t>::max())
+    -> std::vector<TileGridChoice> {
+        auto result = std::vector<TileGridChoice>{};
+        const auto maxTileRows = max((size_t) 1, min(numTiles, slice.height() / minRowsPerTile));
+        for (auto tileRows = 1ul; tileRows <= maxTileRows; tileRows++) {
+            const auto maxTileCols = max((size_t) 1, min(numTiles / tileRows, slice.width() / minColsPerTile));
+            for (auto tileCols = 1ul; tileCols <= maxTileCols; tileCols++) {
+                // Every block must be at least as deep as the halo, so halos only come from adjacent tiles
+                if ((tileRows > 1 && slice.height() / tileRows < model.haloDepth) ||
+                    (tileCols > 1 && slice.width() / tileCols < model.haloDepth)) {
+                    continue;
+                }
+                const auto choice = tileGridCost(slice, tileRows, tileCols, model);
+                const auto padding = 2 * model.haloDepth;
+                if ((choice.blockRows + padding) * (choice.blockCols + padding) > maxCellsPerTile) continue;
+                result.push_back(choice);
+            }
+        }
+        std::stable_sort(result.begin(), result.end(), [](const TileGridChoice &a, const TileGridChoice &b) {
+            if (a.superstepCycles() != b.superstepCycles()) return a.superstepCycles() < b.superstepCycles();
+            if (a.tiles() != b.tiles()) return a.tiles() < b.tiles();
+            return a.blockCols > b.blockCols;
+        });
+        return result;
+    }
 
-                workerMappings.insert({PartitioningTarget{target.ipu(), tile, worker}, {
-                        {slice.rows().from(), slice.rows().to()}, {c, c + numCols}
-                }});
-                c += numCols;
+    /**
+     * The general case grid decomposition driven by a cost model rather than the aspect ratio: picks the
+     * decomposition with the smallest predicted superstep time. With explain set, it prints the winner and the
+     * runners-up so you can see why
+     */
+    auto costModelTileGridStrategy(const PartitioningTarget target,
+                                   const Slice2D slice,
+                                   const size_t numTiles,
+                                   const TileCostModel &model = {},
+                                   const size_t minRowsPerTile = DefaultMinRowsPerTile,
+                                   const size_t minColsPerTile = DefaultMinColsPerTile,
+                                   const size_t maxCellsPerTile = std::numeric_limits<size_t>::max(),
+                                   ostream *explain = nullptr) -> GridPartitioning {
+        const auto ranked = rankTileGrids(slice, numTiles, model, minRowsPerTile, minColsPerTile, maxCellsPerTile);
+        if (ranked.empty()) {
+            throw std::invalid_argument("Can't fit " + Slice2D::print(slice) + " on " + std::to_string(numTiles) +
+                                        " tiles of at most " + std::to_string(maxCellsPerTile) + " cells");
+        }
+        const auto &best = ranked.front();
+        if (explain != nullptr) {
+            *explain << "Partitioning " << Slice2D::print(slice) << " on IPU " << target.ipu() << " into ";
+            best.explain(*explain);
+            for (auto i = 1u; i < min(ranked.size(), (size_t) 4); i++) {
+                *explain << "  vs ";
+                ranked[i].explain(*explain);
             }
         }
 
-        return workerMappings;
+        auto rowAllocs = std::vector<size_t>(best.tileRows, 0);
+        auto colAllocs = std::vector<size_t>(best.tileCols, 0);
+        roundRobinFill(rowAllocs, slice.height());
+        roundRobinFill(colAllocs, slice.width());
+
+        auto tileMapping = GridPartitioning{numTiles};
+        auto tile = 0ul;
+        auto startRow = slice.rows().from();
+        for (const auto rowAlloc: rowAllocs) {
+            auto startCol = slice.cols().from();
+            for (const auto colAlloc: colAllocs) {
+                tileMapping.insert({PartitioningTarget{target.ipu(), tile},
+                                    {{startRow, startRow + rowAlloc},
+                                     {startCol, startCol + colAlloc}}});
+                startCol += colAlloc;
+                tile++;
+            }
+            startRow += rowAlloc;
+        }
+        return tileMapping;
     }
 
 
     /**
-     * As an intermediate step in mapping down to worker split, determine the split down to tile level.
-     * All MappingTargets will have worker=0. Use toWorkerMappings to further refine down to worker split
+     * Per-cell costs for splitting a tile's block between its workers. Cells on the block's edge rows and cols
+     * can cost more than interior ones (e.g. the edge and corner special cases in ExtraHalosApproach), and
+     * column splits are kept to multiples of cellsPerWord so every worker's part of a row starts on a 64-bit word
+     * boundary (relative to the start of the block) for vectorised inner loops
      */
-    auto partitionForIpus(Size2D size,
-                          size_t numIpus,
-                          size_t maxCellsPerIpu) -> optional<GridPartitioning> {
-        // Lost cause! Too much data
-        if (size.rows() * size.cols() > maxCellsPerIpu * numIpus) return nullopt;
-//
-//        // How will work be more evenly split? By rows or by cols? We want most even
-        float rowImbalance = (float) (size.rows() % numIpus) / (float) size.rows();
-        float colImbalance = (float) (size.cols() % numIpus) / (float) size.cols();
-//
-//        if (rowImbalance < colImbalance) {
-//            if (auto result = longAndNarrowIpuStrategy(size, numIpus, maxCellsPerIpu); result.has_value()) {
-//                return result;
-//            } else {
-//                // Couldn't partition. Try cols?
-//                return shortAndWideIpuStrategy(size, numIpus, maxCellsPerIpu);
-//            }
-//        } else {
-//            if (auto result = shortAndWideIpuStrategy(size, numIpus, maxCellsPerIpu); result.has_value()) {
-//                return result;
-//            } else {
-//                // Couldn't partition. Try rows?
-//                return longAndNarrowIpuStrategy(size, numIpus, maxCellsPerIpu);
-//            }
-//        }
-
-        auto numRows = 1;
-        auto numCols = 1;
-
-        if (numIpus == 2) {
-            if (rowImbalance < colImbalance) {
-                numRows = 2;
-            } else {
-                numCols = 2;
+    struct WorkerCostModel {
+        double interiorCellCost = 1.0;
+        double boundaryCellCost = 1.0;
+        size_t cellsPerWord = sizeof(uint64_t) / sizeof(float);
+
+        [[nodiscard]] auto cost(const Slice2D tileSlice, const Range rows, const Range cols) const -> double {
+            const auto onEdge = [](const Range outer, const Range inner) -> size_t {
+                return (inner.from() == outer.from()) + (inner.to() == outer.to() && inner.to() - 1 > inner.from());
+            };
+            const auto edgeRows = onEdge(tileSlice.rows(), rows);
+            const auto edgeCols = onEdge(tileSlice.cols(), cols);
+            const auto height = rows.to() - rows.from();
+            const auto width = cols.to() - cols.from();
+            const auto boundaryCells = edgeRows * width + edgeCols * height - edgeRows * edgeCols;
+            return interiorCellCost * static_cast<double>(height * width - boundaryCells) +
+                   boundaryCellCost * static_cast<double>(boundaryCells);
+        }
+    };
+
+    /** A rowParts x colParts split of a tile's block between workers, and the cost of its most expensive worker */
+    struct WorkerSplitChoice {
+        std::vector<size_t> rowAllocs;
+        std::vector<size_t> colAllocs;
+        double maxWorkerCost;
+
+        [[nodiscard]] auto workers() const -> size_t { return rowAllocs.size() * colAllocs.size(); }
+
+        auto explain(ostream &os = cout) const -> void {
+            os << rowAllocs.size() << "x" << colAllocs.size() << " workers, the busiest costing " << std::fixed
+               << std::setprecision(1) << maxWorkerCost << std::defaultfloat << endl;
+        }
+    };
+
+    /**
+     * Splits extent cells into at most parts contiguous runs of roughly equal weight, each (but the last) a
+     * multiple of alignment cells. Fewer runs come back when there aren't enough aligned cells to go round
+     */
+    auto weightedSplit(const std::vector<double> &weights, const size_t parts, const size_t alignment = 1)
+    -> std::vector<size_t> {
+        const auto extent = weights.size();
+        const auto units = (extent + alignment - 1) / alignment; // The last unit may be short
+        const auto numParts = max((size_t) 1, min(parts, units));
+        auto prefix = std::vector<double>(units + 1, 0.0);
+        for (auto unit = 0ul; unit < units; unit++) {
+            prefix[unit + 1] = prefix[unit];
+            for (auto i = unit * alignment; i < min(extent, (unit + 1) * alignment); i++) {
+                prefix[unit + 1] += weights[i];
+            }
+        }
+        auto result = std::vector<size_t>{};
+        auto from = 0ul;
+        for (auto part = 1ul; part < numParts; part++) {
+            // The split closest to this part's share of the weight, leaving at least one unit for each later part
+            const auto target = prefix[units] * static_cast<double>(part) / static_cast<double>(numParts);
+            auto to = from + 1;
+            while (to + 1 <= units - (numParts - part) &&
+                   std::abs(prefix[to + 1] - target) < std::abs(prefix[to] - target)) {
+                to++;
             }
+            result.push_back((to - from) * alignment);
+            from = to;
         }
+        result.push_back(extent - from * alignment);
+        return result;
+    }
 
-        if (numIpus == 4) {
-            numRows = 2;
-            numCols = 2;
+    /**
+     * Scores every rows x cols arrangement of at most numWorkers workers over a tile's block (6x1, 3x2, 2x3...),
+     * each splitting the rows and columns by weight, and returns them with the cheapest busiest worker first. Ties
+     * go to fewer workers, then to fewer column splits, which keep each worker's rows whole
+     */
+    auto rankWorkerSplits(const Slice2D slice, const size_t numWorkers,
+                          const WorkerCostModel &model = {}) -> std::vector<WorkerSplitChoice> {
+        auto rowWeights = std::vector<double>(slice.height());
+        for (auto r = 0ul; r < slice.height(); r++) {
+            const auto row = Range{slice.rows().from() + r, slice.rows().from() + r + 1};
+            rowWeights[r] = model.cost(slice, row, slice.cols());
+        }
+        auto colWeights = std::vector<double>(slice.width());
+        for (auto c = 0ul; c < slice.width(); c++) {
+            const auto col = Range{slice.cols().from() + c, slice.cols().from() + c + 1};
+            colWeights[c] = model.cost(slice, slice.rows(), col);
         }
 
-        if (numIpus == 8) {
-            if (rowImbalance < colImbalance) {
-                numRows = 4;
-                numCols = 2;
-            } else {
-                numRows = 2;
-                numCols = 4;
+        auto result = std::vector<WorkerSplitChoice>{};
+        for (auto rowParts = 1ul; rowParts <= min(numWorkers, slice.height()); rowParts++) {
+            const auto rowAllocs = weightedSplit(rowWeights, rowParts);
+            const auto colParts = numWorkers / rowAllocs.size();
+            for (auto cols = 1ul; cols <= colParts; cols++) {
+                auto choice = WorkerSplitChoice{rowAllocs, weightedSplit(colWeights, cols, model.cellsPerWord), 0.0};
+                auto r = slice.rows().from();
+                for (const auto rows: choice.rowAllocs) {
+                    auto c = slice.cols().from();
+                    for (const auto numCols: choice.colAllocs) {
+                        choice.maxWorkerCost = max(choice.maxWorkerCost,
+                                                   model.cost(slice, {r, r + rows}, {c, c + numCols}));
+                        c += numCols;
+                    }
+                    r += rows;
+                }
+                result.push_back(choice);
             }
         }
+        std::stable_sort(result.begin(), result.end(), [](const WorkerSplitChoice &a, const WorkerSplitChoice &b) {
+            if (a.maxWorkerCost != b.maxWorkerCost) return a.maxWorkerCost < b.maxWorkerCost;
+            if (a.workers() != b.workers()) return a.workers() < b.workers();
+            return a.colAllocs.size() < b.colAllocs.size();
+        });
+        return result;
+    }
 
-        if (numIpus == 16) {
-            numRows = 4;
-            numCols = 4;
+    /**
+     * Split a tile's workload between its workers so the busiest one has as little to do as possible. Thin
+     * blocks that don't divide evenly by 6 rows or 6 cols are split 2x3 or 3x2 instead, cells are weighed by the
+     * model's interior and boundary costs, and column splits are aligned to 64-bit words. Workers are numbered
+     * in row-major order
+     */
+    auto toWorkerPartitions(const PartitioningTarget target, const Slice2D slice,
+                            const size_t numWorkersPerTile = DefaultNumWorkersPerTile,
+                            const WorkerCostModel &model = {}) -> GridPartitioning {
+        const auto best = rankWorkerSplits(slice, numWorkersPerTile, model).front();
+        auto workerMappings = GridPartitioning{target.tile() + 1, numWorkersPerTile};
+        workerMappings.reserve(best.workers());
+
+        auto worker = 0ul;
+        auto r = slice.rows().from();
+        for (const auto rows: best.rowAllocs) {
+            auto c = slice.cols().from();
+            for (const auto cols: best.colAllocs) {
+                workerMappings.insert({PartitioningTarget{target.ipu(), target.tile(), worker++},
+                                       {{r, r + rows}, {c, c + cols}}});
+                c += cols;
+            }
+            assert(c == slice.cols().to());
+            r += rows;
         }
+        assert(r == slice.rows().to());
+        return workerMappings;
+    }
+
+
+    /**
+     * The estimated time for one iteration when the grid is split into ipuRows x ipuCols blocks, in units of one cell
+     * update: every IPU waits for the biggest block, which computes its cells and swaps up to 8 neighbours' worth of
+     * halo over IPU-Link, costing interIpuHaloCost per halo cell
+     */
+    auto ipuGridCost(const Size2D size, const size_t ipuRows, const size_t ipuCols,
+                     const double interIpuHaloCost) -> double {
+        const auto maxRows = (size.rows() + ipuRows - 1) / ipuRows;
+        const auto maxCols = (size.cols() + ipuCols - 1) / ipuCols;
+        const auto verticalNeighbours = min(ipuRows - 1, (size_t) 2);
+        const auto horizontalNeighbours = min(ipuCols - 1, (size_t) 2);
+        const auto haloCells = verticalNeighbours * maxCols + horizontalNeighbours * maxRows +
+                               verticalNeighbours * horizontalNeighbours;
+        return static_cast<double>(maxRows * maxCols) + interIpuHaloCost * static_cast<double>(haloCells);
+    }
+
+    /**
+     * As an intermediate step in mapping down to worker split, determine the split down to IPU level.
+     * Tries every ipuRows x ipuCols factorisation of numIpus and picks the cheapest by ipuGridCost, which trades
+     * the load imbalance of uneven blocks against the halo perimeter that has to cross IPU-Link. Returns nullopt
+     * if the grid doesn't fit, or can't be split so every IPU gets at least one row and column.
+     * All MappingTargets will have tile=0 and worker=0. Use toTilePartitions to further refine down to tile split
+     */
+    auto partitionForIpus(Size2D size,
+                          size_t numIpus,
+                          size_t maxCellsPerIpu,
+                          double interIpuHaloCost = DefaultInterIpuHaloCost) -> optional<GridPartitioning> {
+        // Lost cause! Too much data
+        if (size.rows() * size.cols() > maxCellsPerIpu * numIpus) return nullopt;
+
+        auto numRows = 0ul;
+        auto numCols = 0ul;
+        auto bestCost = 0.0;
+        for (auto ipuRows = 1ul; ipuRows <= numIpus; ipuRows++) {
+            if (numIpus % ipuRows != 0) continue;
+            const auto ipuCols = numIpus / ipuRows;
+            if (ipuRows > size.rows() || ipuCols > size.cols()) continue; // Some IPUs would get nothing
+            const auto maxCells = ((size.rows() + ipuRows - 1) / ipuRows) * ((size.cols() + ipuCols - 1) / ipuCols);
+            if (maxCells > maxCellsPerIpu) continue;
+
+            const auto cost = ipuGridCost(size, ipuRows, ipuCols, interIpuHaloCost);
+            if (numRows == 0 || cost < bestCost) {
+                numRows = ipuRows;
+                numCols = ipuCols;
+                bestCost = cost;
+            }
+        }
+        if (numRows == 0) return nullopt;
 
         GridPartitioning result = {};
 
-        auto rowAllocs = std::vector<size_t>(std::min((size_t) numRows, size.rows()), 0);
-        auto colAllocs = std::vector<size_t>(std::min((size_t) numCols, size.cols()), 0);
+        auto rowAllocs = std::vector<size_t>(numRows, 0);
+        auto colAllocs = std::vector<size_t>(numCols, 0);
         roundRobinFill(rowAllocs, size.rows());
         roundRobinFill(colAllocs, size.cols());
 
-        auto startRow = 0;
-        size_t tile = 0u;
-        for (auto row = 0u; row < rowAllocs.size(); row++) {
+        auto startRow = 0ul;
+        for (auto row = 0ul; row < numRows; row++) {
             auto rowAlloc = rowAllocs[row];
-            auto startCol = 0;
-            if (rowAlloc == 0) break;
-
-            for (auto col = 0u; col < colAllocs.size(); col++) {
+            auto startCol = 0ul;
+            for (auto col = 0ul; col < numCols; col++) {
                 auto colAlloc = colAllocs[col];
 
-                if (colAlloc == 0) break;
-
                 auto key = PartitioningTarget{row * numCols + col, 0};
                 auto entry = Slice2D{
                         Range(startRow, startRow + rowAlloc),
                         Range(startCol, startCol + colAlloc)};
                 result.insert({key, entry});
-                tile++;
                 startCol += colAlloc;
             }
             startRow += rowAlloc;
@@ -561,6 +1182,20 @@ namespace grids {
     }
 
 
+    /**
+     * partitionForIpus over all the target's IPUs, where an IPU holds as many cells of bytesPerCell as fit in its
+     * tiles' memory
+     */
+    auto partitionForIpus(Size2D size,
+                          const poplar::Target &target,
+                          size_t bytesPerCell,
+                          double interIpuHaloCost = DefaultInterIpuHaloCost) -> optional<GridPartitioning> {
+        const auto device = PartitioningDevice::fromTarget(target);
+        return partitionForIpus(size, device.numIpus, device.tilesPerIpu * device.maxCellsPerTile(bytesPerCell),
+                                interIpuHaloCost);
+    }
+
+
     /**
      * As an intermediate step in mapping down to worker split, determine the split down to tile level.
      * All MappingTargets will have worker=0. Use toWorkerMappings to further refine down to worker split
@@ -569,7 +1204,10 @@ namespace grids {
                                       const Slice2D slice,
                                       const size_t numTiles = DefaultNumTilesPerIpu,
                                       const size_t minRowsPerTile = DefaultMinRowsPerTile,
-                                      const size_t minColsPerTile = DefaultMinColsPerTile) -> GridPartitioning {
+                                      const size_t minColsPerTile = DefaultMinColsPerTile,
+                                      const TileCostModel &model = {},
+                                      const size_t maxCellsPerTile = std::numeric_limits<size_t>::max())
+    -> GridPartitioning {
         if (slice.width() * slice.height() < minColsPerTile * minRowsPerTile) {
             // This is unlikely for a real case! Not even going to try and optimise for it
             return singleTileStrategy(target, slice);
@@ -581,8 +1219,9 @@ namespace grids {
             return shortAndWideTileStrategy(target, slice, numTiles, minColsPerTile);
 
         } else {
-            // We'll try and use the best grid overlay we can
-            return generalTileGridStrategy(target, slice, numTiles, minRowsPerTile, minColsPerTile);
+            // We'll try and use the grid overlay with the shortest predicted superstep
+            return costModelTileGridStrategy(target, slice, numTiles, model, minRowsPerTile, minColsPerTile,
+                                             maxCellsPerTile);
         }
     }
 
@@ -590,66 +1229,68 @@ namespace grids {
      * Further splits a tile mapping that is the result of @refitem  partitionGridToTileForSingleIpu futher into worker mappings
      */
     auto toWorkerPartitions(const GridPartitioning &tileMappings,
-                            size_t numWorkersPerTile = DefaultNumWorkersPerTile) -> GridPartitioning {
-        GridPartitioning result = {};
-        for (const auto&[target, tileSlice]: tileMappings) {
-            auto newMappings = toWorkerPartitions(target, tileSlice, numWorkersPerTile);
-            for (auto &[newTarget, newTileSlice]: newMappings) {
-                result.insert({newTarget, newTileSlice});
-            }
+                            size_t numWorkersPerTile = DefaultNumWorkersPerTile,
+                            const WorkerCostModel &model = {}) -> GridPartitioning {
+        // Tiles are independent, so each thread splits a contiguous run of them and the runs are joined in order
+        const auto numThreads = max(1ul, min((size_t) std::thread::hardware_concurrency(), tileMappings.size()));
+        const auto tilesPerThread = (tileMappings.size() + numThreads - 1) / max(1ul, numThreads);
+        auto parts = std::vector<std::future<GridPartitioning>>{};
+        for (auto first = 0ul; first < tileMappings.size(); first += tilesPerThread) {
+            const auto last = min(first + tilesPerThread, tileMappings.size());
+            parts.push_back(std::async(std::launch::async, [&tileMappings, &model, first, last, numWorkersPerTile]() {
+                auto result = GridPartitioning{tileMappings.tilesPerIpu(), numWorkersPerTile};
+                result.reserve((last - first) * numWorkersPerTile);
+                for (auto it = tileMappings.begin() + first; it != tileMappings.begin() + last; it++) {
+                    for (const auto &entry: toWorkerPartitions(it->first, it->second, numWorkersPerTile, model)) {
+                        result.insert(entry);
+                    }
+                }
+                return result;
+            }));
         }
-        return result;
+        auto results = std::vector<GridPartitioning>{};
+        for (auto &part: parts) results.push_back(part.get());
+        return GridPartitioning::merge(results);
+    }
+
+
+    /** toWorkerPartitions for as many workers as the target's tiles have */
+    auto toWorkerPartitions(const GridPartitioning &tileMappings,
+                            const poplar::Target &target,
+                            const WorkerCostModel &model = {}) -> GridPartitioning {
+        return toWorkerPartitions(tileMappings, target.getNumWorkerContexts(), model);
     }
 
 
+    /**
+     * Every IPU's slice split into the tile grid with the shortest predicted superstep on numTiles tiles. This used
+     * to be a fixed 38x32 grid for Mk1, which it still picks for a 1024x1024 grid on 1216 tiles
+     */
     auto newTilePartitions(const GridPartitioning &ipuMappings,
                            const size_t numTiles = DefaultNumTilesPerIpu,
                            const size_t minRowsPerTile = DefaultMinRowsPerTile,
                            const size_t minColsPerTile = DefaultMinColsPerTile) {
         assert(ipuMappings.size() > 0);
-        GridPartitioning result = {};
+        auto parts = std::vector<GridPartitioning>{};
         for (const auto&[target, ipuSlice]: ipuMappings) {
-            auto rowAllocs = std::vector<size_t>(std::min((size_t) 38u, ipuSlice.height()), 0);
-            auto colAllocs = std::vector<size_t>(std::min((size_t) 32u, ipuSlice.width()), 0);
-            roundRobinFill(rowAllocs, ipuSlice.height());
-            roundRobinFill(colAllocs, ipuSlice.width());
-
-            auto startRow = 0;
-            size_t tile = 0u;
-            for (auto row = 0u; row < rowAllocs.size(); row++) {
-                auto rowAlloc = rowAllocs[row];
-                auto startCol = 0;
-                if (rowAlloc == 0) break;
-
-                for (auto col = 0u; col < colAllocs.size(); col++) {
-                    auto colAlloc = colAllocs[col];
-
-                    if (colAlloc == 0) break;
-
-                    auto key = PartitioningTarget{target.ipu(), tile};
-                    auto entry = Slice2D{
-                            Range(ipuSlice.rows().from() + startRow, ipuSlice.rows().from() + startRow + rowAlloc),
-                            Range(ipuSlice.cols().from() + startCol, ipuSlice.cols().from() + startCol + colAlloc)};
-                    result.insert({key, entry});
-                    tile++;
-                    startCol += colAlloc;
-                }
-
-                startRow += rowAlloc;
-
-            }
+            parts.push_back(costModelTileGridStrategy(target, ipuSlice, numTiles, {},
+                                                      minRowsPerTile, minColsPerTile));
         }
-        return result;
-
+        return GridPartitioning::merge(parts);
     }
 
+    /**
+     * Hand-tuned 38x32 split of a 1024x1024 grid. costModelTileGridStrategy predicts the same superstep time for it
+     * and finds equivalent splits for other sizes, so prefer that for new grids
+     */
     auto lbm1024x1024TilePartitions(const GridPartitioning &ipuMappings,
                                     const size_t numTiles = DefaultNumTilesPerIpu,
                                     const size_t minRowsPerTile = DefaultMinRowsPerTile,
                                     const size_t minColsPerTile = DefaultMinColsPerTile) {
 
 
-        GridPartitioning result;
+        assert(numTiles >= 38 * 32);
+        GridPartitioning result{numTiles};
 
         // Everyone gets 27ish rows (last 2 rows gets 26)
         // Everyone gets 32 columns
@@ -680,18 +1321,41 @@ namespace grids {
     auto toTilePartitions(const GridPartitioning &ipuMappings,
                           const size_t numTiles = DefaultNumTilesPerIpu,
                           const size_t minRowsPerTile = DefaultMinRowsPerTile,
-                          const size_t minColsPerTile = DefaultMinColsPerTile) {
+                          const size_t minColsPerTile = DefaultMinColsPerTile,
+                          const TileCostModel &model = {},
+                          const size_t maxCellsPerTile = std::numeric_limits<size_t>::max()) {
         assert(ipuMappings.size() > 0);
-        GridPartitioning result = {};
+        // Each IPU's slice is partitioned on its own thread
+        auto parts = std::vector<std::future<GridPartitioning>>{};
         for (const auto&[target, ipuSlice]: ipuMappings) {
-            auto newMappings = toTilePartitionsForSingleIpu(target, ipuSlice, numTiles,
-                                                            minRowsPerTile, minColsPerTile);
-            for (const auto &[newTarget, newTileSlice]: newMappings) {
+            parts.push_back(std::async(std::launch::async, [=, &model]() {
+                return toTilePartitionsForSingleIpu(target, ipuSlice, numTiles,
+                                                    minRowsPerTile, minColsPerTile, model, maxCellsPerTile);
+            }));
+        }
+        auto results = std::vector<GridPartitioning>{};
+        for (auto &part: parts) {
+            results.push_back(part.get());
+            for (const auto &[newTarget, newTileSlice]: results.back()) {
                 assert(newTarget.tile() < numTiles);
-                result.insert({newTarget, newTileSlice});
             }
         }
-        return result;
+        return GridPartitioning::merge(results);
+    }
+
+    /**
+     * toTilePartitions for the target's tile count, where no tile gets more cells of bytesPerCell (including its
+     * halo) than fit in its memory. Pass a TileCostModel::forTarget to weigh exchange by the target's bandwidth
+     */
+    auto toTilePartitions(const GridPartitioning &ipuMappings,
+                          const poplar::Target &target,
+                          const size_t bytesPerCell,
+                          const TileCostModel &model = {},
+                          const size_t minRowsPerTile = DefaultMinRowsPerTile,
+                          const size_t minColsPerTile = DefaultMinColsPerTile) {
+        const auto device = PartitioningDevice::fromTarget(target);
+        return toTilePartitions(ipuMappings, device.tilesPerIpu, minRowsPerTile, minColsPerTile, model,
+                                device.maxCellsPerTile(bytesPerCell));
     }
 
     class Halos {
@@ -714,8 +1378,10 @@ namespace grids {
         }
 
 
-        // Top left is (0,0) as in Gaussian Blur
-        static auto forSliceTopIs0NoWrap(Slice2D slice, Size2D matrixSize) -> Halos {
+        // Top left is (0,0) as in Gaussian Blur. The halos are depth cells deep, for stencils that exchange once
+        // every depth sweeps
+        static auto forSliceTopIs0NoWrap(Slice2D slice, Size2D matrixSize, const size_t depth = 1) -> Halos {
+            assert(depth > 0);
             // Some shorthand sugar
             const auto x = slice.cols().from();
             const auto y = slice.rows().from();
@@ -723,54 +1389,59 @@ namespace grids {
             const auto h = slice.height();
             const auto nx = matrixSize.cols();
             const auto ny = matrixSize.rows();
+            const auto k = (unsigned) depth;
 
             int t, l;
             unsigned int r, b;
-            t = (int) y - 1;
-            l = (int) x - 1;
+            t = (int) y - (int) k;
+            l = (int) x - (int) k;
             r = x + w;
             b = y + h;
+            const auto hasTop = t > 0;
+            const auto hasLeft = l > 0;
+            const auto hasRight = r + k < nx;
+            const auto hasBottom = b + k < ny;
 
-            auto topLeft = (t > 0 && l > 0)
+            auto topLeft = (hasTop && hasLeft)
                            ? std::optional<Slice2D>{
-                            {{(unsigned) t, (unsigned) t + 1},
-                                    {(unsigned) l, (unsigned) l + 1}}}
+                            {{(unsigned) t, (unsigned) t + k},
+                                    {(unsigned) l, (unsigned) l + k}}}
                            : std::nullopt;
-            auto top = (t > 0)
+            auto top = hasTop
                        ? std::optional<Slice2D>{
-                            {{(unsigned) t, (unsigned) t + 1},
+                            {{(unsigned) t, (unsigned) t + k},
                                     {x, x + w}}}
                        : std::nullopt;
 
-            auto topRight = (t > 0 && r < nx - 1)
+            auto topRight = (hasTop && hasRight)
                             ? std::optional<Slice2D>{
                             {
-                                    {(unsigned) t, (unsigned) t + 1},
-                                    {r, r + 1}
+                                    {(unsigned) t, (unsigned) t + k},
+                                    {r, r + k}
                             }}
                             : std::nullopt;
 
-            auto left = (l > 0) ? std::optional<Slice2D>{
+            auto left = hasLeft ? std::optional<Slice2D>{
                     {{y, y + h},
-                            {(unsigned) l, (unsigned) l + 1}}} : std::nullopt;
-            auto right = r < nx - 1
+                            {(unsigned) l, (unsigned) l + k}}} : std::nullopt;
+            auto right = hasRight
                          ? std::optional<Slice2D>{{{y, y + h},
-                                                          {r, r + 1}}}
+                                                          {r, r + k}}}
                          : std::nullopt;
-            auto bottomLeft = (l > 0 && b < ny - 1)
-                              ? std::optional<Slice2D>{{{b, b + 1},
-                                                               {(unsigned) l, (unsigned) l + 1}}}
+            auto bottomLeft = (hasLeft && hasBottom)
+                              ? std::optional<Slice2D>{{{b, b + k},
+                                                               {(unsigned) l, (unsigned) l + k}}}
                               : std::nullopt;
-            auto bottom = (b < ny - 1)
+            auto bottom = hasBottom
                           ? std::optional<Slice2D>{
-                            {{b, b + 1},
+                            {{b, b + k},
                                     {x, x + w}}}
                           : std::nullopt;
-            auto bottomRight = (b < ny - 1) && (r < nx - 1)
+            auto bottomRight = hasBottom && hasRight
                                ? std::optional<Slice2D>{
                             {
-                                    {b, b + 1},
-                                    {r, r + 1}
+                                    {b, b + k},
+                                    {r, r + k}
                             }} : std::nullopt;
             return Halos(top, bottom, left, right, topLeft, topRight, bottomLeft, bottomRight);
 
@@ -801,8 +1472,10 @@ namespace grids {
 
         }
 
+        // Every slice must start and end on the edge of the matrix or at least depth cells from it, so that no
+        // halo region is split by the wraparound
         static auto
-        forSliceWithWraparound(Slice2D slice, Size2D matrixSize) -> Halos {
+        forSliceWithWraparound(Slice2D slice, Size2D matrixSize, const size_t depth = 1) -> Halos {
             // Some shorthand sugar
             const auto x = slice.cols().from();
             const auto y = slice.rows().from();
@@ -810,40 +1483,43 @@ namespace grids {
             const auto h = slice.height();
             const auto nx = matrixSize.cols();
             const auto ny = matrixSize.rows();
+            const auto k = depth;
+            assert(k > 0 && (x == 0 || x >= k) && (y == 0 || y >= k));
+            assert((x + w == nx || x + w + k <= nx) && (y + h == ny || y + h + k <= ny));
 
             std::optional<size_t> t, l, r, b;
-            t = (ny + y - 1) % ny;
-            l = (nx + x - 1) % nx;
+            t = (ny + y - k) % ny;
+            l = (nx + x - k) % nx;
             r = (nx + x + w) % nx;
             b = (ny + y + h) % ny;
 
             auto topLeft = std::optional<Slice2D>{
-                    {{*t, *t + 1},
-                            {*l, *l + 1}}};
+                    {{*t, *t + k},
+                            {*l, *l + k}}};
             auto top = std::optional<Slice2D>{
-                    {{*t, *t + 1},
+                    {{*t, *t + k},
                             {x, x + w}}};
 
             auto topRight = std::optional<Slice2D>{
                     {
-                            {*t, *t + 1},
-                            {*r, *r + 1}
+                            {*t, *t + k},
+                            {*r, *r + k}
                     }};
 
             auto left = std::optional<Slice2D>{
                     {{y, y + h},
-                            {*l, *l + 1}}};
+                            {*l, *l + k}}};
             auto right = std::optional<Slice2D>{{{y, y + h},
-                                                        {*r, *r + 1}}};
-            auto bottomLeft = std::optional<Slice2D>{{{*b, *b + 1},
-                                                             {*l, *l + 1}}};
+                                                        {*r, *r + k}}};
+            auto bottomLeft = std::optional<Slice2D>{{{*b, *b + k},
+                                                             {*l, *l + k}}};
             auto bottom = std::optional<Slice2D>{
-                    {{*b, *b + 1},
+                    {{*b, *b + k},
                             {x, x + w}}};
             auto bottomRight = std::optional<Slice2D>{
                     {
-                            {*b, *b + 1},
-                            {*r, *r + 1}
+                            {*b, *b + k},
+                            {*r, *r + k}
                     }};
             return Halos(top, bottom, left, right, topLeft, topRight, bottomLeft, bottomRight);
 
@@ -851,5 +1527,348 @@ namespace grids {
 
     };
 
+
+    constexpr auto DefaultMinEdgePerBrick = 4u;
+
+    /** A candidate planes x rows x cols decomposition into bricks and its predicted cost for the biggest brick */
+    struct BrickGridChoice {
+        std::array<size_t, 3> parts; // How many bricks along the planes, rows and cols
+        std::array<size_t, 3> brick; // The biggest brick's planes, rows and cols
+        double computeCycles;
+        double exchangeCycles;
+        size_t haloDepth = 1; // A superstep is one exchange and haloDepth sweeps
+
+        [[nodiscard]] auto numBricks() const -> size_t { return parts[0] * parts[1] * parts[2]; }
+
+        [[nodiscard]] auto superstepCycles() const -> double { return computeCycles + exchangeCycles; }
+
+        auto explain(ostream &os = cout) const -> void {
+            os << parts[0] << "x" << parts[1] << "x" << parts[2] << " bricks (" << numBricks() << " used) of up to "
+               << brick[0] << "x" << brick[1] << "x" << brick[2] << " cells: " << std::fixed << std::setprecision(0)
+               << computeCycles << " compute + " << exchangeCycles << " exchange = " << superstepCycles()
+               << " cycles per superstep" << std::defaultfloat;
+            if (haloDepth > 1) os << " of " << haloDepth << " sweeps";
+            os << endl;
+        }
+    };
+
+    /**
+     * The cost of the biggest brick when size is split into parts: its cells, plus its 26-neighbour halo. A brick
+     * with neighbours on both sides of every dimension has a halo of (p + 2k)(r + 2k)(c + 2k) - prc cells for a
+     * halo depth of k, and redoes part of that halo's work in the k sweeps between exchanges
+     */
+    auto brickGridCost(const Size3D size, const std::array<size_t, 3> parts, const TileCostModel &model)
+    -> BrickGridChoice {
+        const auto extents = std::array<size_t, 3>{size.depth(), size.rows(), size.cols()};
+        auto brick = std::array<size_t, 3>{};
+        auto neighbours = std::array<size_t, 3>{};
+        for (auto i = 0u; i < 3; i++) {
+            brick[i] = (extents[i] + parts[i] - 1) / parts[i];
+            neighbours[i] = min(parts[i] - 1, (size_t) 2);
+        }
+        return {parts, brick,
+                model.cyclesPerCell * static_cast<double>(sweptCells(brick, neighbours, model.haloDepth)),
+                model.cyclesPerExchange + model.cyclesPerHaloByte * model.bytesPerCell *
+                                          static_cast<double>(deepHaloCells(brick, neighbours, model.haloDepth)),
+                model.haloDepth};
+    }
+
+    /**
+     * Scores the ways of splitting size into at most numBricks bricks (exactly numBricks if exact is set) whose
+     * edges are at least minEdge cells and the halo depth (unless that dimension isn't split) and whose cells with
+     * their halo fit in maxCellsPerBrick, and returns them cheapest first. Ties go to fewer bricks, then longer rows
+     */
+    auto rankBrickGrids(const Size3D size,
+                        const size_t numBricks,
+                        const TileCostModel &model = {},
+                        const size_t minEdge = DefaultMinEdgePerBrick,
+                        const size_t maxCellsPerBrick = std::numeric_limits<size_t>::max(),
+                        const bool exact = false) -> std::vector<BrickGridChoice> {
+        const auto minExtent = max({(size_t) 1, minEdge, model.haloDepth});
+        const auto maxParts = [&](const size_t extent) { return max((size_t) 1, extent / minExtent); };
+        auto result = std::vector<BrickGridChoice>{};
+        for (auto planes = 1ul; planes <= min(numBricks, maxParts(size.depth())); planes++) {
+            for (auto rows = 1ul; rows <= min(numBricks / planes, maxParts(size.rows())); rows++) {
+                const auto maxCols = min(numBricks / (planes * rows), maxParts(size.cols()));
+                for (auto cols = exact ? maxCols : 1ul; cols <= maxCols; cols++) {
+                    if (exact && planes * rows * cols != numBricks) continue;
+                    const auto choice = brickGridCost(size, {planes, rows, cols}, model);
+                    const auto &b = choice.brick;
+                    const auto padding = exact ? 0 : 2 * model.haloDepth;
+                    const auto haloCells = (b[0] + padding) * (b[1] + padding) * (b[2] + padding);
+                    if (haloCells > maxCellsPerBrick) continue;
+                    result.push_back(choice);
+                }
+            }
+        }
+        std::stable_sort(result.begin(), result.end(), [](const BrickGridChoice &a, const BrickGridChoice &b) {
+            if (a.superstepCycles() != b.superstepCycles()) return a.superstepCycles() < b.superstepCycles();
+            if (a.numBricks() != b.numBricks()) return a.numBricks() < b.numBricks();
+            return a.brick[2] > b.brick[2];
+        });
+        return result;
+    }
+
+    /** Lays out choice's bricks over slice in plane, row, col order, giving brick i the target made by targetFor(i) */
+    auto layoutBricks(const Slice3D slice, const BrickGridChoice &choice,
+                      const std::function<PartitioningTarget(size_t)> &targetFor,
+                      const size_t tilesPerIpu = DefaultNumTilesPerIpu) -> GridPartitioning3D {
+        auto allocs = std::array<std::vector<size_t>, 3>{};
+        const auto starts = std::array<size_t, 3>{slice.planes().from(), slice.rows().from(), slice.cols().from()};
+        const auto extents = std::array<size_t, 3>{slice.depth(), slice.height(), slice.width()};
+        for (auto i = 0u; i < 3; i++) {
+            allocs[i] = std::vector<size_t>(choice.parts[i], 0);
+            roundRobinFill(allocs[i], extents[i]);
+        }
+
+        auto result = GridPartitioning3D{tilesPerIpu};
+        result.reserve(choice.numBricks());
+        auto brick = 0ul;
+        auto p = starts[0];
+        for (const auto planes: allocs[0]) {
+            auto r = starts[1];
+            for (const auto rows: allocs[1]) {
+                auto c = starts[2];
+                for (const auto cols: allocs[2]) {
+                    result.insert({targetFor(brick), {{p, p + planes}, {r, r + rows}, {c, c + cols}}});
+                    c += cols;
+                    brick++;
+                }
+                r += rows;
+            }
+            p += planes;
+        }
+        return result;
+    }
+
+    /**
+     * Splits a 3D grid into exactly numIpus bricks, picking the factorisation that minimises the biggest brick's
+     * cells plus its inter-IPU halo weighted by interIpuHaloCost. nullopt if it doesn't fit.
+     * All MappingTargets will have tile=0 and worker=0. Use toTilePartitions3D to refine them down to tiles
+     */
+    auto partitionForIpus3D(const Size3D size,
+                            const size_t numIpus,
+                            const size_t maxCellsPerIpu,
+                            const double interIpuHaloCost = DefaultInterIpuHaloCost) -> optional<GridPartitioning3D> {
+        if (size.cells() > maxCellsPerIpu * numIpus) return nullopt;
+        const auto ranked = rankBrickGrids(size, numIpus, {1.0, 1.0, interIpuHaloCost}, 1, maxCellsPerIpu, true);
+        if (ranked.empty()) return nullopt;
+        const auto whole = Slice3D{{0, size.depth()}, {0, size.rows()}, {0, size.cols()}};
+        return layoutBricks(whole, ranked.front(), [](const size_t ipu) { return PartitioningTarget{ipu}; });
+    }
+
+    /** partitionForIpus3D over the target's IPUs, where an IPU holds as many cells as fit in its tiles' memory */
+    auto partitionForIpus3D(const Size3D size,
+                            const poplar::Target &target,
+                            const size_t bytesPerCell,
+                            const double interIpuHaloCost = DefaultInterIpuHaloCost) -> optional<GridPartitioning3D> {
+        const auto device = PartitioningDevice::fromTarget(target);
+        return partitionForIpus3D(size, device.numIpus, device.tilesPerIpu * device.maxCellsPerTile(bytesPerCell),
+                                  interIpuHaloCost);
+    }
+
+    /**
+     * Splits one IPU's brick between its tiles with the shortest predicted superstep. With explain set, it prints
+     * the winner and the runners-up
+     */
+    auto costModelBrickStrategy(const PartitioningTarget target,
+                                const Slice3D slice,
+                                const size_t numTiles,
+                                const TileCostModel &model = {},
+                                const size_t minEdge = DefaultMinEdgePerBrick,
+                                const size_t maxCellsPerTile = std::numeric_limits<size_t>::max(),
+                                ostream *explain = nullptr) -> GridPartitioning3D {
+        const auto ranked = rankBrickGrids(slice.size(), numTiles, model, minEdge, maxCellsPerTile);
+        if (ranked.empty()) {
+            throw std::invalid_argument("Can't fit " + Slice3D::print(slice) + " on " + std::to_string(numTiles) +
+                                        " tiles of at most " + std::to_string(maxCellsPerTile) + " cells");
+        }
+        if (explain != nullptr) {
+            *explain << "Partitioning " << Slice3D::print(slice) << " on IPU " << target.ipu() << " into ";
+            ranked.front().explain(*explain);
+            for (auto i = 1u; i < min(ranked.size(), (size_t) 4); i++) {
+                *explain << "  vs ";
+                ranked[i].explain(*explain);
+            }
+        }
+        const auto ipu = target.ipu();
+        return layoutBricks(slice, ranked.front(),
+                            [ipu](const size_t tile) { return PartitioningTarget{ipu, tile}; }, numTiles);
+    }
+
+    /**
+     * Refines IPU-level bricks into tile-level bricks, partitioning each IPU on its own thread. With explain set,
+     * each IPU's choice (see costModelBrickStrategy) is printed to it, in IPU order
+     */
+    auto toTilePartitions3D(const GridPartitioning3D &ipuMappings,
+                            const size_t numTiles = DefaultNumTilesPerIpu,
+                            const TileCostModel &model = {},
+                            const size_t minEdge = DefaultMinEdgePerBrick,
+                            const size_t maxCellsPerTile = std::numeric_limits<size_t>::max(),
+                            ostream *explain = nullptr) -> GridPartitioning3D {
+        assert(ipuMappings.size() > 0);
+        // The threads explain into their own streams, so their output doesn't interleave
+        auto explanations = std::vector<std::stringstream>(ipuMappings.size());
+        auto parts = std::vector<std::future<GridPartitioning3D>>{};
+        for (const auto&[target, ipuSlice]: ipuMappings) {
+            auto ipuExplain = explain != nullptr ? &explanations[parts.size()] : nullptr;
+            parts.push_back(std::async(std::launch::async, [=, &model]() {
+                return costModelBrickStrategy(target, ipuSlice, numTiles, model, minEdge, maxCellsPerTile,
+                                              ipuExplain);
+            }));
+        }
+        auto results = std::vector<GridPartitioning3D>{};
+        for (auto &part: parts) results.push_back(part.get());
+        if (explain != nullptr) {
+            for (const auto &explanation: explanations) *explain << explanation.str();
+        }
+        return GridPartitioning3D::merge(results);
+    }
+
+    /** toTilePartitions3D for the target's tile count and memory, for cells of bytesPerCell */
+    auto toTilePartitions3D(const GridPartitioning3D &ipuMappings,
+                            const poplar::Target &target,
+                            const size_t bytesPerCell,
+                            const TileCostModel &model = {},
+                            const size_t minEdge = DefaultMinEdgePerBrick,
+                            ostream *explain = nullptr) -> GridPartitioning3D {
+        const auto device = PartitioningDevice::fromTarget(target);
+        return toTilePartitions3D(ipuMappings, device.tilesPerIpu, model, minEdge,
+                                  device.maxCellsPerTile(bytesPerCell), explain);
+    }
+
+    /**
+     * Splits a tile's brick between its workers by planes or by rows, whichever is more even. Columns are never
+     * split, so every worker keeps whole contiguous rows
+     */
+    auto toWorkerPartitions3D(const PartitioningTarget target, const Slice3D slice,
+                              const size_t numWorkersPerTile = DefaultNumWorkersPerTile) -> GridPartitioning3D {
+        const auto planeImbalance = (float) (slice.depth() % numWorkersPerTile) / (float) slice.depth();
+        const auto rowImbalance = (float) (slice.height() % numWorkersPerTile) / (float) slice.height();
+        const auto byPlanes = slice.depth() >= numWorkersPerTile ? planeImbalance <= rowImbalance
+                                                                 : slice.depth() > slice.height();
+
+        const auto extent = byPlanes ? slice.depth() : slice.height();
+        auto allocs = std::vector<size_t>(min(extent, numWorkersPerTile), 0);
+        roundRobinFill(allocs, extent);
+
+        auto result = GridPartitioning3D{target.tile() + 1, numWorkersPerTile};
+        auto from = byPlanes ? slice.planes().from() : slice.rows().from();
+        for (auto worker = 0ul; worker < allocs.size(); worker++) {
+            const auto part = Range{from, from + allocs[worker]};
+            result.insert({PartitioningTarget{target.ipu(), target.tile(), worker},
+                           byPlanes ? Slice3D{part, slice.rows(), slice.cols()}
+                                    : Slice3D{slice.planes(), part, slice.cols()}});
+            from += allocs[worker];
+        }
+        return result;
+    }
+
+    auto toWorkerPartitions3D(const GridPartitioning3D &tileMappings,
+                              const size_t numWorkersPerTile = DefaultNumWorkersPerTile) -> GridPartitioning3D {
+        auto result = GridPartitioning3D{tileMappings.tilesPerIpu(), numWorkersPerTile};
+        result.reserve(tileMappings.size() * numWorkersPerTile);
+        for (const auto &[target, slice]: tileMappings) {
+            for (const auto &entry: toWorkerPartitions3D(target, slice, numWorkersPerTile)) {
+                result.insert(entry);
+            }
+        }
+        return result;
+    }
+
+
+    /**
+     * The 26 halo regions around a brick of a 3D grid: 6 faces, 12 edges and 8 corners, each depth cells deep. Each
+     * is identified by its direction (dPlane, dRow, dCol), with every component in {-1, 0, 1}, and is nullopt where
+     * the brick touches the boundary of a grid that doesn't wrap around
+     */
+    class Halos3D {
+        std::array<std::optional<Slice3D>, 27> t_regions; // The centre (0, 0, 0) is never set
+
+        static auto indexOf(const int dPlane, const int dRow, const int dCol) -> size_t {
+            assert(dPlane >= -1 && dPlane <= 1 && dRow >= -1 && dRow <= 1 && dCol >= -1 && dCol <= 1);
+            return (dPlane + 1) * 9 + (dRow + 1) * 3 + (dCol + 1);
+        }
+
+        // The depth-cell range beside [from, to) in direction d, or the range itself for d = 0. Ranges are at least
+        // depth cells from the edge unless they touch it, so a wrapped range is never split
+        static auto beside(const Range range, const int d, const size_t extent, const bool wrap,
+                           const size_t depth) -> optional<Range> {
+            if (d == 0) return range;
+            if (d < 0) {
+                if (range.from() > 0) {
+                    assert(range.from() >= depth);
+                    return Range{range.from() - depth, range.from()};
+                }
+                return wrap ? std::optional<Range>{Range{extent - depth, extent}} : std::nullopt;
+            }
+            if (range.to() < extent) {
+                assert(range.to() + depth <= extent);
+                return Range{range.to(), range.to() + depth};
+            }
+            return wrap ? std::optional<Range>{Range{0, depth}} : std::nullopt;
+        }
+
+        static auto forSlice(const Slice3D slice, const Size3D gridSize, const bool wrap,
+                             const size_t depth) -> Halos3D {
+            assert(depth > 0);
+            auto result = Halos3D{};
+            for (const auto &[dPlane, dRow, dCol]: directions()) {
+                const auto planes = beside(slice.planes(), dPlane, gridSize.depth(), wrap, depth);
+                const auto rows = beside(slice.rows(), dRow, gridSize.rows(), wrap, depth);
+                const auto cols = beside(slice.cols(), dCol, gridSize.cols(), wrap, depth);
+                if (planes && rows && cols) {
+                    result.t_regions[indexOf(dPlane, dRow, dCol)] = Slice3D{*planes, *rows, *cols};
+                }
+            }
+            return result;
+        }
+
+    public:
+        /** All 26 directions, faces first, then edges, then corners */
+        static auto directions() -> const std::vector<std::array<int, 3>> & {
+            static const auto all = []() {
+                auto result = std::vector<std::array<int, 3>>{};
+                for (auto nonZero = 1; nonZero <= 3; nonZero++) {
+                    for (auto dPlane = -1; dPlane <= 1; dPlane++) {
+                        for (auto dRow = -1; dRow <= 1; dRow++) {
+                            for (auto dCol = -1; dCol <= 1; dCol++) {
+                                if ((dPlane != 0) + (dRow != 0) + (dCol != 0) == nonZero) {
+                                    result.push_back({dPlane, dRow, dCol});
+                                }
+                            }
+                        }
+                    }
+                }
+                return result;
+            }();
+            return all;
+        }
+
+        [[nodiscard]] auto at(const int dPlane, const int dRow, const int dCol) const -> const optional<Slice3D> & {
+            return t_regions[indexOf(dPlane, dRow, dCol)];
+        }
+
+        /** Cells outside the grid have no halo region: the stencil treats them as a fixed boundary */
+        static auto forSliceNoWrap(const Slice3D slice, const Size3D gridSize, const size_t depth = 1) -> Halos3D {
+            return forSlice(slice, gridSize, false, depth);
+        }
+
+        /** Periodic boundaries: a brick on the edge of the grid gets its halo from the opposite side */
+        static auto forSliceWithWraparound(const Slice3D slice, const Size3D gridSize,
+                                           const size_t depth = 1) -> Halos3D {
+            return forSlice(slice, gridSize, true, depth);
+        }
+
+        static auto debugHalos(const Halos3D &h) -> void {
+            std::cout << "---" << std::endl;
+            for (const auto &[dPlane, dRow, dCol]: directions()) {
+                const auto &region = h.at(dPlane, dRow, dCol);
+                std::cout << "(" << std::setw(2) << dPlane << "," << std::setw(2) << dRow << "," << std::setw(2)
+                          << dCol << "): " << (region.has_value() ? Slice3D::print(*region) : "") << std::endl;
+            }
+        }
+    };
+
 }
 #endif //LBM_GRAPHCORE_STRUCTUREGRIDUTILS_H
@@ -7,6 +7,16 @@
 
 using namespace poplar;
 
+template<typename T>
+T min(const T a, const T b) {
+    return a < b ? a : b;
+}
+
+template<typename T>
+T max(const T a, const T b) {
+    return a > b ? a : b;
+}
+
 template<typename T>
 T stencil(const T nw, const T n, const T ne, const T w, const T m,
           const T e, const T sw,
@@ -37,13 +47,22 @@ class IncludedHalosApproach : public Vertex {
 public:
     Input <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> in;
     Output <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> out;
+    // The grid is compiled for its maximum size, and only the cells in the first activeRows x activeCols are
+    // updated. firstRow and firstCol are where this block's non-ghost cells start in the whole grid
+    Input<unsigned> activeRows;
+    Input<unsigned> activeCols;
+    unsigned firstRow;
+    unsigned firstCol;
 
     // Average the moore neighbourhood of the non-ghost part of the block
     bool compute() {
+        if (*activeRows <= firstRow || *activeCols <= firstCol) return true; // The whole block is inactive
         // Only works if this is at least a 3x3 block, and in must be same size as out
         if (out.size() == in.size() && in.size() > 2 && in[0].size() > 2 && in[0].size() == out[0].size()) {
-            for (auto y = 1u; y < in.size() - 1; y++) {
-                for (auto x = 1u; x < in[y].size() - 1; x++) {
+            const auto rowsEnd = min<unsigned>(in.size() - 1, *activeRows - firstRow + 1);
+            const auto colsEnd = min<unsigned>(in[0].size() - 1, *activeCols - firstCol + 1);
+            for (auto y = 1u; y < rowsEnd; y++) {
+                for (auto x = 1u; x < colsEnd; x++) {
                     out[y][x] = stencil(in[y - 1][x - 1], in[y - 1][x], in[y - 1][x + 1],
                                         in[y][x - 1], in[y][x], in[y][x + 1],
                                         in[y + 1][x - 1], in[y + 1][x], in[y + 1][x + 1]);
@@ -59,6 +78,47 @@ template
 class IncludedHalosApproach<float>;
 
 
+// One of the sweeps between two exchanges of deep halos (temporal blocking). in and out are the block with a
+// halo of depth cells all round, and the sweep updates the cells at least margin from the edge: the first sweep
+// after an exchange has margin 1, and the last has margin depth, which is just the block. Cells outside the grid
+// or the active extents are never updated. originRow and originCol are where in[0][0] is in the whole grid, so
+// they are negative for a block on the top or left edge
+template<typename T>
+class DeepHaloSweep : public Vertex {
+
+public:
+    Input <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> in;
+    Output <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> out;
+    Input<unsigned> activeRows;
+    Input<unsigned> activeCols;
+    int originRow;
+    int originCol;
+    unsigned margin;
+
+    bool compute() {
+        if (out.size() != in.size() || in[0].size() != out[0].size() || margin == 0) return false;
+        const int rows = in.size();
+        const int cols = in[0].size();
+        const int m = margin;
+        const auto rowsFrom = max(m, -originRow);
+        const auto colsFrom = max(m, -originCol);
+        const auto rowsEnd = min(rows - m, (int) *activeRows - originRow);
+        const auto colsEnd = min(cols - m, (int) *activeCols - originCol);
+        for (auto y = rowsFrom; y < rowsEnd; y++) {
+            for (auto x = colsFrom; x < colsEnd; x++) {
+                out[y][x] = stencil(in[y - 1][x - 1], in[y - 1][x], in[y - 1][x + 1],
+                                    in[y][x - 1], in[y][x], in[y][x + 1],
+                                    in[y + 1][x - 1], in[y + 1][x], in[y + 1][x + 1]);
+            }
+        }
+        return true;
+    }
+};
+
+template
+class DeepHaloSweep<float>;
+
+
 template<typename T>
 class ExtraHalosApproach : public Vertex {
 
@@ -172,13 +232,40 @@ template
 class ExtraHalosApproach<float>;
 
 
+// A 27-point average over a brick of a 3D grid. in is the brick with a 1-cell halo all round, as
+// (planes + 2) x (rows + 2) rows of cols + 2 values; out is the brick itself, as planes x rows rows of cols values
+template<typename T>
+class Stencil27Point : public Vertex {
 
+public:
+    Input <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> in;
+    Output <VectorList<T, poplar::VectorListLayout::COMPACT_DELTAN, 4, false>> out;
+    unsigned planes;
+    unsigned rows;
 
+    bool compute() {
+        const auto cols = out[0].size();
+        const auto paddedRows = rows + 2;
+        if (in.size() != (planes + 2) * paddedRows || out.size() != planes * rows || in[0].size() != cols + 2) {
+            return false;
+        }
+        for (auto z = 0u; z < planes; z++) {
+            for (auto y = 0u; y < rows; y++) {
+                for (auto x = 0u; x < cols; x++) {
+                    T sum = 0;
+                    for (auto dz = 0u; dz < 3; dz++) {
+                        for (auto dy = 0u; dy < 3; dy++) {
+                            const auto &row = in[(z + dz) * paddedRows + y + dy];
+                            sum += row[x] + row[x + 1] + row[x + 2];
+                        }
+                    }
+                    out[z * rows + y][x] = sum / 27;
+                }
+            }
+        }
+        return true;
+    }
+};
 
-
-
-
-
-
-
-
+template
+class Stencil27Point<float>;
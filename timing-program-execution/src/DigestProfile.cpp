@@ -0,0 +1,44 @@
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ProfileDigest.hpp"
+
+/**
+ * Summarises the profile.pop written by an engine run with autoReport.all (e.g. --engine-profile=light-profile),
+ * or compares two of them:
+ *
+ *     profile-digest <profile.pop> [<other profile.pop>] [--json=<digest.json>]
+ */
+int main(int argc, char *argv[]) {
+    auto profiles = std::vector<std::string>{};
+    auto jsonPath = std::string{};
+    for (auto i = 1; i < argc; i++) {
+        const auto arg = std::string{argv[i]};
+        if (arg.rfind("--json=", 0) == 0) {
+            jsonPath = arg.substr(7);
+        } else {
+            profiles.push_back(arg);
+        }
+    }
+    if (profiles.empty() || profiles.size() > 2) {
+        std::cerr << "Usage: " << argv[0] << " <profile.pop> [<other profile.pop>] [--json=<digest.json>]"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto digest = ipu::ProfileDigest::fromFile(profiles[0]);
+    digest.print();
+    if (!jsonPath.empty()) {
+        digest.writeJson(jsonPath);
+    }
+
+    if (profiles.size() == 2) {
+        const auto other = ipu::ProfileDigest::fromFile(profiles[1]);
+        std::cout << std::endl << "A: " << profiles[0] << std::endl << "B: " << profiles[1] << std::endl;
+        ipu::ProfileDigest::printComparison(digest, other);
+    }
+
+    return EXIT_SUCCESS;
+}
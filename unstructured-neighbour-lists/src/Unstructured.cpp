@@ -350,19 +350,25 @@ int main() {
     };
 
 
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
     const auto program = Repeat(
             NumIterations,
-            Sequence{updateAToB(),
-                     updateBToA()
+            Sequence{cycles.wrap("updateAToB", updateAToB()),
+                     cycles.wrap("updateBToA", updateBToA())
             }
     );
 
 
     auto engine = ipu::prepareEngine(graph, {program}, *device);
-
-    auto timer = ipu::startTimer("Running append program");
-    engine.run(0);
-    ipu::endTimer(timer);
+    cycles.connect(engine);
+
+    // Each iteration updates every node twice (A to B, then B to A)
+    auto bench = ipu::Benchmark::fromEnvironment("unstructuredNeighbourLists")
+            .throughput("node updates", 2.0 * NumIterations * NumNodes)
+            .afterWarmups([&]() { cycles.reset(); });
+    bench.run([&]() { engine.run(0); });
+    bench.report();
+    cycles.report();
 
     return EXIT_SUCCESS;
 }
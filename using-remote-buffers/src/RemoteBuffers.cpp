@@ -4,6 +4,7 @@
 #include <poputil/TileMapping.hpp>
 #include <popops/ElementWise.hpp>
 #include <popops/codelets.hpp>
+#include <popops/Zero.hpp>
 #include <poplar/Program.hpp>
 #include <algorithm>
 
@@ -92,7 +93,18 @@ int main() {
         return s;
     };
 
-    const auto program = Sequence{
+    // Start from the first chunk on every run, so the program can be run repeatedly when benchmarking
+    const auto resetRemoteBufferIndices = [&]() -> Sequence {
+        Sequence s;
+        popops::zero(graph, remoteBuffer0Index, s, "resetOffset0");
+        popops::zero(graph, remoteBuffer1Index, s, "resetOffset1");
+        return s;
+    };
+
+    // Only time the whole pipeline: counting its phases separately would add syncs that stop them overlapping
+    auto cycles = ipu::CycleCounter::fromEnvironment(graph);
+    const auto program = cycles.wrap("pipeline", Sequence{
+            resetRemoteBufferIndices(),
             copyFromRbToIpu0,
             Sequence{processDataOnIpu0, copyFromRbToIpu1},
             Sequence{copyFromIpu0ToRb, processDataOnIpu1},
@@ -105,10 +117,11 @@ int main() {
                            Sequence{copyFromIpu0ToRb, processDataOnIpu1}}
             ),
             copyFromIpu1ToRb
-    };
+    });
 
 
     auto engine = ipu::prepareEngine(graph, {program}, *device);
+    cycles.connect(engine);
 
     // We use engine.copyToRemoteBuffer() to store some initial data in the remote buffer
     // We're just going to copy 0...,1...,2...,.... to the data0 chunks and 100...,101.... etc to the data1 chunks
@@ -121,18 +134,25 @@ int main() {
             dataInKernelMemory[i] = val;
         }
     };
-    for (auto i = 0; i < NumDataRepeats; i++) {
-        fillBufferWith(i);
-        engine.copyToRemoteBuffer(dataInKernelMemory, remoteBuffer0.handle(), i);
-        fillBufferWith(100 + i);
-        engine.copyToRemoteBuffer(dataInKernelMemory, remoteBuffer1.handle(), i);
-    }
+    const auto copyInitialDataToRemoteBuffers = [&]() {
+        for (auto i = 0; i < NumDataRepeats; i++) {
+            fillBufferWith(i);
+            engine.copyToRemoteBuffer(dataInKernelMemory, remoteBuffer0.handle(), i);
+            fillBufferWith(100 + i);
+            engine.copyToRemoteBuffer(dataInKernelMemory, remoteBuffer1.handle(), i);
+        }
+    };
 
     engine.disableExecutionProfiling();
 
-    auto timer = ipu::startTimer("Running Program");
-    engine.run(0);
-    ipu::endTimer(timer);
+    // Every chunk of both remote buffers is copied to the IPUs and back once per run
+    const auto bytesMovedPerRun = 2.0 * 2.0 * NumDataRepeats * NumElemsToTransfer * sizeof(int);
+    auto bench = ipu::Benchmark::fromEnvironment("remoteBuffers", 1, 5)
+            .throughput("GB", bytesMovedPerRun / 1e9)
+            .afterWarmups([&]() { cycles.reset(); });
+    bench.run([&]() { engine.run(0); }, copyInitialDataToRemoteBuffers);
+    bench.report();
+    cycles.report();
 
     // We use engine.copyFromRemoteBuffer() to copy the final data in the remote buffer back to kernel memory
     // And check that it's the expected value: every byte should have the value 1 now